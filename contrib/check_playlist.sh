@@ -0,0 +1,47 @@
+#!/bin/sh
+
+# check that every entry of a playlist is played exactly once.
+# Plays <count> one-frame raw files (listed in a playlist) on the setup
+# of <prefs-file> with and without decode-ahead and counts the entries
+# ledcat reports. Hardware of the setup should be harmless to send to
+# (e.g. the "dummy" plugin).
+
+PREFS="$1"
+COUNT="${2:-10}"
+LEDCAT="${LEDCAT:-ledcat}"
+
+if [ -z "${PREFS}" ] ; then echo "Usage: $0 <prefs-file> [count] (LEDCAT=<path to ledcat>)" ; exit 1 ; fi
+
+TMP="$(mktemp -d)" || exit 1
+trap 'rm -rf "${TMP}"' EXIT
+
+# one 8x8 RGB frame per file, scaled to the setup by ledcat
+for n in $(seq 1 ${COUNT}) ; do
+    head -c 192 /dev/zero > "${TMP}/${n}.rgb"
+    echo "${TMP}/${n}.rgb" >> "${TMP}/list"
+done
+
+FAILED=0
+
+# play list with extra options & count entries reported
+check() {
+    "${LEDCAT}" -c "${PREFS}" -l debug -f "RGB u8" -d 8x8 -s box -F 100 \
+        "$@" -i "${TMP}/list" > "${TMP}/log" 2>&1
+    PLAYED=$(grep -c "Getting pixels from" "${TMP}/log")
+    if [ "${PLAYED}" -ne "${COUNT}" ] ; then
+        echo "FAIL: ($*) played ${PLAYED} of ${COUNT} entries"
+        FAILED=1
+    else
+        echo "OK: ($*) played ${COUNT} entries"
+    fi
+}
+
+# builds without ImageMagick always read raw & never decode ahead
+if "${LEDCAT}" --help | grep -q -- "--prefetch" ; then
+    check --raw --prefetch 0
+    check --raw --prefetch 4
+else
+    check
+fi
+
+exit ${FAILED}
@@ -0,0 +1,62 @@
+#!/bin/sh
+
+# check that --video plays every frame of a clip at its own timestamp.
+# Generates a <frames> long testsrc clip at <fps> with ffmpeg, plays it on
+# the setup of <prefs-file> and checks the amount & timestamps of decoded
+# frames and the time playback took. Hardware of the setup should be
+# harmless to send to (e.g. the "dummy" plugin).
+
+PREFS="$1"
+FRAMES="${2:-50}"
+FPS="${3:-25}"
+LEDCAT="${LEDCAT:-ledcat}"
+FFMPEG="${FFMPEG:-ffmpeg}"
+
+if [ -z "${PREFS}" ] ; then echo "Usage: $0 <prefs-file> [frames] [fps] (LEDCAT=<path to ledcat> FFMPEG=<path to ffmpeg>)" ; exit 1 ; fi
+
+if ! "${LEDCAT}" --help | grep -q -- "--video" ; then echo "SKIP: ledcat built without video decoding" ; exit 0 ; fi
+
+TMP="$(mktemp -d)" || exit 1
+trap 'rm -rf "${TMP}"' EXIT
+
+# lossless codec that every ffmpeg build has
+"${FFMPEG}" -v error -f lavfi -i "testsrc=size=64x48:rate=${FPS}" \
+    -frames:v "${FRAMES}" -c:v ffv1 "${TMP}/clip.mkv" || exit 1
+
+START=$(date +%s.%N)
+"${LEDCAT}" -c "${PREFS}" -l debug -f "RGB u8" -d 8x8 --video \
+    "${TMP}/clip.mkv" > "${TMP}/log" 2>&1
+END=$(date +%s.%N)
+
+# every frame decoded, in order, at n / fps
+grep "Video frame at" "${TMP}/log" | sed 's/.*Video frame at \([0-9.]*\) s.*/\1/' | \
+    awk -v frames="${FRAMES}" -v fps="${FPS}" -v start="${START}" -v end="${END}" '
+    {
+        want = NR - 1
+        got = $1 * fps
+        if(got - want > 0.01 || want - got > 0.01)
+        {
+            printf("FAIL: frame %d at %s s (expected %.3f s)\n", want, $1, want / fps)
+            failed = 1
+        }
+    }
+    END {
+        if(NR != frames)
+        {
+            printf("FAIL: decoded %d of %d frames\n", NR, frames)
+            failed = 1
+        }
+
+        # last frame is latched (frames - 1) / fps after the first
+        took = end - start
+        least = (frames - 1) / fps
+        if(took < least || took > least + 2)
+        {
+            printf("FAIL: playback took %.2f s (expected %.2f s)\n", took, least)
+            failed = 1
+        }
+
+        if(!failed)
+            printf("OK: %d frames at %s fps in %.2f s\n", frames, fps, took)
+        exit failed
+    }'
@@ -1,6 +1,8 @@
 #!/bin/sh
 
 # print video-data as RAW 24-bit RGB values to stdout
+# ledcat can decode & scale videos in-process when built with libav:
+#   ledcat --video <file>
 
 # adjust this to match your desired dimensions
 WIDTH=16
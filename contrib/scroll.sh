@@ -1,5 +1,9 @@
 #!/bin/sh
 
+# split an image into one file per pixel offset for scrolling.
+# ledcat can do this in-process without writing any files:
+#   ledcat --scroll left[,<pixels per second>] [--wrap] <image>
+
 FILENAME="$1"
 WIDTH="$2"
 
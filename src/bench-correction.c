@@ -0,0 +1,158 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Benchmark of the color correction stage: time per 100x100 frame for
+ * u8 & u16 components with gamma 1.0 (gain kernels) and 2.2 (lookup
+ * tables). Built by "make bench", SIMD kernels follow CFLAGS like they do
+ * for ledcat (e.g. CFLAGS=-mavx2).
+ *
+ * Usage: bench-correction [iterations]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <niftyled.h>
+#include "correction.h"
+
+
+/** width & height of benchmarked frame */
+#define BENCH_DIM               100
+
+
+
+/** seconds of monotonic clock */
+static double _now(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (double) t.tv_sec + (double) t.tv_nsec / 1000000000.0;
+}
+
+
+/** time correction of one frame in a pixelformat */
+static NftResult _bench(const char *format, double gamma, int iterations)
+{
+        LedPixelFormat *f;
+        if(!(f = led_pixel_format_from_string(format)))
+                return NFT_FAILURE;
+
+        size_t size = led_pixel_format_get_buffer_size(f,
+                                                       BENCH_DIM * BENCH_DIM);
+        unsigned char *buf;
+        if(!(buf = malloc(size)))
+        {
+                NFT_LOG_PERROR("malloc()");
+                led_pixel_format_destroy(f);
+                return NFT_FAILURE;
+        }
+
+        /* pseudo random content (same on every run) */
+        size_t i;
+        srand(1);
+        for(i = 0; i < size; i++)
+                buf[i] = (unsigned char) rand();
+
+        double white[3] = { 1.0, 0.8, 0.6 };
+        Correction *c;
+        if(!(c = correction_new(f, gamma, 0.9, white)))
+        {
+                free(buf);
+                led_pixel_format_destroy(f);
+                return NFT_FAILURE;
+        }
+
+        /* checksum of one pass to compare scalar & SIMD builds */
+        correction_apply(c, buf, size);
+        unsigned long sum = 0;
+        for(i = 0; i < size; i++)
+                sum = sum * 31 + buf[i];
+
+        double start = _now();
+        int n;
+        for(n = 0; n < iterations; n++)
+                correction_apply(c, buf, size);
+        double t = _now() - start;
+
+        printf("%-10s gamma %.1f: %8.2f us/frame (checksum %08lx)\n", format,
+               gamma, t / iterations * 1000000, sum & 0xffffffff);
+
+        correction_destroy(c);
+        free(buf);
+        led_pixel_format_destroy(f);
+
+        return NFT_SUCCESS;
+}
+
+
+int main(int argc, char *argv[])
+{
+        int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+        if(iterations <= 0)
+        {
+                fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        printf("%dx%d frame, %d iterations\n", BENCH_DIM, BENCH_DIM,
+               iterations);
+
+        const char *formats[] = { "RGB u8", "RGB u16" };
+        const double gammas[] = { 1.0, 2.2 };
+        size_t i, j;
+        for(i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+        {
+                for(j = 0; j < sizeof(gammas) / sizeof(gammas[0]); j++)
+                {
+                        if(!_bench(formats[i], gammas[j], iterations))
+                                return EXIT_FAILURE;
+                }
+        }
+
+        return EXIT_SUCCESS;
+}
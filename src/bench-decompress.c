@@ -0,0 +1,227 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/**
+ * Benchmark of raw input: frames/s read from a raw file (uncompressed,
+ * LZ4 or zstd - detected like ledcat does) with the storage optionally
+ * limited to <MB/s> by feeding the file through a throttled pipe. When a
+ * reference file (e.g. the uncompressed original) is given, every frame
+ * is compared to it. Built by "make bench".
+ *
+ * Usage: bench-decompress <file> <framesize> [MB/s] [reference]
+ *
+ * e.g. compare a recording on 10 MB/s storage:
+ *   bench-decompress rec.raw 30000 10
+ *   bench-decompress rec.raw.zst 30000 10 rec.raw
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <niftyled.h>
+#include "events.h"
+#include "raw.h"
+
+
+/** bytes passed through throttled pipe at once */
+#define BENCH_CHUNK             65536
+
+
+/** throttled storage */
+struct Throttle
+{
+        /** file to read */
+        int src;
+        /** write end of pipe */
+        int dst;
+        /** bytes per second */
+        double rate;
+};
+
+
+/** seconds of monotonic clock */
+static double _now(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (double) t.tv_sec + (double) t.tv_nsec / 1000000000.0;
+}
+
+
+/** copy file to pipe no faster than rate */
+static void *_throttle(void *arg)
+{
+        struct Throttle *t = arg;
+        char buf[BENCH_CHUNK];
+        double start = _now(), sent = 0;
+        ssize_t n;
+
+        while((n = read(t->src, buf, sizeof(buf))) > 0)
+        {
+                sent += n;
+                double ahead = start + sent / t->rate - _now();
+                if(ahead > 0)
+                        usleep((useconds_t) (ahead * 1000000));
+
+                ssize_t w, o = 0;
+                while(o < n && (w = write(t->dst, buf + o, n - o)) > 0)
+                        o += w;
+                if(o < n)
+                        break;
+        }
+
+        close(t->dst);
+        return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+        if(argc < 3 || atol(argv[2]) <= 0)
+        {
+                fprintf(stderr,
+                        "Usage: %s <file> <framesize> [MB/s] [reference]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        size_t size = (size_t) atol(argv[2]);
+        double rate = argc > 3 ? atof(argv[3]) : 0;
+
+        struct Throttle t = {.rate = rate * 1000000 };
+        if((t.src = open(argv[1], O_RDONLY)) < 0)
+        {
+                NFT_LOG_PERROR("open()");
+                return EXIT_FAILURE;
+        }
+
+        int ref = -1;
+        char *expected = NULL;
+        if(argc > 4)
+        {
+                if((ref = open(argv[4], O_RDONLY)) < 0)
+                {
+                        NFT_LOG_PERROR("open()");
+                        return EXIT_FAILURE;
+                }
+                if(!(expected = malloc(size)))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        return EXIT_FAILURE;
+                }
+        }
+
+        bool running = true;
+        Events *events;
+        RawReader *r;
+        if(!(events = events_new(&running)) || !(r = raw_reader_new(1)))
+                return EXIT_FAILURE;
+
+        /* read from throttled pipe instead of file? */
+        int fd = t.src;
+        pthread_t thread;
+        if(rate > 0)
+        {
+                int p[2];
+                if(pipe(p) != 0)
+                {
+                        NFT_LOG_PERROR("pipe()");
+                        return EXIT_FAILURE;
+                }
+                fd = p[0];
+                t.dst = p[1];
+                if(pthread_create(&thread, NULL, _throttle, &t) != 0)
+                {
+                        NFT_LOG(L_ERROR, "Failed to start throttle thread");
+                        return EXIT_FAILURE;
+                }
+        }
+
+        unsigned long frames = 0, bad = 0;
+        char *frame;
+        double start = _now();
+        while((frame = raw_reader_frame(r, events, &running, fd, size)))
+        {
+                if(expected &&
+                   (read(ref, expected, size) != (ssize_t) size ||
+                    memcmp(frame, expected, size) != 0))
+                        bad++;
+                frames++;
+        }
+        double elapsed = _now() - start;
+
+        if(rate > 0)
+        {
+                pthread_join(thread, NULL);
+                printf("%s @ %.1f MB/s: ", argv[1], rate);
+        }
+        else
+        {
+                printf("%s: ", argv[1]);
+        }
+        printf("%lu frames in %.2f s, %.1f frames/s", frames, elapsed,
+               elapsed > 0 ? frames / elapsed : 0);
+        if(expected)
+                printf(", %lu differ from %s", bad, argv[4]);
+        printf("\n");
+
+        raw_reader_destroy(r);
+        events_destroy(events);
+        if(fd != t.src)
+                close(fd);
+        close(t.src);
+        if(ref >= 0)
+                close(ref);
+        free(expected);
+
+        return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/**
+ * Benchmark of temporal dithering: time per 100x100 RGB u16 frame and the
+ * mean u8 output of a constant input over 257 frames (should equal
+ * input / 257). Built by "make bench".
+ *
+ * Usage: bench-dither [iterations]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <niftyled.h>
+#include "dither.h"
+
+
+/** width & height of benchmarked frame */
+#define BENCH_DIM               100
+/** constant u16 input level */
+#define BENCH_LEVEL             12345
+
+
+
+/** seconds of monotonic clock */
+static double _now(void)
+{
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (double) t.tv_sec + (double) t.tv_nsec / 1000000000.0;
+}
+
+
+int main(int argc, char *argv[])
+{
+        int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+        if(iterations <= 0)
+        {
+                fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        LedPixelFormat *f;
+        if(!(f = led_pixel_format_from_string("RGB u16")))
+                return EXIT_FAILURE;
+
+        size_t n = BENCH_DIM * BENCH_DIM *
+                led_pixel_format_get_n_components(f);
+        uint16_t *in;
+        if(!(in = malloc(n * sizeof(uint16_t))))
+        {
+                NFT_LOG_PERROR("malloc()");
+                led_pixel_format_destroy(f);
+                return EXIT_FAILURE;
+        }
+
+        size_t i;
+        for(i = 0; i < n; i++)
+                in[i] = BENCH_LEVEL;
+
+        Dither *d;
+        if(!(d = dither_new(f, BENCH_DIM, BENCH_DIM)))
+        {
+                free(in);
+                led_pixel_format_destroy(f);
+                return EXIT_FAILURE;
+        }
+        uint8_t *out = led_frame_get_buffer(dither_get_frame(d));
+
+        /* average output of one full error cycle */
+        unsigned long long sum = 0;
+        int k;
+        for(k = 0; k < 257; k++)
+        {
+                dither_run(d, in);
+                for(i = 0; i < n; i++)
+                        sum += out[i];
+        }
+        printf("mean output %.4f (expected %.4f)\n",
+               (double) sum / (257.0 * n), BENCH_LEVEL / 257.0);
+
+        double start = _now();
+        for(k = 0; k < iterations; k++)
+                dither_run(d, in);
+        double t = _now() - start;
+
+        printf("%dx%d RGB u16 frame, %d iterations: %.2f us/frame\n",
+               BENCH_DIM, BENCH_DIM, iterations, t / iterations * 1000000);
+
+        dither_destroy(d);
+        free(in);
+        led_pixel_format_destroy(f);
+
+        return EXIT_SUCCESS;
+}
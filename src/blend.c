@@ -0,0 +1,221 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdint.h>
+#include <niftyled.h>
+#include "simd.h"
+#include "blend.h"
+
+
+
+/** blend u8 components */
+static void _blend_u8(uint8_t * dst, const uint8_t * a, const uint8_t * b,
+                      size_t n, uint16_t t)
+{
+        /* 8 bit weight (0 - 256) */
+        uint16_t wb = (t + 128) >> 8;
+        uint16_t wa = 256 - wb;
+        size_t i = 0;
+
+#if SIMD_AVX2
+        __m256i z = _mm256_setzero_si256();
+        __m256i va = _mm256_set1_epi16(wa), vb = _mm256_set1_epi16(wb);
+        __m256i r = _mm256_set1_epi16(128);
+        for(; i + 32 <= n; i += 32)
+        {
+                __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+                __m256i y = _mm256_loadu_si256((__m256i *) (b + i));
+                __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16
+                                              (_mm256_unpacklo_epi8(x, z), va),
+                                              _mm256_mullo_epi16
+                                              (_mm256_unpacklo_epi8(y, z),
+                                               vb));
+                __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16
+                                              (_mm256_unpackhi_epi8(x, z), va),
+                                              _mm256_mullo_epi16
+                                              (_mm256_unpackhi_epi8(y, z),
+                                               vb));
+                lo = _mm256_srli_epi16(_mm256_add_epi16(lo, r), 8);
+                hi = _mm256_srli_epi16(_mm256_add_epi16(hi, r), 8);
+                _mm256_storeu_si256((__m256i *) (dst + i),
+                                    _mm256_packus_epi16(lo, hi));
+        }
+#elif SIMD_SSE2
+        __m128i z = _mm_setzero_si128();
+        __m128i va = _mm_set1_epi16(wa), vb = _mm_set1_epi16(wb);
+        __m128i r = _mm_set1_epi16(128);
+        for(; i + 16 <= n; i += 16)
+        {
+                __m128i x = _mm_loadu_si128((__m128i *) (a + i));
+                __m128i y = _mm_loadu_si128((__m128i *) (b + i));
+                __m128i lo = _mm_add_epi16(_mm_mullo_epi16
+                                           (_mm_unpacklo_epi8(x, z), va),
+                                           _mm_mullo_epi16(_mm_unpacklo_epi8
+                                                           (y, z), vb));
+                __m128i hi = _mm_add_epi16(_mm_mullo_epi16
+                                           (_mm_unpackhi_epi8(x, z), va),
+                                           _mm_mullo_epi16(_mm_unpackhi_epi8
+                                                           (y, z), vb));
+                lo = _mm_srli_epi16(_mm_add_epi16(lo, r), 8);
+                hi = _mm_srli_epi16(_mm_add_epi16(hi, r), 8);
+                _mm_storeu_si128((__m128i *) (dst + i),
+                                 _mm_packus_epi16(lo, hi));
+        }
+#elif SIMD_NEON
+        uint16x8_t va = vdupq_n_u16(wa), vb = vdupq_n_u16(wb);
+        for(; i + 16 <= n; i += 16)
+        {
+                uint8x16_t x = vld1q_u8(a + i);
+                uint8x16_t y = vld1q_u8(b + i);
+                uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(x)),
+                                                    va),
+                                          vmovl_u8(vget_low_u8(y)), vb);
+                uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(x)),
+                                                    va),
+                                          vmovl_u8(vget_high_u8(y)), vb);
+                vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 8),
+                                              vrshrn_n_u16(hi, 8)));
+        }
+#endif
+
+        for(; i < n; i++)
+                dst[i] = (a[i] * wa + b[i] * wb + 128) >> 8;
+}
+
+
+/** blend u16 components */
+static void _blend_u16(uint16_t * dst, const uint16_t * a, const uint16_t * b,
+                       size_t n, uint16_t t)
+{
+        size_t i = 0;
+
+#if SIMD_AVX2
+        __m256i vt = _mm256_set1_epi16(t);
+        for(; i + 16 <= n; i += 16)
+        {
+                __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+                __m256i y = _mm256_loadu_si256((__m256i *) (b + i));
+                /* x - x*t + y*t */
+                __m256i v = _mm256_add_epi16(_mm256_sub_epi16
+                                             (x, _mm256_mulhi_epu16(x, vt)),
+                                             _mm256_mulhi_epu16(y, vt));
+                _mm256_storeu_si256((__m256i *) (dst + i), v);
+        }
+#elif SIMD_SSE2
+        __m128i vt = _mm_set1_epi16(t);
+        for(; i + 8 <= n; i += 8)
+        {
+                __m128i x = _mm_loadu_si128((__m128i *) (a + i));
+                __m128i y = _mm_loadu_si128((__m128i *) (b + i));
+                __m128i v = _mm_add_epi16(_mm_sub_epi16
+                                          (x, _mm_mulhi_epu16(x, vt)),
+                                          _mm_mulhi_epu16(y, vt));
+                _mm_storeu_si128((__m128i *) (dst + i), v);
+        }
+#elif SIMD_NEON
+        uint16x4_t vt = vdup_n_u16(t);
+        for(; i + 8 <= n; i += 8)
+        {
+                uint16x8_t x = vld1q_u16(a + i);
+                uint16x8_t y = vld1q_u16(b + i);
+                uint16x8_t xt = vcombine_u16(vshrn_n_u32(vmull_u16
+                                                         (vget_low_u16(x), vt),
+                                                         16),
+                                             vshrn_n_u32(vmull_u16
+                                                         (vget_high_u16(x), vt),
+                                                         16));
+                uint16x8_t yt = vcombine_u16(vshrn_n_u32(vmull_u16
+                                                         (vget_low_u16(y), vt),
+                                                         16),
+                                             vshrn_n_u32(vmull_u16
+                                                         (vget_high_u16(y), vt),
+                                                         16));
+                vst1q_u16(dst + i, vaddq_u16(vsubq_u16(x, xt), yt));
+        }
+#endif
+
+        for(; i < n; i++)
+                dst[i] = a[i] - ((a[i] * (uint32_t) t) >> 16) +
+                        ((b[i] * (uint32_t) t) >> 16);
+}
+
+
+/** blend float components */
+static void _blend_float(float *dst, const float *a, const float *b,
+                         size_t n, uint16_t t)
+{
+        float f = t / 65536.0f;
+        size_t i;
+        for(i = 0; i < n; i++)
+                dst[i] = a[i] + (b[i] - a[i]) * f;
+}
+
+
+
+/**
+ * linear blend of two raw frames: dst = a * (1 - t) + b * t
+ *
+ * @param dst destination frame (may be a or b)
+ * @param a first frame
+ * @param b second frame
+ * @param size size of each frame in bytes
+ * @param component_size size of one component in bytes (1 or 2 for
+ *        unsigned components, 4 for float)
+ * @param t weight of b (0 - 65535)
+ */
+void blend_frames(void *dst, const void *a, const void *b, size_t size,
+                  size_t component_size, uint16_t t)
+{
+        switch (component_size)
+        {
+                case 1:
+                        _blend_u8(dst, a, b, size, t);
+                        break;
+                case 2:
+                        _blend_u16(dst, a, b, size / 2, t);
+                        break;
+                case 4:
+                        _blend_float(dst, a, b, size / 4, t);
+                        break;
+        }
+}
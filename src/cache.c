@@ -41,11 +41,61 @@
  * Boston, MA 02111-1307, USA.
  */
 
+/**
+ * Frames are never freed one by one, only together with the cache. So
+ * their pixels are carved out of slabs: large anonymous mappings, one
+ * series of slabs per frame size (rounded to cache lines). Frames of one
+ * file end up next to each other without per-frame heap overhead. Slabs
+ * of a series start small (CACHE_SLAB_FRAMES frames, whole pages) & double
+ * up to the size of a huge page, so rarely used sizes don't pin 2 MiB
+ * each. From there on slabs are multiples of a huge page & can be backed
+ * by huge pages (MAP_HUGETLB or transparent huge pages as fallback) to
+ * cover the whole cache with few TLB entries.
+ *
+ * Frame descriptors are kept in blocks of CACHE_BLOCK in the order they
+ * were cached & all frames of a file share one copy of its filename.
+ */
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <niftyled.h>
 #include "cache.h"
 
 
+/** alignment of frames in slabs (cache line) */
+#define CACHE_ALIGN             64
+/** size of a huge page (slabs this large & larger are multiples of it) */
+#define CACHE_SLAB              (2 * 1024 * 1024)
+/** minimum amount of frames a slab holds */
+#define CACHE_SLAB_FRAMES       16
+/** amount of frame descriptors allocated at once */
+#define CACHE_BLOCK             1024
+
+
+/** slab series for frames of one size */
+typedef struct
+{
+        /** bytes per frame (size rounded to CACHE_ALIGN) */
+        size_t stride;
+        /** current slab */
+        char *slab;
+        /** size of current slab in bytes */
+        size_t slab_size;
+        /** bytes of current slab handed out */
+        size_t used;
+} CacheClass;
+
+/** mapping of one slab */
+typedef struct
+{
+        void *map;
+        size_t size;
+} CacheSlab;
+
+
 /** cache descriptor */
 struct _Cache
 {
@@ -53,12 +103,251 @@ struct _Cache
         size_t frames;
         /** first cached frame */
         CachedFrame *first;
+        /** last cached frame */
+        CachedFrame *last;
+        /** first frame of file cached last (NULL if it was dropped) */
+        CachedFrame *file_first;
+        /** frame before it (NULL = none) */
+        CachedFrame *file_before;
+        /** first frame of every file by hash of filename */
+        CachedFrame **buckets;
+        /** amount of buckets (power of 2) */
+        size_t bucketcount;
+        /** amount of files in cache */
+        size_t files;
         /** true if caching is disabled */
         bool disabled;
+        /** slab series by frame size */
+        CacheClass *classes;
+        /** amount of classes */
+        size_t classcount;
+        /** all slabs mapped */
+        CacheSlab *slabs;
+        /** amount of slabs */
+        size_t slabcount;
+        /** blocks of CACHE_BLOCK frame descriptors */
+        CachedFrame **blocks;
+        /** amount of blocks */
+        size_t blockcount;
+        /** descriptors used of last block */
+        size_t block_used;
+        /** bytes of frame data cached */
+        size_t bytes;
+        /** bytes of slabs mapped */
+        size_t mapped;
+        /** true to back slabs with huge pages */
+        bool hugepages;
+        /** true if no huge pages are reserved (using THP instead) */
+        bool no_hugetlb;
 };
 
 
 
+/** FNV-1a hash of filename */
+static uint32_t _hash(const char *s)
+{
+        uint32_t h = 2166136261u;
+        while(*s)
+        {
+                h ^= (uint8_t) * s++;
+                h *= 16777619u;
+        }
+        return h;
+}
+
+
+/** make room in hash index for one more file */
+static NftResult _index_grow(Cache * c)
+{
+        /* grow index (keep less than one file per bucket) */
+        if(c->files >= c->bucketcount)
+        {
+                size_t count = c->bucketcount ? c->bucketcount * 2 : 256;
+                CachedFrame **buckets;
+                if(!(buckets = calloc(count, sizeof(CachedFrame *))))
+                {
+                        NFT_LOG_PERROR("calloc()");
+                        return NFT_FAILURE;
+                }
+
+                size_t i;
+                for(i = 0; i < c->bucketcount; i++)
+                {
+                        CachedFrame *a = c->buckets[i];
+                        while(a)
+                        {
+                                CachedFrame *b = a->hash_next;
+                                size_t n = _hash(a->filename) & (count - 1);
+                                a->hash_next = buckets[n];
+                                buckets[n] = a;
+                                a = b;
+                        }
+                }
+
+                free(c->buckets);
+                c->buckets = buckets;
+                c->bucketcount = count;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** add first frame of a file to hash index (after _index_grow()) */
+static void _index(Cache * c, CachedFrame * f)
+{
+        size_t n = _hash(f->filename) & (c->bucketcount - 1);
+        f->hash_next = c->buckets[n];
+        c->buckets[n] = f;
+        c->files++;
+}
+
+
+/** map a new slab */
+static void *_slab_map(Cache * c, size_t size)
+{
+        CacheSlab *slabs;
+        if(!(slabs = realloc(c->slabs, (c->slabcount + 1) *
+                             sizeof(CacheSlab))))
+        {
+                NFT_LOG_PERROR("realloc()");
+                return NULL;
+        }
+        c->slabs = slabs;
+
+        /* slabs below a huge page are plain pages */
+        bool huge = c->hugepages && size % CACHE_SLAB == 0;
+
+        void *map = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        /* reserved huge pages (vm.nr_hugepages) */
+        if(huge && !c->no_hugetlb &&
+           (map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1,
+                       0)) == MAP_FAILED)
+        {
+                NFT_LOG(L_INFO,
+                        "No huge pages reserved, using transparent huge pages for frame cache");
+                c->no_hugetlb = true;
+        }
+#endif
+        if(map == MAP_FAILED)
+        {
+                if((map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                               0)) == MAP_FAILED)
+                {
+                        NFT_LOG_PERROR("mmap()");
+                        return NULL;
+                }
+#ifdef MADV_HUGEPAGE
+                if(huge)
+                        madvise(map, size, MADV_HUGEPAGE);
+#endif
+        }
+
+        c->slabs[c->slabcount].map = map;
+        c->slabs[c->slabcount].size = size;
+        c->slabcount++;
+        c->mapped += size;
+
+        return map;
+}
+
+
+/** allocate pixels of one frame from slab of its size */
+static void *_pixels_alloc(Cache * c, size_t size)
+{
+        size_t stride = (size + CACHE_ALIGN - 1) & ~(size_t) (CACHE_ALIGN - 1);
+
+        /* find series of this size */
+        CacheClass *k = NULL;
+        size_t i;
+        for(i = 0; i < c->classcount; i++)
+        {
+                if(c->classes[i].stride == stride)
+                {
+                        k = &c->classes[i];
+                        break;
+                }
+        }
+
+        if(!k)
+        {
+                CacheClass *classes;
+                if(!(classes = realloc(c->classes, (c->classcount + 1) *
+                                       sizeof(CacheClass))))
+                {
+                        NFT_LOG_PERROR("realloc()");
+                        return NULL;
+                }
+                c->classes = classes;
+                k = &c->classes[c->classcount++];
+                memset(k, 0, sizeof(*k));
+                k->stride = stride;
+        }
+
+        /* current slab full? */
+        if(!k->slab || k->used + stride > k->slab_size)
+        {
+                /* CACHE_SLAB_FRAMES frames in whole pages, up to twice
+                 * the previous slab of this size until that reaches a
+                 * huge page, whole huge pages from there on */
+                size_t page = (size_t) sysconf(_SC_PAGESIZE);
+                size_t slab_size = stride * CACHE_SLAB_FRAMES;
+                if(k->slab && k->slab_size < CACHE_SLAB &&
+                   slab_size < k->slab_size * 2)
+                        slab_size = k->slab_size * 2;
+                if(slab_size >= CACHE_SLAB)
+                        page = CACHE_SLAB;
+                slab_size = (slab_size + page - 1) / page * page;
+
+                char *slab;
+                if(!(slab = _slab_map(c, slab_size)))
+                        return NULL;
+
+                k->slab = slab;
+                k->slab_size = slab_size;
+                k->used = 0;
+        }
+
+        void *p = k->slab + k->used;
+        k->used += stride;
+        c->bytes += size;
+
+        return p;
+}
+
+
+/** get unused frame descriptor */
+static CachedFrame *_frame_new(Cache * c)
+{
+        if(!c->blockcount || c->block_used == CACHE_BLOCK)
+        {
+                CachedFrame **blocks;
+                if(!(blocks = realloc(c->blocks, (c->blockcount + 1) *
+                                      sizeof(CachedFrame *))))
+                {
+                        NFT_LOG_PERROR("realloc()");
+                        return NULL;
+                }
+                c->blocks = blocks;
+
+                if(!(c->blocks[c->blockcount] =
+                     calloc(CACHE_BLOCK, sizeof(CachedFrame))))
+                {
+                        NFT_LOG_PERROR("calloc()");
+                        return NULL;
+                }
+                c->blockcount++;
+                c->block_used = 0;
+        }
+
+        return &c->blocks[c->blockcount - 1][c->block_used++];
+}
+
+
+
 /**
  * enable or disable cache
  *
@@ -73,29 +362,58 @@ void cache_disable(Cache * c, bool disabled)
 }
 
 
+/**
+ * back frame cache with huge pages (affects slabs mapped from now on)
+ *
+ * @param c a cache acquired by cache_new()
+ * @param enabled true to use huge pages
+ */
+void cache_hugepages(Cache * c, bool enabled)
+{
+        c->hugepages = enabled;
+}
+
+
 /**
  * cache a frame
  *
  * @param c a cache acquired by cache_new()
  * @param frame raw frame data (will be copied)
  * @param size size of raw frame in bytes
- * @param filename the filename of the frame (will be truncated to 255 bytes)
+ * @param width width of frame in pixels
+ * @param height height of frame in pixels
+ * @param delay time to show frame in seconds (0 = in respect to fps)
+ * @param palette color table of an index frame (NULL = raw pixels)
+ * @param filename the filename of the frame (will be copied)
  * @result NFT_SUCCESS or NFT_FAILURE
  */
-NftResult cache_frame_put(Cache * c, void *frame, size_t size, char *filename)
+NftResult cache_frame_put(Cache * c, void *frame, size_t size,
+                          LedFrameCord width, LedFrameCord height,
+                          double delay, const void *palette,
+                          char *filename)
 {
         if(c->disabled)
                 return NFT_SUCCESS;
 
+        /* first frame of a file? (frames of a file are cached in order) */
+        bool first = !c->last || strcmp(c->last->filename, filename) != 0;
+        if(first && !_index_grow(c))
+                return NFT_FAILURE;
+
+        /* frames of a file share its name */
+        char *name = first ? strdup(filename) : c->last->filename;
+        if(!name)
+                return NFT_FAILURE;
+
         /* allocate new CachedFrame */
         CachedFrame *f;
-        if(!(f = calloc(1, sizeof(CachedFrame))))
-                return NFT_FAILURE;
+        if(!(f = _frame_new(c)))
+                goto _cfp_error;
 
-        if(!(f->frame = malloc(size)))
+        if(!(f->frame = _pixels_alloc(c, size)))
         {
-                free(f);
-                return NFT_FAILURE;
+                c->block_used--;
+                goto _cfp_error;
         }
 
         /* copy raw frame data */
@@ -103,28 +421,99 @@ NftResult cache_frame_put(Cache * c, void *frame, size_t size, char *filename)
 
         /* store size */
         f->size = size;
+        f->width = width;
+        f->height = height;
+        f->delay = delay;
+        f->palette = palette;
+        f->filename = name;
+        f->next = NULL;
 
-        /* copy filename */
-        strncpy(f->filename, filename, sizeof(f->filename));
+        if(first)
+        {
+                _index(c, f);
+                c->file_first = f;
+                c->file_before = c->last;
+        }
 
-        /* seek to last frame in cache */
+        /* append to list */
         if(!c->first)
-        {
                 c->first = f;
-        }
         else
-        {
-                CachedFrame *l;
-                for(l = c->first; l->next; l = l->next);
-                l->next = f;
-        }
+                c->last->next = f;
+        c->last = f;
 
         /* increase counter */
         c->frames++;
 
-        NFT_LOG(L_DEBUG, "Frame \"%s\" cached (%d frames in cache)", filename,
+        NFT_LOG(L_DEBUG, "Frame \"%s\" cached (%zu frames in cache)", filename,
                 c->frames);
         return NFT_SUCCESS;
+
+_cfp_error:
+        if(first)
+                free(name);
+        return NFT_FAILURE;
+}
+
+
+/**
+ * drop all frames of the file cached last (e.g. because it wasn't decoded
+ * to its end)
+ *
+ * @param c a cache acquired by cache_new()
+ * @param filename name of file (nothing is dropped if another file was
+ *        cached last)
+ */
+void cache_file_drop(Cache * c, char *filename)
+{
+        CachedFrame *first = c->file_first;
+        if(!first || strcmp(first->filename, filename) != 0)
+                return;
+
+        /* remove file from hash index */
+        CachedFrame **h = &c->buckets[_hash(filename) &
+                                      (c->bucketcount - 1)];
+        while(*h != first)
+                h = &(*h)->hash_next;
+        *h = first->hash_next;
+        c->files--;
+
+        /* frames of this file were allocated last, give back what's in
+         * the current slab of their class & the current descriptor block */
+        CachedFrame *block = c->blocks[c->blockcount - 1];
+        CachedFrame *f;
+        for(f = first; f; f = f->next)
+        {
+                size_t stride = (f->size + CACHE_ALIGN - 1) &
+                        ~(size_t) (CACHE_ALIGN - 1);
+                size_t i;
+                for(i = 0; i < c->classcount; i++)
+                {
+                        CacheClass *k = &c->classes[i];
+                        char *p = f->frame;
+                        if(k->stride == stride && p >= k->slab &&
+                           p < k->slab + k->used)
+                                k->used = (size_t) (p - k->slab);
+                }
+
+                if(f >= block && f < block + c->block_used)
+                        c->block_used = (size_t) (f - block);
+
+                c->bytes -= f->size;
+                c->frames--;
+        }
+
+        free(first->filename);
+
+        /* unlink frames */
+        if(c->file_before)
+                c->file_before->next = NULL;
+        else
+                c->first = NULL;
+        c->last = c->file_before;
+        c->file_first = NULL;
+
+        NFT_LOG(L_DEBUG, "Dropped frames of \"%s\" from cache", filename);
 }
 
 
@@ -140,7 +529,12 @@ CachedFrame *cache_frame_get(Cache * c, char *filename)
         if(c->disabled)
                 return NULL;
 
-        for(CachedFrame * f = c->first; f; f = f->next)
+        if(!c->bucketcount)
+                goto _cfg_miss;
+
+        for(CachedFrame * f = c->buckets[_hash(filename) &
+                                         (c->bucketcount - 1)];
+            f; f = f->hash_next)
         {
                 if(strcmp(filename, f->filename) != 0)
                         continue;
@@ -149,11 +543,50 @@ CachedFrame *cache_frame_get(Cache * c, char *filename)
                 return f;
         }
 
+_cfg_miss:
         NFT_LOG(L_DEBUG, "Frame \"%s\" not found in cache", filename);
         return NULL;
 }
 
 
+/**
+ * get next frame of the same file from cache (frames of a file are cached
+ * in order)
+ *
+ * @param c a cache acquired by cache_new()
+ * @param f a frame acquired by cache_frame_get() or cache_frame_next()
+ * @result next frame or NULL if f is the last frame of its file
+ */
+CachedFrame *cache_frame_next(Cache * c, CachedFrame * f)
+{
+        if(c->disabled || !f || !f->next)
+                return NULL;
+
+        if(f->filename != f->next->filename)
+                return NULL;
+
+        return f->next;
+}
+
+
+/**
+ * get n-th frame of a file from cache
+ *
+ * @param c a cache acquired by cache_new()
+ * @param filename name of file
+ * @param n index of frame (0 = first frame)
+ * @result frame or NULL if not cached
+ */
+CachedFrame *cache_frame_nth(Cache * c, char *filename, unsigned long n)
+{
+        CachedFrame *f = cache_frame_get(c, filename);
+        for(; f && n > 0; n--)
+                f = cache_frame_next(c, f);
+
+        return f;
+}
+
+
 /**
  * initialize a new cache
  *
@@ -181,17 +614,31 @@ void cache_destroy(Cache * c)
         if(!c)
                 return;
 		
-        /* free all cached frames */
-        CachedFrame *a = c->first;
-        while(a)
+        NFT_LOG(L_VERBOSE,
+                "%zu frames cached in %zu slabs (%.1f MiB of %.1f MiB used)",
+                c->frames, c->slabcount, (double) c->bytes / 1048576,
+                (double) c->mapped / 1048576);
+
+        /* free filenames (shared by all frames of a file) */
+        CachedFrame *a;
+        for(a = c->first; a; a = a->next)
         {
-                CachedFrame *b = a->next;
-                free(a->frame);
-                free(a);
-                a = b;
+                if(!a->next || a->next->filename != a->filename)
+                        free(a->filename);
         }
 
+        /* free frame descriptors & slabs */
+        size_t i;
+        for(i = 0; i < c->blockcount; i++)
+                free(c->blocks[i]);
+        for(i = 0; i < c->slabcount; i++)
+                munmap(c->slabs[i].map, c->slabs[i].size);
+
         /* free cache */
+        free(c->blocks);
+        free(c->slabs);
+        free(c->classes);
+        free(c->buckets);
         free(c);
 
         NFT_LOG(L_DEBUG, "destroying frame cache");
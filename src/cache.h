@@ -50,10 +50,20 @@ typedef struct CachedFrame
 {
         /** next cached frame */
         struct CachedFrame             *next;
+        /** next first frame of a file with same hash */
+        struct CachedFrame             *hash_next;
         /** filename of this frame */
-        char                            filename[255];
+        char                           *filename;
         /** size of raw frame data in bytes */
         size_t                          size;
+        /** width of frame in pixels */
+        LedFrameCord                    width;
+        /** height of frame in pixels */
+        LedFrameCord                    height;
+        /** time to show frame in seconds (0 = in respect to fps) */
+        double                          delay;
+        /** PaletteTable frame holds 8-bit indices into (NULL = raw pixels) */
+        const void                     *palette;
         /** raw frame */
         void                           *frame;
 } CachedFrame;
@@ -64,8 +74,12 @@ typedef struct _Cache           Cache;
 
 
 void                            cache_disable(Cache * c, bool disabled);
-NftResult                       cache_frame_put(Cache * c, void *frame, size_t size, char *filename);
+void                            cache_hugepages(Cache * c, bool enabled);
+NftResult                       cache_frame_put(Cache * c, void *frame, size_t size, LedFrameCord width, LedFrameCord height, double delay, const void *palette, char *filename);
+void                            cache_file_drop(Cache * c, char *filename);
 CachedFrame                    *cache_frame_get(Cache * c, char *filename);
+CachedFrame                    *cache_frame_next(Cache * c, CachedFrame * f);
+CachedFrame                    *cache_frame_nth(Cache * c, char *filename, unsigned long n);
 Cache                          *cache_new();
 void                            cache_destroy(Cache * c);
 
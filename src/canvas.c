@@ -0,0 +1,334 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <niftyled.h>
+#include "canvas.h"
+
+
+/** canvas descriptor */
+struct _Canvas
+{
+        /** bytes per pixel */
+        size_t bpp;
+        /** viewport width */
+        LedFrameCord width;
+        /** viewport height */
+        LedFrameCord height;
+        /** canvas width */
+        LedFrameCord canvas_width;
+        /** canvas height */
+        LedFrameCord canvas_height;
+        /** canvas pixels */
+        char *buffer;
+        /** size of buffer in bytes */
+        size_t buffer_size;
+        /** scroll direction */
+        ScrollDirection direction;
+        /** scroll speed in pixels per second */
+        double speed;
+        /** true to wrap around canvas edges */
+        bool wrap;
+};
+
+
+
+/** position modulo n (always positive) */
+static LedFrameCord _wrap(long v, LedFrameCord n)
+{
+        long r = v % n;
+        return (LedFrameCord) (r < 0 ? r + n : r);
+}
+
+
+/** copy one viewport row starting at canvas column x */
+static void _copy_row(Canvas * c, const char *src, char *dst, long x)
+{
+        LedFrameCord done = 0;
+
+        while(done < c->width)
+        {
+                long sx = x + done;
+                LedFrameCord n;
+
+                if(c->wrap)
+                        sx = _wrap(sx, c->canvas_width);
+
+                /* outside of canvas */
+                if(sx < 0 || sx >= c->canvas_width)
+                {
+                        n = (sx < 0) ? (LedFrameCord) - sx : c->width - done;
+                        if(n > c->width - done)
+                                n = c->width - done;
+                        memset(dst + done * c->bpp, 0, n * c->bpp);
+                }
+                /* span until canvas edge */
+                else
+                {
+                        n = c->canvas_width - sx;
+                        if(n > c->width - done)
+                                n = c->width - done;
+                        memcpy(dst + done * c->bpp, src + sx * c->bpp,
+                               n * c->bpp);
+                }
+
+                done += n;
+        }
+}
+
+
+
+/**
+ * parse scroll definition
+ *
+ * @param s "<left|right|up|down>[,<pixels per second>]"
+ * @param direction space for direction
+ * @param speed space for speed (left untouched if not given)
+ * @result NFT_SUCCESS or NFT_FAILURE
+ */
+NftResult canvas_scroll_from_string(const char *s,
+                                    ScrollDirection * direction,
+                                    double *speed)
+{
+        char name[16];
+        double v;
+
+        switch (sscanf(s, "%15[a-z],%lf", name, &v))
+        {
+                case 2:
+                        if(v <= 0)
+                                return NFT_FAILURE;
+                        *speed = v;
+                        /* fall through */
+                case 1:
+                        break;
+                default:
+                        return NFT_FAILURE;
+        }
+
+        if(strcmp(name, "left") == 0)
+                *direction = SCROLL_LEFT;
+        else if(strcmp(name, "right") == 0)
+                *direction = SCROLL_RIGHT;
+        else if(strcmp(name, "up") == 0)
+                *direction = SCROLL_UP;
+        else if(strcmp(name, "down") == 0)
+                *direction = SCROLL_DOWN;
+        else
+                return NFT_FAILURE;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * create new canvas
+ *
+ * @param f pixelformat of canvas and viewport
+ * @param width viewport width
+ * @param height viewport height
+ * @param direction direction the content moves in
+ * @param speed pixels per second
+ * @param wrap true to wrap around the canvas edges (scrolls endlessly)
+ * @result new canvas or NULL
+ */
+Canvas *canvas_new(LedPixelFormat * f, LedFrameCord width,
+                   LedFrameCord height, ScrollDirection direction,
+                   double speed, bool wrap)
+{
+        Canvas *c;
+        if(!(c = calloc(1, sizeof(Canvas))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        c->bpp = led_pixel_format_get_bytes_per_pixel(f);
+        c->width = width;
+        c->height = height;
+        c->direction = direction;
+        c->speed = speed;
+        c->wrap = wrap;
+
+        NFT_LOG(L_INFO, "Scrolling %dx%d viewport at %.1f pixels/s%s",
+                width, height, speed, wrap ? " (wrapping)" : "");
+
+        return c;
+}
+
+
+/**
+ * get buffer to load a new canvas image into
+ *
+ * @param c canvas acquired by canvas_new()
+ * @param width width of canvas image
+ * @param height height of canvas image
+ * @result buffer (owned by canvas) or NULL
+ */
+void *canvas_get_buffer(Canvas * c, LedFrameCord width, LedFrameCord height)
+{
+        size_t size = (size_t) width * height * c->bpp;
+
+        if(width <= 0 || height <= 0)
+                return NULL;
+
+        if(c->buffer_size < size)
+        {
+                free(c->buffer);
+                if(!(c->buffer = malloc(size)))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        c->buffer_size = 0;
+                        return NULL;
+                }
+                c->buffer_size = size;
+        }
+
+        c->canvas_width = width;
+        c->canvas_height = height;
+
+        return c->buffer;
+}
+
+
+/**
+ * get dimensions of current canvas image
+ */
+void canvas_get_dim(Canvas * c, LedFrameCord * width, LedFrameCord * height)
+{
+        *width = c->canvas_width;
+        *height = c->canvas_height;
+}
+
+
+/**
+ * get size of current canvas image in bytes
+ */
+size_t canvas_get_size(Canvas * c)
+{
+        return (size_t) c->canvas_width * c->canvas_height * c->bpp;
+}
+
+
+/**
+ * copy viewport at a point in time to a frame
+ *
+ * @param c canvas acquired by canvas_new()
+ * @param seconds time since scrolling started
+ * @param dst raw frame of viewport dimensions
+ * @result NFT_SUCCESS or NFT_FAILURE when the whole canvas has been shown
+ */
+NftResult canvas_view(Canvas * c, double seconds, void *dst)
+{
+        if(!c->buffer || c->canvas_width <= 0 || c->canvas_height <= 0)
+                return NFT_FAILURE;
+
+        /* distance to scroll */
+        bool horizontal = (c->direction == SCROLL_LEFT ||
+                           c->direction == SCROLL_RIGHT);
+        long length = horizontal ? c->canvas_width : c->canvas_height;
+        long view = horizontal ? c->width : c->height;
+        long distance = c->wrap ? length : length - view;
+        if(distance < 0)
+                distance = 0;
+
+        /* position in pixels */
+        long pos = (long) floor(seconds * c->speed);
+        if(c->wrap ? (pos >= distance) : (pos > distance))
+                return NFT_FAILURE;
+
+        long x = 0, y = 0;
+        switch (c->direction)
+        {
+                case SCROLL_LEFT:
+                        x = pos;
+                        break;
+                case SCROLL_RIGHT:
+                        x = distance - pos;
+                        break;
+                case SCROLL_UP:
+                        y = pos;
+                        break;
+                case SCROLL_DOWN:
+                        y = distance - pos;
+                        break;
+                default:
+                        break;
+        }
+
+        /* strided copy */
+        size_t stride = c->width * c->bpp;
+        LedFrameCord row;
+        for(row = 0; row < c->height; row++)
+        {
+                char *d = (char *) dst + row * stride;
+                long sy = y + row;
+
+                if(c->wrap)
+                        sy = _wrap(sy, c->canvas_height);
+
+                if(sy < 0 || sy >= c->canvas_height)
+                {
+                        memset(d, 0, stride);
+                        continue;
+                }
+
+                _copy_row(c, c->buffer + sy * c->canvas_width * c->bpp, d, x);
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * free canvas and all its resources
+ */
+void canvas_destroy(Canvas * c)
+{
+        if(!c)
+                return;
+
+        free(c->buffer);
+        free(c);
+}
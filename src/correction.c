@@ -0,0 +1,484 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <niftyled.h>
+#include "simd.h"
+#include "format.h"
+#include "correction.h"
+
+
+/** max. amount of components we build SIMD gain patterns for */
+#define CORRECTION_MAX_COMPONENTS 4
+/** alignment of descriptor (SIMD patterns are read with aligned loads) */
+#if SIMD_VECTOR_BYTES
+#define CORRECTION_ALIGN        SIMD_VECTOR_BYTES
+#else
+#define CORRECTION_ALIGN        sizeof(void *)
+#endif
+
+
+/** correction descriptor */
+struct _Correction
+{
+        /** amount of components per pixel */
+        size_t components;
+        /** size of one component in bytes (1 or 2) */
+        size_t size;
+        /** lookup-table (components * 256 or components * 65536 entries) */
+        void *lut;
+        /** true if the correction is a plain per-channel gain (gamma 1.0) */
+        bool linear;
+#if SIMD_VECTOR_BYTES
+        /** u8: per-lane gain for low/high half of a vector (8.8 fixed point) */
+        uint16_t gain8[CORRECTION_MAX_COMPONENTS][2][SIMD_VECTOR_BYTES / 2]
+                __attribute__ ((aligned(SIMD_VECTOR_BYTES)));
+        /** u16: per-lane attenuation (0.16 fixed point, 1.0 - gain) */
+        uint16_t gain16[CORRECTION_MAX_COMPONENTS][SIMD_VECTOR_BYTES / 2]
+                __attribute__ ((aligned(SIMD_VECTOR_BYTES)));
+        /** u16: per-lane mask of result (0 for a gain of 0) */
+        uint16_t mask16[CORRECTION_MAX_COMPONENTS][SIMD_VECTOR_BYTES / 2]
+                __attribute__ ((aligned(SIMD_VECTOR_BYTES)));
+#endif
+};
+
+
+
+/** 8.8 fixed point gain of a channel */
+static uint16_t _gain8(double gain)
+{
+        return (uint16_t) lround(gain * 256.0);
+}
+
+
+/** 
+ * 0.16 fixed point attenuation (1.0 - gain) of a channel. An attenuation
+ * of 1.0 doesn't fit, a gain of 0 is applied by _mask16() instead 
+ */
+static uint16_t _attenuation16(double gain)
+{
+        long g = lround(gain * 65536.0);
+        if(g < 1)
+                g = 1;
+        return (uint16_t) (65536 - g);
+}
+
+
+/** mask of attenuated u16 value (clears it for a gain of 0) */
+static uint16_t _mask16(double gain)
+{
+        return lround(gain * 65536.0) < 1 ? 0 : 0xffff;
+}
+
+
+/** 
+ * correct one value. The linear case uses the exact same fixed-point 
+ * math as the SIMD kernels so both paths produce identical output 
+ */
+static unsigned int _correct(unsigned int value, unsigned int max,
+                             double gamma, double gain)
+{
+        if(gamma == 1.0)
+        {
+                if(max == 0xff)
+                        return (value * _gain8(gain) + 128) >> 8;
+
+                return (value - ((value * _attenuation16(gain)) >> 16)) &
+                        _mask16(gain);
+        }
+
+        return (unsigned int) lround(pow((double) value / max, gamma) *
+                                     gain * max);
+}
+
+
+#if SIMD_VECTOR_BYTES
+/** 
+ * position of element i of a vector after widening it to 16 bit
+ * (AVX2 unpacks per 128-bit lane) 
+ */
+static void _widened_lane(size_t i, size_t * half, size_t * lane)
+{
+#if SIMD_AVX2
+        *half = (i % 16) >= 8;
+        *lane = (i / 16) * 8 + (i % 8);
+#else
+        *half = i >= 8;
+        *lane = i % 8;
+#endif
+}
+
+
+/** build per-lane gain patterns for the SIMD kernels */
+static void _build_patterns(Correction * c, double *gain)
+{
+        size_t v, i;
+        for(v = 0; v < c->components; v++)
+        {
+                /* u8 */
+                for(i = 0; i < SIMD_VECTOR_BYTES; i++)
+                {
+                        size_t half, lane;
+                        _widened_lane(i, &half, &lane);
+                        c->gain8[v][half][lane] =
+                                _gain8(gain
+                                       [(v * SIMD_VECTOR_BYTES +
+                                         i) % c->components]);
+                }
+
+                /* u16 */
+                for(i = 0; i < SIMD_VECTOR_BYTES / 2; i++)
+                {
+                        double g = gain[(v * SIMD_VECTOR_BYTES / 2 +
+                                         i) % c->components];
+                        c->gain16[v][i] = _attenuation16(g);
+                        c->mask16[v][i] = _mask16(g);
+                }
+        }
+}
+
+
+/** 
+ * apply per-channel gain to u8 components 
+ *
+ * @result amount of components processed 
+ */
+static size_t _gain_u8(Correction * c, uint8_t * p, size_t n)
+{
+        size_t block = c->components * SIMD_VECTOR_BYTES;
+        size_t done, v;
+
+        for(done = 0; done + block <= n; done += block)
+        {
+                for(v = 0; v < c->components; v++, p += SIMD_VECTOR_BYTES)
+                {
+#if SIMD_AVX2
+                        __m256i x = _mm256_loadu_si256((__m256i *) p);
+                        __m256i z = _mm256_setzero_si256();
+                        __m256i r = _mm256_set1_epi16(128);
+                        __m256i lo = _mm256_unpacklo_epi8(x, z);
+                        __m256i hi = _mm256_unpackhi_epi8(x, z);
+                        lo = _mm256_mullo_epi16(lo,
+                                                _mm256_load_si256((__m256i *)
+                                                                  c->gain8[v]
+                                                                  [0]));
+                        hi = _mm256_mullo_epi16(hi,
+                                                _mm256_load_si256((__m256i *)
+                                                                  c->gain8[v]
+                                                                  [1]));
+                        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, r), 8);
+                        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, r), 8);
+                        _mm256_storeu_si256((__m256i *) p,
+                                            _mm256_packus_epi16(lo, hi));
+#elif SIMD_SSE2
+                        __m128i x = _mm_loadu_si128((__m128i *) p);
+                        __m128i z = _mm_setzero_si128();
+                        __m128i r = _mm_set1_epi16(128);
+                        __m128i lo = _mm_unpacklo_epi8(x, z);
+                        __m128i hi = _mm_unpackhi_epi8(x, z);
+                        lo = _mm_mullo_epi16(lo,
+                                             _mm_load_si128((__m128i *)
+                                                            c->gain8[v][0]));
+                        hi = _mm_mullo_epi16(hi,
+                                             _mm_load_si128((__m128i *)
+                                                            c->gain8[v][1]));
+                        lo = _mm_srli_epi16(_mm_add_epi16(lo, r), 8);
+                        hi = _mm_srli_epi16(_mm_add_epi16(hi, r), 8);
+                        _mm_storeu_si128((__m128i *) p,
+                                         _mm_packus_epi16(lo, hi));
+#elif SIMD_NEON
+                        uint8x16_t x = vld1q_u8(p);
+                        uint16x8_t lo = vmulq_u16(vmovl_u8(vget_low_u8(x)),
+                                                  vld1q_u16(c->gain8[v][0]));
+                        uint16x8_t hi = vmulq_u16(vmovl_u8(vget_high_u8(x)),
+                                                  vld1q_u16(c->gain8[v][1]));
+                        vst1q_u8(p, vcombine_u8(vmovn_u16(vrshrq_n_u16(lo, 8)),
+                                                vmovn_u16(vrshrq_n_u16
+                                                          (hi, 8))));
+#endif
+                }
+        }
+
+        return done;
+}
+
+
+/** 
+ * apply per-channel gain to u16 components 
+ *
+ * @result amount of components processed 
+ */
+static size_t _gain_u16(Correction * c, uint16_t * p, size_t n)
+{
+        size_t lanes = SIMD_VECTOR_BYTES / 2;
+        size_t block = c->components * lanes;
+        size_t done, v;
+
+        for(done = 0; done + block <= n; done += block)
+        {
+                for(v = 0; v < c->components; v++, p += lanes)
+                {
+#if SIMD_AVX2
+                        __m256i x = _mm256_loadu_si256((__m256i *) p);
+                        __m256i a = _mm256_mulhi_epu16(x,
+                                                       _mm256_load_si256((__m256i *) c->gain16[v]));
+                        _mm256_storeu_si256((__m256i *) p,
+                                            _mm256_and_si256(_mm256_sub_epi16
+                                                             (x, a),
+                                                             _mm256_load_si256
+                                                             ((__m256i *)
+                                                              c->mask16[v])));
+#elif SIMD_SSE2
+                        __m128i x = _mm_loadu_si128((__m128i *) p);
+                        __m128i a = _mm_mulhi_epu16(x,
+                                                    _mm_load_si128((__m128i *)
+                                                                   c->gain16
+                                                                   [v]));
+                        _mm_storeu_si128((__m128i *) p,
+                                         _mm_and_si128(_mm_sub_epi16(x, a),
+                                                       _mm_load_si128((__m128i
+                                                                       *)
+                                                                      c->mask16
+                                                                      [v])));
+#elif SIMD_NEON
+                        uint16x8_t x = vld1q_u16(p);
+                        uint16x8_t g = vld1q_u16(c->gain16[v]);
+                        uint32x4_t lo = vmull_u16(vget_low_u16(x),
+                                                  vget_low_u16(g));
+                        uint32x4_t hi = vmull_u16(vget_high_u16(x),
+                                                  vget_high_u16(g));
+                        uint16x8_t a = vcombine_u16(vshrn_n_u32(lo, 16),
+                                                    vshrn_n_u32(hi, 16));
+                        vst1q_u16(p, vandq_u16(vsubq_u16(x, a),
+                                               vld1q_u16(c->mask16[v])));
+#endif
+                }
+        }
+
+        return done;
+}
+#endif /* SIMD_VECTOR_BYTES */
+
+
+
+/**
+ * create new color correction for a pixelformat
+ *
+ * @param f pixelformat of frames that will be corrected
+ * @param gamma gamma exponent (1.0 = linear)
+ * @param brightness global brightness (0.0 - 1.0)
+ * @param white white balance for red, green & blue (0.0 - 1.0 each)
+ * @result new correction or NULL
+ */
+Correction *correction_new(LedPixelFormat * f, double gamma,
+                           double brightness, double white[3])
+{
+        size_t size = format_component_size(f);
+        if(!format_is_unsigned(f) || (size != 1 && size != 2))
+        {
+                NFT_LOG(L_ERROR,
+                        "Color correction only supports u8 and u16 pixelformats (not \"%s\")",
+                        led_pixel_format_to_string(f));
+                return NULL;
+        }
+
+        if(gamma <= 0 || brightness < 0 || brightness > 1)
+        {
+                NFT_LOG(L_ERROR,
+                        "Invalid color correction (gamma: %f, brightness: %f)",
+                        gamma, brightness);
+                return NULL;
+        }
+
+        /* calloc() only guarantees 16 byte alignment */
+        Correction *c;
+        if((errno = posix_memalign((void **) &c, CORRECTION_ALIGN,
+                                   sizeof(Correction))) != 0)
+        {
+                NFT_LOG_PERROR("posix_memalign()");
+                return NULL;
+        }
+        memset(c, 0, sizeof(Correction));
+
+        c->components = led_pixel_format_get_n_components(f);
+        c->size = size;
+        c->linear = (gamma == 1.0);
+
+        unsigned int max = (size == 1) ? 0xff : 0xffff;
+        if(!(c->lut = malloc(c->components * (max + 1) * size)))
+        {
+                NFT_LOG_PERROR("malloc()");
+                free(c);
+                return NULL;
+        }
+
+        /* gain of every component */
+        double gain[c->components];
+        size_t i;
+        for(i = 0; i < c->components; i++)
+        {
+                double g;
+                switch (format_component_name(f, i))
+                {
+                        case 'R':
+                                g = brightness * white[0];
+                                break;
+                        case 'G':
+                                g = brightness * white[1];
+                                break;
+                        case 'B':
+                                g = brightness * white[2];
+                                break;
+                        /* leave alpha untouched */
+                        case 'A':
+                                g = 1.0;
+                                break;
+                        default:
+                                g = brightness;
+                                break;
+                }
+                gain[i] = (g < 0) ? 0 : ((g > 1) ? 1 : g);
+        }
+
+        /* build lookup-tables */
+        unsigned int v;
+        for(i = 0; i < c->components; i++)
+        {
+                double ga = (format_component_name(f, i) == 'A') ? 1.0 : gamma;
+
+                for(v = 0; v <= max; v++)
+                {
+                        unsigned int r = _correct(v, max, ga, gain[i]);
+                        if(size == 1)
+                                ((uint8_t *) c->lut)[i * 256 + v] = r;
+                        else
+                                ((uint16_t *) c->lut)[i * 65536 + v] = r;
+                }
+
+                /* per-channel gamma can't be expressed as plain gain */
+                if(ga != 1.0)
+                        c->linear = false;
+        }
+
+#if SIMD_VECTOR_BYTES
+        if(c->components > CORRECTION_MAX_COMPONENTS)
+                c->linear = false;
+        else
+                _build_patterns(c, gain);
+#endif
+
+        NFT_LOG(L_INFO,
+                "Color correction: gamma %.2f, brightness %.2f, white %.2f/%.2f/%.2f (%s)",
+                gamma, brightness, white[0], white[1], white[2],
+                c->linear ? SIMD_NAME : "lookup-table");
+
+        return c;
+}
+
+
+/**
+ * correct a raw frame in place
+ *
+ * @param c correction acquired by correction_new()
+ * @param buf raw frame data in the pixelformat the correction was created for
+ * @param size size of buf in bytes
+ */
+void correction_apply(Correction * c, void *buf, size_t size)
+{
+        size_t n = size / c->size;
+        size_t i = 0;
+
+#if SIMD_VECTOR_BYTES
+        /* vector kernels (process whole pixel-patterns) */
+        if(c->linear)
+        {
+                if(c->size == 1)
+                        i = _gain_u8(c, buf, n);
+                else
+                        i = _gain_u16(c, buf, n);
+        }
+#endif
+
+        /* lookup-table for the rest (the SIMD kernels always end on a pixel
+         * boundary, so the first remaining component is component 0) */
+        size_t component = 0;
+        if(c->size == 1)
+        {
+                uint8_t *p = buf, *lut = c->lut;
+                for(; i < n; i++)
+                {
+                        p[i] = lut[component * 256 + p[i]];
+                        if(++component == c->components)
+                                component = 0;
+                }
+        }
+        else
+        {
+                uint16_t *p = buf, *lut = c->lut;
+                for(; i < n; i++)
+                {
+                        p[i] = lut[component * 65536 + p[i]];
+                        if(++component == c->components)
+                                component = 0;
+                }
+        }
+}
+
+
+/**
+ * free a correction and all its resources
+ *
+ * @param c correction acquired by correction_new()
+ */
+void correction_destroy(Correction * c)
+{
+        if(!c)
+                return;
+
+        free(c->lut);
+        free(c);
+}
@@ -0,0 +1,764 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Jobs are queued & playback is controlled by writing lines to the socket:
+ *
+ *   play <path>        play file or directory
+ *   playlist <file>    play files listed in playlist file
+ *   load <file>        replace queued jobs & the one playing with playlist
+ *   clear              drop queued jobs & stop the one playing
+ *   pause / resume     hold current frame / continue
+ *   seek <frame>       continue with n-th frame of current file
+ *   fps <n>            change framerate
+ *   next / prev        skip to next / previous file (only entries not
+ *                      released from the playlist window can be
+ *                      stepped back to)
+ *   stats              print state of playback
+ *
+ * Playback applies requests at frame boundaries. It only checks an atomic
+ * flag per frame & takes the lock when something was requested. While
+ * waiting, playback watches an eventfd that's written for every job &
+ * request. Stats requests have an eventfd of their own that's watched by
+ * the event loop of playback, so they're answered whatever playback waits
+ * for (and the event loop never consumes a wake-up meant for jobs).
+ *
+ * Every line is answered with "OK" or "ERR <reason>". Paths should be
+ * absolute, they're resolved relative to the working directory of ledcat.
+ * Clients are served one after another.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+#include <niftyled.h>
+#include "playlist.h"
+#include "events.h"
+#include "daemon.h"
+
+
+
+/** one queued job */
+struct Job
+{
+        /** files to play */
+        Playlist *playlist;
+        /** next job in queue */
+        struct Job *next;
+};
+
+
+/** job server */
+struct _Daemon
+{
+        /** path of socket */
+        struct sockaddr_un addr;
+        /** listening socket */
+        int sock;
+        /** true if socket file was created */
+        bool bound;
+        /** currently connected client (-1 = none) */
+        int client;
+        /** thread accepting clients */
+        pthread_t thread;
+        /** true if thread was started */
+        bool started;
+        /** true if playlists of jobs start over when they end */
+        bool loop;
+        /** amount of entries playlists of jobs keep enumerated */
+        size_t window;
+        /** first queued job */
+        struct Job *first;
+        /** last queued job */
+        struct Job *last;
+        /** requests not applied by playback yet */
+        DaemonRequest req;
+        /** stats of playback (valid if stats_ready) */
+        DaemonStats stats;
+        /** true if playback answered the last stats request */
+        bool stats_ready;
+        /** true while a client waits for stats */
+        bool stats_wanted;
+        /** true while playback waits for the next job */
+        bool idle;
+        /** entries playback can step back from the one playing */
+        unsigned long back;
+        /** true to stop thread */
+        bool stop;
+        /** protects everything above */
+        pthread_mutex_t mutex;
+        /** readable when a job was queued or something was requested */
+        int wake;
+        /** readable when a client waits for stats */
+        int stats_fd;
+        /** signalled when playback answered a stats request */
+        pthread_cond_t answered;
+        /** non-zero if req holds something (read without lock) */
+        int changed;
+};
+
+
+
+/** send answer to client */
+static void _reply(int client, const char *msg)
+{
+        /* don't get killed by SIGPIPE if client went away */
+        if(send(client, msg, strlen(msg), MSG_NOSIGNAL) < 0)
+                NFT_LOG(L_DEBUG, "send(): %s", strerror(errno));
+}
+
+
+/** free all queued jobs (mutex must be held) */
+static void _clear_queue(Daemon * d)
+{
+        while(d->first)
+        {
+                struct Job *j = d->first;
+                d->first = j->next;
+                playlist_destroy(j->playlist);
+                free(j);
+        }
+        d->last = NULL;
+}
+
+
+/** wake up playback waiting for jobs or requests */
+static void _wake(Daemon * d)
+{
+        uint64_t one = 1;
+        if(write(d->wake, &one, sizeof(one)) != sizeof(one))
+                NFT_LOG_PERROR("write()");
+}
+
+
+/** reset wake-up descriptor (before checking for jobs or requests) */
+static void _drain(Daemon * d)
+{
+        uint64_t n;
+        if(read(d->wake, &n, sizeof(n)) < 0 && errno != EAGAIN)
+                NFT_LOG_PERROR("read()");
+}
+
+
+/** wake up event loop of playback to answer stats */
+static void _wake_stats(Daemon * d)
+{
+        uint64_t one = 1;
+        if(write(d->stats_fd, &one, sizeof(one)) != sizeof(one))
+                NFT_LOG_PERROR("write()");
+}
+
+
+/** pass request to playback (mutex must be held) */
+static void _request(Daemon * d)
+{
+        __atomic_store_n(&d->changed, 1, __ATOMIC_RELEASE);
+        _wake(d);
+}
+
+
+/** 
+ * queue job playing one path or playlist file 
+ * (replace queue & job playing if replace is true) 
+ */
+static NftResult _queue(Daemon * d, const char *path, bool list,
+                        bool replace)
+{
+        /* report missing files to client right away */
+        if(access(path, R_OK) != 0)
+        {
+                NFT_LOG(L_ERROR, "Can't read \"%s\": %s", path,
+                        strerror(errno));
+                return NFT_FAILURE;
+        }
+
+        struct Job *j;
+        if(!(j = calloc(1, sizeof(struct Job))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NFT_FAILURE;
+        }
+
+        if(!(j->playlist = playlist_new(d->loop, d->window)) ||
+           !(list ? playlist_add_list(j->playlist, path) :
+             playlist_add_path(j->playlist, path)) ||
+           playlist_is_empty(j->playlist))
+        {
+                playlist_destroy(j->playlist);
+                free(j);
+                return NFT_FAILURE;
+        }
+
+        pthread_mutex_lock(&d->mutex);
+        if(replace)
+        {
+                _clear_queue(d);
+                d->req.clear = true;
+                _request(d);
+        }
+        if(d->last)
+                d->last->next = j;
+        else
+                d->first = j;
+        d->last = j;
+        _wake(d);
+        pthread_mutex_unlock(&d->mutex);
+
+        NFT_LOG(L_INFO, "Queued \"%s\"", path);
+
+        return NFT_SUCCESS;
+}
+
+
+/** ask playback for its stats & send them to client */
+static void _stats(Daemon * d, int client)
+{
+        pthread_mutex_lock(&d->mutex);
+
+        if(d->idle)
+        {
+                pthread_mutex_unlock(&d->mutex);
+                _reply(client, "OK idle\n");
+                return;
+        }
+
+        d->stats_ready = false;
+        d->stats_wanted = true;
+        _wake_stats(d);
+
+        /* playback answers from its event loop */
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += 2;
+        while(!d->stats_ready && !d->stop)
+        {
+                if(pthread_cond_timedwait(&d->answered, &d->mutex, &t) ==
+                   ETIMEDOUT)
+                        break;
+        }
+
+        DaemonStats st = d->stats;
+        bool ready = d->stats_ready;
+        d->stats_wanted = false;
+        pthread_mutex_unlock(&d->mutex);
+
+        if(!ready)
+        {
+                _reply(client, "ERR playback didn't answer\n");
+                return;
+        }
+
+        char msg[1280];
+        snprintf(msg, sizeof(msg),
+                 "OK file=%s entry=%lu frame=%lu fps=%d paused=%d "
+                 "frames_sent=%llu syscalls_per_frame=%.3f\n", st.file,
+                 st.seq, st.frame, st.fps, st.paused ? 1 : 0, st.frames_sent,
+                 st.frames_read ? (double) st.syscalls / st.frames_read : 0);
+        _reply(client, msg);
+}
+
+
+/** handle one line received from client */
+static void _command(Daemon * d, int client, char *line)
+{
+        line[strcspn(line, "\r\n")] = '\0';
+
+        /* commands taking an integer argument */
+        long arg = 0;
+        bool valid = true;
+        char *end;
+        if(strncmp(line, "seek ", 5) == 0 || strncmp(line, "fps ", 4) == 0)
+        {
+                arg = strtol(strchr(line, ' ') + 1, &end, 10);
+                valid = (*end == '\0' && arg >= 0);
+                if(line[0] == 'f')
+                        valid = valid && arg > 0 && arg <= 1000;
+        }
+
+        if(strncmp(line, "play ", 5) == 0)
+        {
+                if(!_queue(d, &line[5], false, false))
+                {
+                        _reply(client, "ERR failed to queue file\n");
+                        return;
+                }
+        }
+        else if(strncmp(line, "playlist ", 9) == 0 ||
+                strncmp(line, "load ", 5) == 0)
+        {
+                const char *file = strchr(line, ' ') + 1;
+
+                /* our stdin isn't the client's */
+                if(strcmp(file, "-") == 0 ||
+                   !_queue(d, file, true, line[0] == 'l'))
+                {
+                        _reply(client, "ERR failed to queue playlist\n");
+                        return;
+                }
+        }
+        else if(strcmp(line, "stats") == 0)
+        {
+                _stats(d, client);
+                return;
+        }
+        else if(!valid)
+        {
+                _reply(client, "ERR invalid argument\n");
+                return;
+        }
+        else
+        {
+                pthread_mutex_lock(&d->mutex);
+                if(strcmp(line, "clear") == 0)
+                {
+                        _clear_queue(d);
+                        d->req.clear = true;
+                }
+                else if(strcmp(line, "pause") == 0)
+                        d->req.pause = 1;
+                else if(strcmp(line, "resume") == 0)
+                        d->req.pause = -1;
+                else if((strcmp(line, "next") == 0 ||
+                         strcmp(line, "prev") == 0) && d->idle)
+                {
+                        pthread_mutex_unlock(&d->mutex);
+                        _reply(client, "ERR nothing playing\n");
+                        return;
+                }
+                else if(strcmp(line, "next") == 0)
+                        d->req.skip++;
+                else if(strcmp(line, "prev") == 0)
+                {
+                        /* released entries can't be played again */
+                        if(d->req.skip - 1 < -(long) d->back)
+                        {
+                                pthread_mutex_unlock(&d->mutex);
+                                _reply(client,
+                                       "ERR can't step back further\n");
+                                return;
+                        }
+                        d->req.skip--;
+                }
+                else if(strncmp(line, "seek ", 5) == 0)
+                        d->req.seek = arg;
+                else if(strncmp(line, "fps ", 4) == 0)
+                        d->req.fps = (int) arg;
+                else
+                {
+                        pthread_mutex_unlock(&d->mutex);
+                        _reply(client, "ERR unknown command\n");
+                        return;
+                }
+                _request(d);
+                pthread_mutex_unlock(&d->mutex);
+        }
+
+        _reply(client, "OK\n");
+}
+
+
+/** thread serving clients one after another */
+static void *_server_thread(void *arg)
+{
+        Daemon *d = arg;
+
+        for(;;)
+        {
+                int client = accept(d->sock, NULL, NULL);
+
+                pthread_mutex_lock(&d->mutex);
+                bool stop = d->stop;
+                if(!stop)
+                        d->client = client;
+                pthread_mutex_unlock(&d->mutex);
+
+                if(stop)
+                {
+                        if(client >= 0)
+                                close(client);
+                        break;
+                }
+
+                if(client < 0)
+                {
+                        if(errno == EINTR || errno == ECONNABORTED)
+                                continue;
+                        NFT_LOG_PERROR("accept()");
+                        break;
+                }
+
+                /* read commands line by line */
+                int fd;
+                FILE *f = NULL;
+                if((fd = dup(client)) < 0 || !(f = fdopen(fd, "r")))
+                {
+                        NFT_LOG_PERROR("fdopen()");
+                        if(fd >= 0)
+                                close(fd);
+                }
+                else
+                {
+                        char line[1100];
+                        while(fgets(line, sizeof(line), f))
+                                _command(d, client, line);
+                        fclose(f);
+                }
+
+                pthread_mutex_lock(&d->mutex);
+                d->client = -1;
+                pthread_mutex_unlock(&d->mutex);
+                close(client);
+        }
+
+        return NULL;
+}
+
+
+/**
+ * start accepting jobs
+ *
+ * @param path filename of unix socket (an existing socket is replaced)
+ * @param loop true if playlists of jobs start over when they end
+ * @param window amount of entries playlists of jobs keep enumerated
+ * @result daemon or NULL upon error
+ */
+Daemon *daemon_new(const char *path, bool loop, size_t window)
+{
+        if(!path)
+                return NULL;
+
+        Daemon *d;
+        if(!(d = calloc(1, sizeof(Daemon))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        d->sock = -1;
+        d->client = -1;
+        d->wake = -1;
+        d->stats_fd = -1;
+        d->loop = loop;
+        d->window = window;
+        d->req.seek = -1;
+        pthread_mutex_init(&d->mutex, NULL);
+
+        if((d->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+           (d->stats_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        {
+                NFT_LOG_PERROR("eventfd()");
+                goto _dn_error;
+        }
+        pthread_cond_init(&d->answered, NULL);
+
+        d->addr.sun_family = AF_UNIX;
+        if(strlen(path) >= sizeof(d->addr.sun_path))
+        {
+                NFT_LOG(L_ERROR, "Socket path \"%s\" too long", path);
+                goto _dn_error;
+        }
+        strcpy(d->addr.sun_path, path);
+
+        if((d->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        {
+                NFT_LOG_PERROR("socket()");
+                goto _dn_error;
+        }
+
+        /* remove stale socket of previous run */
+        struct stat st;
+        if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+                unlink(path);
+
+        if(bind(d->sock, (struct sockaddr *) &d->addr, sizeof(d->addr)) < 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to bind \"%s\": %s", path,
+                        strerror(errno));
+                goto _dn_error;
+        }
+        d->bound = true;
+
+        if(listen(d->sock, 4) < 0)
+        {
+                NFT_LOG_PERROR("listen()");
+                goto _dn_error;
+        }
+
+        if(pthread_create(&d->thread, NULL, _server_thread, d) != 0)
+        {
+                NFT_LOG_PERROR("pthread_create()");
+                goto _dn_error;
+        }
+        d->started = true;
+
+        NFT_LOG(L_INFO, "Waiting for jobs on \"%s\"", path);
+
+        return d;
+
+_dn_error:
+        daemon_destroy(d);
+        return NULL;
+}
+
+
+/**
+ * get next queued job (blocks until one is queued)
+ *
+ * @param d daemon
+ * @param events event loop handled while waiting
+ * @param running running flag
+ * @result playlist of job (to be destroyed by caller) or NULL if
+ *         *running became false
+ */
+Playlist *daemon_next_job(Daemon * d, Events * events, bool * running)
+{
+        if(!d || !events || !running)
+                return NULL;
+
+        pthread_mutex_lock(&d->mutex);
+
+        d->idle = true;
+
+        while(*running && !d->first)
+        {
+                pthread_mutex_unlock(&d->mutex);
+                events_wait_fd(events, d->wake, 0);
+                _drain(d);
+                pthread_mutex_lock(&d->mutex);
+        }
+        d->idle = false;
+
+        /* job playing is done (requests concerning it are obsolete) */
+        d->req.clear = false;
+        d->req.skip = 0;
+        d->req.seek = -1;
+        d->back = 0;
+
+        Playlist *p = NULL;
+        struct Job *j;
+        if(*running && (j = d->first))
+        {
+                d->first = j->next;
+                if(!d->first)
+                        d->last = NULL;
+                p = j->playlist;
+                free(j);
+        }
+
+        pthread_mutex_unlock(&d->mutex);
+
+        return p;
+}
+
+
+/**
+ * @result true if a job is waiting to be played
+ */
+bool daemon_pending(Daemon * d)
+{
+        if(!d)
+                return false;
+
+        pthread_mutex_lock(&d->mutex);
+        bool r = (d->first != NULL);
+        pthread_mutex_unlock(&d->mutex);
+
+        return r;
+}
+
+
+/**
+ * get requests of clients (called by playback at every frame boundary)
+ *
+ * @param d daemon
+ * @param r space for requests (only valid if NFT_SUCCESS is returned)
+ * @result NFT_SUCCESS if something was requested since the last call
+ */
+NftResult daemon_poll(Daemon * d, DaemonRequest * r)
+{
+        if(!d || !r)
+                return NFT_FAILURE;
+
+        /* nothing requested (no locking in this case) */
+        if(!__atomic_load_n(&d->changed, __ATOMIC_ACQUIRE))
+                return NFT_FAILURE;
+
+        pthread_mutex_lock(&d->mutex);
+        *r = d->req;
+        /* entry skipped to reports how far it can step back */
+        if(r->skip)
+                d->back = 0;
+        memset(&d->req, 0, sizeof(d->req));
+        d->req.seek = -1;
+        __atomic_store_n(&d->changed, 0, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&d->mutex);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * wait for requests of clients
+ *
+ * @param d daemon
+ * @param events event loop handled while waiting
+ * @param seconds maximum time to wait
+ */
+void daemon_wait(Daemon * d, Events * events, double seconds)
+{
+        if(!d || !events)
+                return;
+
+        if(!__atomic_load_n(&d->changed, __ATOMIC_ACQUIRE))
+                events_wait_fd(events, d->wake, seconds);
+        _drain(d);
+}
+
+
+/**
+ * tell daemon which entry of the job is playing
+ *
+ * @param d daemon
+ * @param back amount of entries before it that can still be played
+ */
+void daemon_playing(Daemon * d, unsigned long back)
+{
+        if(!d)
+                return;
+
+        pthread_mutex_lock(&d->mutex);
+        d->back = back;
+        pthread_mutex_unlock(&d->mutex);
+}
+
+
+/**
+ * @result descriptor that becomes readable when a client asks for stats
+ *         (to be watched by the event loop, which calls daemon_stats()
+ *         then)
+ */
+int daemon_get_fd(Daemon * d)
+{
+        if(!d)
+                return -1;
+
+        return d->stats_fd;
+}
+
+
+/**
+ * reset descriptor of daemon_get_fd() & answer stats request of client
+ * (if one waits)
+ *
+ * @param d daemon
+ * @param s current state of playback
+ */
+void daemon_stats(Daemon * d, const DaemonStats * s)
+{
+        if(!d || !s)
+                return;
+
+        uint64_t n;
+        if(read(d->stats_fd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+                NFT_LOG_PERROR("read()");
+
+        pthread_mutex_lock(&d->mutex);
+        if(d->stats_wanted)
+        {
+                d->stats = *s;
+                d->stats_ready = true;
+                d->stats_wanted = false;
+                pthread_cond_broadcast(&d->answered);
+        }
+        pthread_mutex_unlock(&d->mutex);
+}
+
+
+/**
+ * stop accepting jobs, free queue & remove socket
+ */
+void daemon_destroy(Daemon * d)
+{
+        if(!d)
+                return;
+
+        /* wake up thread */
+        pthread_mutex_lock(&d->mutex);
+        d->stop = true;
+        pthread_cond_broadcast(&d->answered);
+        if(d->client >= 0)
+                shutdown(d->client, SHUT_RDWR);
+        pthread_mutex_unlock(&d->mutex);
+        if(d->sock >= 0)
+                shutdown(d->sock, SHUT_RDWR);
+
+        if(d->started)
+                pthread_join(d->thread, NULL);
+
+        if(d->sock >= 0)
+                close(d->sock);
+        if(d->bound)
+                unlink(d->addr.sun_path);
+
+        _clear_queue(d);
+        if(d->wake >= 0)
+                close(d->wake);
+        if(d->stats_fd >= 0)
+                close(d->stats_fd);
+        pthread_cond_destroy(&d->answered);
+        pthread_mutex_destroy(&d->mutex);
+        free(d);
+}
@@ -0,0 +1,99 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _DAEMON_H
+#define _DAEMON_H
+
+
+/** server accepting play jobs on a local unix socket */
+typedef struct _Daemon          Daemon;
+
+/** requests of clients to be applied by playback */
+typedef struct
+{
+        /** true to stop the job playing */
+        bool                            clear;
+        /** 1 to pause, -1 to resume (0 = unchanged) */
+        int                             pause;
+        /** files to skip forward (negative = backward) */
+        int                             skip;
+        /** frame of current file to continue with (-1 = unchanged) */
+        long                            seek;
+        /** new framerate (0 = unchanged) */
+        int                             fps;
+} DaemonRequest;
+
+/** state of playback reported to clients */
+typedef struct
+{
+        /** file playing */
+        char                            file[1024];
+        /** n-th entry of job playing */
+        unsigned long                   seq;
+        /** frame of file shown */
+        unsigned long                   frame;
+        /** framerate */
+        int                             fps;
+        /** true if paused */
+        bool                            paused;
+        /** frames sent since start */
+        unsigned long long              frames_sent;
+        /** raw frames read since start */
+        unsigned long long              frames_read;
+        /** syscalls made to read them */
+        unsigned long long              syscalls;
+} DaemonStats;
+
+
+Daemon                         *daemon_new(const char *path, bool loop, size_t window);
+Playlist                       *daemon_next_job(Daemon * d, Events * events, bool * running);
+bool                            daemon_pending(Daemon * d);
+NftResult                       daemon_poll(Daemon * d, DaemonRequest * r);
+void                            daemon_wait(Daemon * d, Events * events, double seconds);
+void                            daemon_playing(Daemon * d, unsigned long back);
+int                             daemon_get_fd(Daemon * d);
+void                            daemon_stats(Daemon * d, const DaemonStats * s);
+void                            daemon_destroy(Daemon * d);
+
+
+#endif /** _DAEMON_H */
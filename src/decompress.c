@@ -0,0 +1,469 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Compressed raw input (LZ4 frame format or zstd, detected by magic
+ * number) is decompressed on a worker thread. It writes the decoded
+ * stream into a pipe that is read like any uncompressed input, so
+ * waiting for decoded frames is handled by the event loop as usual and
+ * decoding overlaps with playback.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <niftyled.h>
+#if HAVE_LZ4 == 1
+#include <lz4frame.h>
+#endif
+#if HAVE_ZSTD == 1
+#include <zstd.h>
+#endif
+#include "decompress.h"
+
+
+/** size of pipe the decoded stream is written to */
+#define DECOMPRESS_PIPE_SIZE    (1024 * 1024)
+/** size of chunks read from compressed input */
+#define DECOMPRESS_CHUNK        (64 * 1024)
+
+
+/** supported formats */
+typedef enum
+{
+        FORMAT_NONE = 0,
+        FORMAT_LZ4,
+        FORMAT_ZSTD,
+} DecompressFormat;
+
+
+/** decompressor descriptor */
+struct _Decompressor
+{
+        /** format of stream */
+        DecompressFormat format;
+        /** compressed input */
+        int fd;
+        /** bytes read from fd before the format was detected */
+        char *head;
+        /** size of head in bytes */
+        size_t head_size;
+        /** decoded stream (read end, write end) */
+        int out[2];
+        /** written to stop worker */
+        int quit[2];
+        /** worker */
+        pthread_t thread;
+        /** true if worker was started */
+        bool started;
+};
+
+
+
+/** get format of stream from its first bytes */
+static DecompressFormat _format(const uint8_t * b, size_t size)
+{
+        if(size < DECOMPRESS_PROBE_SIZE)
+                return FORMAT_NONE;
+
+#if HAVE_LZ4 == 1
+        /* 0x184D2204 */
+        if(b[0] == 0x04 && b[1] == 0x22 && b[2] == 0x4d && b[3] == 0x18)
+                return FORMAT_LZ4;
+#endif
+#if HAVE_ZSTD == 1
+        /* 0xFD2FB528 */
+        if(b[0] == 0x28 && b[1] == 0xb5 && b[2] == 0x2f && b[3] == 0xfd)
+                return FORMAT_ZSTD;
+#endif
+
+        return FORMAT_NONE;
+}
+
+
+#if HAVE_LZ4 == 1 || HAVE_ZSTD == 1
+/**
+ * read compressed input (head first)
+ *
+ * @result bytes read, 0 at end of input (or when stopped), < 0 on error
+ */
+static ssize_t _input(Decompressor * d, void *buf, size_t size)
+{
+        if(d->head_size)
+        {
+                size_t n = d->head_size < size ? d->head_size : size;
+                memcpy(buf, d->head, n);
+                memmove(d->head, d->head + n, d->head_size - n);
+                d->head_size -= n;
+                return n;
+        }
+
+        /* wait for input or until we're stopped */
+        struct pollfd p[2] = {
+                {.fd = d->fd,.events = POLLIN},
+                {.fd = d->quit[0],.events = POLLIN},
+        };
+        while(poll(p, 2, -1) < 0)
+        {
+                if(errno != EINTR)
+                {
+                        NFT_LOG_PERROR("poll()");
+                        return -1;
+                }
+        }
+        if(p[1].revents)
+                return 0;
+
+        ssize_t n;
+        while((n = read(d->fd, buf, size)) < 0)
+        {
+                if(errno != EINTR && errno != EAGAIN)
+                {
+                        NFT_LOG_PERROR("read()");
+                        return -1;
+                }
+        }
+
+        return n;
+}
+
+
+/** write decoded data (false if reader went away) */
+static bool _output(Decompressor * d, const char *buf, size_t size)
+{
+        while(size)
+        {
+                ssize_t n;
+                if((n = write(d->out[1], buf, size)) < 0)
+                {
+                        if(errno == EINTR)
+                                continue;
+                        if(errno != EPIPE)
+                                NFT_LOG_PERROR("write()");
+                        return false;
+                }
+
+                buf += n;
+                size -= n;
+        }
+
+        return true;
+}
+#endif
+
+
+#if HAVE_LZ4 == 1
+/** decode LZ4 frames */
+static void _lz4(Decompressor * d)
+{
+        LZ4F_dctx *ctx;
+        size_t r;
+        if(LZ4F_isError(r = LZ4F_createDecompressionContext(&ctx,
+                                                            LZ4F_VERSION)))
+        {
+                NFT_LOG(L_ERROR, "Failed to initialize LZ4: %s",
+                        LZ4F_getErrorName(r));
+                return;
+        }
+
+        char *in = malloc(DECOMPRESS_CHUNK);
+        char *out = malloc(DECOMPRESS_CHUNK);
+        if(!in || !out)
+        {
+                NFT_LOG_PERROR("malloc()");
+                goto _lz4_end;
+        }
+
+        ssize_t n;
+        while((n = _input(d, in, DECOMPRESS_CHUNK)) > 0)
+        {
+                size_t pos = 0, out_size;
+                do
+                {
+                        size_t in_size = n - pos;
+                        out_size = DECOMPRESS_CHUNK;
+                        if(LZ4F_isError(r = LZ4F_decompress(ctx, out,
+                                                            &out_size,
+                                                            in + pos,
+                                                            &in_size,
+                                                            NULL)))
+                        {
+                                NFT_LOG(L_ERROR, "LZ4 stream corrupt: %s",
+                                        LZ4F_getErrorName(r));
+                                goto _lz4_end;
+                        }
+                        pos += in_size;
+
+                        if(out_size && !_output(d, out, out_size))
+                                goto _lz4_end;
+                }
+                while(pos < (size_t) n || out_size == DECOMPRESS_CHUNK);
+        }
+
+_lz4_end:
+        free(in);
+        free(out);
+        LZ4F_freeDecompressionContext(ctx);
+}
+#endif
+
+
+#if HAVE_ZSTD == 1
+/** decode zstd frames */
+static void _zstd(Decompressor * d)
+{
+        ZSTD_DStream *z;
+        if(!(z = ZSTD_createDStream()))
+        {
+                NFT_LOG(L_ERROR, "Failed to initialize zstd");
+                return;
+        }
+        ZSTD_initDStream(z);
+
+        size_t in_size = ZSTD_DStreamInSize();
+        size_t out_size = ZSTD_DStreamOutSize();
+        char *in = malloc(in_size);
+        char *out = malloc(out_size);
+        if(!in || !out)
+        {
+                NFT_LOG_PERROR("malloc()");
+                goto _zstd_end;
+        }
+
+        ssize_t n;
+        while((n = _input(d, in, in_size)) > 0)
+        {
+                ZSTD_inBuffer ib = {.src = in,.size = n,.pos = 0 };
+                ZSTD_outBuffer ob;
+                do
+                {
+                        ob.dst = out;
+                        ob.size = out_size;
+                        ob.pos = 0;
+
+                        size_t r;
+                        if(ZSTD_isError(r = ZSTD_decompressStream(z, &ob,
+                                                                  &ib)))
+                        {
+                                NFT_LOG(L_ERROR, "zstd stream corrupt: %s",
+                                        ZSTD_getErrorName(r));
+                                goto _zstd_end;
+                        }
+
+                        if(ob.pos && !_output(d, out, ob.pos))
+                                goto _zstd_end;
+                }
+                while(ib.pos < ib.size || ob.pos == ob.size);
+        }
+
+_zstd_end:
+        free(in);
+        free(out);
+        ZSTD_freeDStream(z);
+}
+#endif
+
+
+/** worker: decode input until it ends (or we're stopped) */
+static void *_thread(void *arg)
+{
+        Decompressor *d = arg;
+
+        /* get EPIPE instead of SIGPIPE when reader went away */
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+        switch (d->format)
+        {
+#if HAVE_LZ4 == 1
+                case FORMAT_LZ4:
+                        _lz4(d);
+                        break;
+#endif
+#if HAVE_ZSTD == 1
+                case FORMAT_ZSTD:
+                        _zstd(d);
+                        break;
+#endif
+                default:
+                        break;
+        }
+
+        /* end of decoded stream */
+        close(d->out[1]);
+        d->out[1] = -1;
+
+        return NULL;
+}
+
+
+
+/**
+ * check if stream is compressed in a supported format
+ *
+ * @param buf first bytes of stream
+ * @param size size of buf in bytes
+ * @result true if stream can be decompressed
+ */
+bool decompress_probe(const void *buf, size_t size)
+{
+        return _format(buf, size) != FORMAT_NONE;
+}
+
+
+/**
+ * start decompressing stream
+ *
+ * @param fd compressed input (must stay open until decompressor is
+ *        destroyed)
+ * @param head bytes already read from fd (will be copied)
+ * @param size size of head in bytes
+ * @result newly allocated decompressor or NULL
+ */
+Decompressor *decompress_new(int fd, const void *head, size_t size)
+{
+        Decompressor *d;
+        if(!(d = calloc(1, sizeof(Decompressor))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+        d->fd = fd;
+        d->out[0] = d->out[1] = -1;
+        d->quit[0] = d->quit[1] = -1;
+
+        if((d->format = _format(head, size)) == FORMAT_NONE)
+        {
+                NFT_LOG(L_ERROR, "Unsupported compressed stream");
+                goto _dn_error;
+        }
+
+        if(!(d->head = malloc(size)))
+        {
+                NFT_LOG_PERROR("malloc()");
+                goto _dn_error;
+        }
+        memcpy(d->head, head, size);
+        d->head_size = size;
+
+        if(pipe2(d->out, O_CLOEXEC) != 0 || pipe2(d->quit, O_CLOEXEC) != 0)
+        {
+                NFT_LOG_PERROR("pipe2()");
+                goto _dn_error;
+        }
+
+#ifdef F_SETPIPE_SZ
+        /* room for many decoded frames (best effort) */
+        fcntl(d->out[1], F_SETPIPE_SZ, DECOMPRESS_PIPE_SIZE);
+#endif
+
+        if(pthread_create(&d->thread, NULL, _thread, d) != 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to start decompression thread");
+                goto _dn_error;
+        }
+        d->started = true;
+
+        NFT_LOG(L_INFO, "Decompressing %s stream",
+                d->format == FORMAT_LZ4 ? "LZ4" : "zstd");
+
+        return d;
+
+_dn_error:
+        decompress_destroy(d);
+        return NULL;
+}
+
+
+/**
+ * get descriptor to read decoded stream from
+ */
+int decompress_get_fd(Decompressor * d)
+{
+        return d->out[0];
+}
+
+
+/**
+ * stop decompressing & free decompressor
+ */
+void decompress_destroy(Decompressor * d)
+{
+        if(!d)
+                return;
+
+        if(d->started)
+        {
+                /* wake worker waiting for input & let it fail writing */
+                char c = 'q';
+                if(write(d->quit[1], &c, 1) < 0)
+                        NFT_LOG_PERROR("write()");
+                close(d->out[0]);
+                d->out[0] = -1;
+                pthread_join(d->thread, NULL);
+        }
+
+        int i;
+        for(i = 0; i < 2; i++)
+        {
+                if(d->out[i] >= 0)
+                        close(d->out[i]);
+                if(d->quit[i] >= 0)
+                        close(d->quit[i]);
+        }
+        free(d->head);
+        free(d);
+}
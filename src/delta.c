@@ -0,0 +1,184 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <niftyled.h>
+#include "events.h"
+#include "raw.h"
+#include "correction.h"
+#include "dirty.h"
+#include "delta.h"
+
+
+/** delta input descriptor */
+struct _Delta
+{
+        /** size of one pixel in bytes */
+        size_t bpp;
+        /** component size to convert runs to native byte order (0 =
+         * native) */
+        size_t swap_size;
+        /** applied to runs before they're copied (NULL = none) */
+        Correction *correction;
+        /** frames applied */
+        unsigned long long frames;
+        /** pixels changed by them */
+        unsigned long long pixels;
+};
+
+
+
+/** 32-bit little-endian integer */
+static uint32_t _le32(const char *b)
+{
+        const uint8_t *u = (const uint8_t *) b;
+        return (uint32_t) u[0] | (uint32_t) u[1] << 8 |
+                (uint32_t) u[2] << 16 | (uint32_t) u[3] << 24;
+}
+
+
+
+/**
+ * create delta input state
+ *
+ * @param f pixelformat of runs (and of the frame they're applied to)
+ * @param swap_size component size to convert runs to native byte order
+ *        (0 = native)
+ * @param correction applied to runs before they're copied to the frame
+ *        (NULL = none)
+ * @result newly allocated descriptor or NULL
+ */
+Delta *delta_new(LedPixelFormat * f, size_t swap_size,
+                 Correction * correction)
+{
+        Delta *d;
+        if(!(d = calloc(1, sizeof(Delta))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        d->bpp = led_pixel_format_get_bytes_per_pixel(f);
+        d->swap_size = swap_size;
+        d->correction = correction;
+
+        return d;
+}
+
+
+/**
+ * read next delta frame & apply its runs to frame
+ *
+ * @param d descriptor acquired by delta_new()
+ * @param reader reader to read runs with
+ * @param frame current frame (changed in place)
+ * @param pixels amount of pixels of frame
+ * @param dirty tracker the changed pixels are marked in (NULL = none)
+ * @result >= 0 on success, < 0 at end of file or on error
+ */
+int delta_read_frame(Delta * d, RawReader * reader, Events * events,
+                     bool * running, int fd, void *frame, size_t pixels,
+                     Dirty * dirty)
+{
+        char *b;
+        if(!(b = raw_reader_frame(reader, events, running, fd, 4)))
+                return -1;
+
+        uint32_t runs = _le32(b), r;
+        dirty_clear(dirty);
+
+        for(r = 0; r < runs; r++)
+        {
+                if(!(b = raw_reader_frame(reader, events, running, fd, 8)))
+                        return -1;
+
+                size_t offset = _le32(b), count = _le32(b + 4);
+                if(offset > pixels || count > pixels - offset)
+                {
+                        NFT_LOG(L_ERROR,
+                                "Delta run of %zu pixels at %zu exceeds frame of %zu pixels",
+                                count, offset, pixels);
+                        return -1;
+                }
+
+                size_t size = count * d->bpp;
+                if(!(b = raw_reader_frame(reader, events, running, fd, size)))
+                        return -1;
+
+                /* native byte order, color corrected */
+                if(d->swap_size > 1)
+                        raw_swap_frame(b, size, d->swap_size);
+                if(d->correction)
+                        correction_apply(d->correction, b, size);
+
+                memcpy((char *) frame + offset * d->bpp, b, size);
+                dirty_mark(dirty, offset, count);
+                d->pixels += count;
+        }
+
+        d->frames++;
+
+        return 0;
+}
+
+
+/**
+ * get amount of frames applied & pixels changed by them
+ */
+void delta_get_stats(Delta * d, unsigned long long *frames,
+                     unsigned long long *pixels)
+{
+        *frames = d ? d->frames : 0;
+        *pixels = d ? d->pixels : 0;
+}
+
+
+/**
+ * free descriptor
+ */
+void delta_destroy(Delta * d)
+{
+        free(d);
+}
@@ -0,0 +1,224 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <niftyled.h>
+#include "dirty.h"
+
+
+/** max. amount of hardware tracked (chains of any further hardware are
+ * always refilled) */
+#define DIRTY_MAX_HARDWARE      32
+
+
+/** dirty tracking descriptor */
+struct _Dirty
+{
+        /** frame width */
+        LedFrameCord width;
+        /** frame height */
+        LedFrameCord height;
+        /** per frame pixel: mask of hardware whose chain shows it */
+        uint32_t *owners;
+        /** mask of all tracked hardware */
+        uint32_t all;
+        /** mask of hardware whose chain must be refilled */
+        uint32_t mask;
+        /** mask of hardware whose chain wasn't filled since the tracker
+         * was created (refilled whatever changed) */
+        uint32_t force;
+        /** frames sent */
+        unsigned long long frames;
+        /** chains refilled for them */
+        unsigned long long chains;
+};
+
+
+
+/**
+ * map every pixel of a frame to the hardware chains it's shown on
+ *
+ * @param hw list of hardware (its mapping must be refreshed)
+ * @param f frame the chains are filled from
+ * @result newly allocated tracker (all chains dirty) or NULL
+ */
+Dirty *dirty_new(LedHardware * hw, LedFrame * f)
+{
+        Dirty *d;
+        if(!(d = calloc(1, sizeof(Dirty))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        if(!led_frame_get_dim(f, &d->width, &d->height))
+                goto _dn_error;
+
+        if(!(d->owners = calloc((size_t) d->width * d->height,
+                                sizeof(uint32_t))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                goto _dn_error;
+        }
+
+        LedHardware *h;
+        size_t n;
+        for(h = hw, n = 0; h && n < DIRTY_MAX_HARDWARE;
+            h = led_hardware_list_get_next(h), n++)
+        {
+                LedChain *c = led_hardware_get_chain(h);
+                LedCount i, leds = led_chain_get_ledcount(c);
+                for(i = 0; i < leds; i++)
+                {
+                        Led *l = led_chain_get_nth(c, i);
+                        LedFrameCord x = led_get_x(l), y = led_get_y(l);
+
+                        /* LED outside of frame */
+                        if(x < 0 || y < 0 || x >= d->width ||
+                           y >= d->height)
+                                continue;
+
+                        d->owners[(size_t) y * d->width + x] |= 1u << n;
+                }
+
+                d->all |= 1u << n;
+        }
+
+        if(h)
+                NFT_LOG(L_WARNING,
+                        "Only tracking changes for the first %d hardware chains",
+                        DIRTY_MAX_HARDWARE);
+
+        d->mask = d->all;
+        d->force = d->all;
+
+        return d;
+
+_dn_error:
+        dirty_destroy(d);
+        return NULL;
+}
+
+
+/**
+ * start tracking changes of a new frame (no chain is dirty, except the
+ * ones not filled yet)
+ */
+void dirty_clear(Dirty * d)
+{
+        if(!d)
+                return;
+
+        d->mask = d->force;
+}
+
+
+/**
+ * mark pixels first ... first + count - 1 (in frame order) as changed
+ */
+void dirty_mark(Dirty * d, size_t first, size_t count)
+{
+        if(!d)
+                return;
+
+        size_t i;
+        for(i = first; i < first + count && d->mask != d->all; i++)
+                d->mask |= d->owners[i];
+}
+
+
+/**
+ * frame was sent: the next one counts as changed completely until
+ * dirty_clear() is called for it
+ */
+void dirty_sent(Dirty * d)
+{
+        if(!d)
+                return;
+
+        d->mask = d->all;
+        d->force = 0;
+        d->frames++;
+}
+
+
+/**
+ * check if chain of n-th hardware of list must be refilled (always true
+ * without tracker)
+ */
+bool dirty_chain(Dirty * d, size_t n)
+{
+        if(!d || n >= DIRTY_MAX_HARDWARE)
+                return true;
+
+        if(!(d->mask & (1u << n)))
+                return false;
+
+        d->chains++;
+        return true;
+}
+
+
+/**
+ * get amount of frames sent & chains refilled for them
+ */
+void dirty_get_stats(Dirty * d, unsigned long long *frames,
+                     unsigned long long *chains)
+{
+        *frames = d ? d->frames : 0;
+        *chains = d ? d->chains : 0;
+}
+
+
+/**
+ * free tracker
+ */
+void dirty_destroy(Dirty * d)
+{
+        if(!d)
+                return;
+
+        free(d->owners);
+        free(d);
+}
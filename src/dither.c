@@ -0,0 +1,178 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <niftyled.h>
+#include "format.h"
+#include "dither.h"
+
+
+/** dither descriptor */
+struct _Dither
+{
+        /** u8 output frame */
+        LedFrame *frame;
+        /** amount of components per frame */
+        size_t n;
+        /** quantization error carried to the next frame (0 - 256) */
+        uint16_t *error;
+};
+
+
+
+/**
+ * create new ditherer. The chains should be mapped from the frame
+ * returned by dither_get_frame() instead of the input frame.
+ *
+ * @param f pixelformat of input frames (must be u16)
+ * @param width width of input frames
+ * @param height height of input frames
+ * @result new ditherer or NULL
+ */
+Dither *dither_new(LedPixelFormat * f, LedFrameCord width,
+                   LedFrameCord height)
+{
+        if(!format_is_unsigned(f) || format_component_size(f) != 2)
+        {
+                NFT_LOG(L_ERROR,
+                        "Dithering needs a u16 pixelformat (not \"%s\")",
+                        led_pixel_format_to_string(f));
+                return NULL;
+        }
+
+        Dither *d;
+        if(!(d = calloc(1, sizeof(Dither))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        /* same colorspace with 8 bit per component */
+        char name[64];
+        snprintf(name, sizeof(name), "%s u8",
+                 led_pixel_format_colorspace_to_string(f));
+        LedPixelFormat *out;
+        if(!(out = led_pixel_format_from_string(name)) ||
+           !(d->frame = led_frame_new(width, height, out)))
+        {
+                NFT_LOG(L_ERROR, "Failed to create \"%s\" frame", name);
+                dither_destroy(d);
+                return NULL;
+        }
+        /* output frame is in host byte order */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        led_frame_set_big_endian(d->frame, true);
+#else
+        led_frame_set_big_endian(d->frame, false);
+#endif
+
+        d->n = (size_t) width * height * led_pixel_format_get_n_components(f);
+        if(!(d->error = malloc(d->n * sizeof(uint16_t))))
+        {
+                NFT_LOG_PERROR("malloc()");
+                dither_destroy(d);
+                return NULL;
+        }
+
+        /* scatter initial error so neighbouring LEDs don't change level
+         * in the same frame during slow fades */
+        size_t i;
+        for(i = 0; i < d->n; i++)
+                d->error[i] = (uint16_t) ((i * 2654435761u) >> 16) % 257;
+
+        NFT_LOG(L_INFO, "Dithering %s to %s", led_pixel_format_to_string(f),
+                name);
+
+        return d;
+}
+
+
+/**
+ * get u8 output frame of ditherer
+ */
+LedFrame *dither_get_frame(Dither * d)
+{
+        return d->frame;
+}
+
+
+/**
+ * quantize one u16 frame to u8 for the next output frame. The quantization
+ * error of every component is carried to the next frame, so over time the
+ * average output equals the 16 bit input.
+ *
+ * @param d ditherer acquired by dither_new()
+ * @param buf raw u16 input frame (native byte order)
+ */
+void dither_run(Dither * d, const void *buf)
+{
+        const uint16_t *in = buf;
+        uint8_t *out = led_frame_get_buffer(d->frame);
+        uint16_t *error = d->error;
+        size_t i;
+
+        for(i = 0; i < d->n; i++)
+        {
+                /* 0 - 65791 */
+                uint32_t v = (uint32_t) in[i] + error[i];
+                /* v / 257 (exact for this range) */
+                uint32_t q = (v * 0xff01u) >> 24;
+                out[i] = (uint8_t) q;
+                error[i] = (uint16_t) (v - q * 257);
+        }
+}
+
+
+/**
+ * free ditherer and all its resources
+ */
+void dither_destroy(Dither * d)
+{
+        if(!d)
+                return;
+
+        led_frame_destroy(d->frame);
+        free(d->error);
+        free(d);
+}
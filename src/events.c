@@ -0,0 +1,519 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * All signals ledcat handles are blocked & read from a signalfd, so they
+ * arrive as ordinary events instead of interrupting whatever runs (no
+ * work in signal context, no reliance on EINTR). Threads started after
+ * events_new() inherit the blocked signal mask.
+ *
+ * Everything is dispatched while the main thread waits: for the deadline
+ * of the next frame (timerfd) or for an input descriptor to become
+ * readable.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <niftyled.h>
+#include "events.h"
+
+
+/** maximum amount of periodic timers & watched descriptors */
+#define EVENTS_MAX_SOURCES      16
+
+
+
+/** kind of event source */
+typedef enum
+{
+        SOURCE_SIGNAL = 0,
+        SOURCE_DEADLINE,
+        SOURCE_TIMER,
+        SOURCE_FD,
+} SourceType;
+
+
+/** one descriptor in epoll set */
+struct Source
+{
+        /** descriptor */
+        int fd;
+        /** kind of source */
+        SourceType type;
+        /** function to call (timers & watched descriptors) */
+        EventCallback cb;
+        /** argument to cb */
+        void *arg;
+};
+
+
+/** event loop */
+struct _Events
+{
+        /** running flag (waits return when it becomes false) */
+        bool *running;
+        /** epoll descriptor */
+        int epoll;
+        /** signals handled */
+        sigset_t mask;
+        /** signalfd */
+        struct Source signals;
+        /** handlers of signals */
+        EventCallback handlers[NSIG];
+        /** arguments of handlers */
+        void *args[NSIG];
+        /** timerfd for deadline of next frame */
+        struct Source deadline;
+        /** true if deadline expired */
+        bool expired;
+        /** periodic timers & watched descriptors */
+        struct Source sources[EVENTS_MAX_SOURCES];
+        /** amount of sources used */
+        unsigned int sourcecount;
+};
+
+
+
+/** add descriptor to epoll set */
+static NftResult _add(Events * e, struct Source *s)
+{
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if(epoll_ctl(e->epoll, EPOLL_CTL_ADD, s->fd, &ev) < 0)
+        {
+                NFT_LOG_PERROR("epoll_ctl()");
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** handle pending events (blocks for timeout milliseconds, -1 = forever) */
+static NftResult _dispatch(Events * e, int timeout)
+{
+        struct epoll_event ev[8];
+        int n = epoll_wait(e->epoll, ev, 8, timeout);
+        if(n < 0)
+        {
+                if(errno == EINTR)
+                        return NFT_SUCCESS;
+                NFT_LOG_PERROR("epoll_wait()");
+                return NFT_FAILURE;
+        }
+
+        int i;
+        for(i = 0; i < n; i++)
+        {
+                struct Source *s = ev[i].data.ptr;
+                switch (s->type)
+                {
+                        case SOURCE_SIGNAL:
+                        {
+                                struct signalfd_siginfo si;
+                                while(read(s->fd, &si, sizeof(si)) ==
+                                      sizeof(si))
+                                {
+                                        if(si.ssi_signo < NSIG &&
+                                           e->handlers[si.ssi_signo])
+                                                e->handlers[si.ssi_signo]
+                                                        (e->args
+                                                         [si.ssi_signo]);
+                                }
+                                break;
+                        }
+
+                        case SOURCE_DEADLINE:
+                        case SOURCE_TIMER:
+                        {
+                                uint64_t expirations;
+                                if(read(s->fd, &expirations,
+                                        sizeof(expirations)) !=
+                                   sizeof(expirations))
+                                        break;
+
+                                if(s->type == SOURCE_DEADLINE)
+                                        e->expired = true;
+                                else
+                                        s->cb(s->arg);
+                                break;
+                        }
+
+                        case SOURCE_FD:
+                        {
+                                s->cb(s->arg);
+                                break;
+                        }
+                }
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * create event loop
+ *
+ * @param running running flag (waits return early when it becomes false)
+ * @result event loop or NULL upon error
+ */
+Events *events_new(bool * running)
+{
+        if(!running)
+                return NULL;
+
+        Events *e;
+        if(!(e = calloc(1, sizeof(Events))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        e->running = running;
+        e->signals.fd = -1;
+        e->signals.type = SOURCE_SIGNAL;
+        e->deadline.fd = -1;
+        e->deadline.type = SOURCE_DEADLINE;
+        sigemptyset(&e->mask);
+
+        if((e->epoll = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        {
+                NFT_LOG_PERROR("epoll_create1()");
+                goto _en_error;
+        }
+
+        if((e->signals.fd = signalfd(-1, &e->mask,
+                                     SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+        {
+                NFT_LOG_PERROR("signalfd()");
+                goto _en_error;
+        }
+
+        if((e->deadline.fd = timerfd_create(CLOCK_MONOTONIC,
+                                            TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+        {
+                NFT_LOG_PERROR("timerfd_create()");
+                goto _en_error;
+        }
+
+        if(!_add(e, &e->signals) || !_add(e, &e->deadline))
+                goto _en_error;
+
+        return e;
+
+_en_error:
+        events_destroy(e);
+        return NULL;
+}
+
+
+/**
+ * handle a signal as event (must be called before threads are started)
+ *
+ * @param e event loop
+ * @param signum signal
+ * @param cb function called (in normal context) when signal arrived
+ * @param arg argument to cb
+ */
+NftResult events_on_signal(Events * e, int signum, EventCallback cb,
+                           void *arg)
+{
+        if(!e || signum <= 0 || signum >= NSIG || !cb)
+                return NFT_FAILURE;
+
+        e->handlers[signum] = cb;
+        e->args[signum] = arg;
+
+        sigaddset(&e->mask, signum);
+        int err;
+        if((err = pthread_sigmask(SIG_BLOCK, &e->mask, NULL)) != 0)
+        {
+                NFT_LOG(L_ERROR, "pthread_sigmask(): %s", strerror(err));
+                return NFT_FAILURE;
+        }
+
+        if(signalfd(e->signals.fd, &e->mask, 0) < 0)
+        {
+                NFT_LOG_PERROR("signalfd()");
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** get unused source */
+static struct Source *_new_source(Events * e)
+{
+        if(e->sourcecount >= EVENTS_MAX_SOURCES)
+        {
+                NFT_LOG(L_ERROR, "Too many event sources");
+                return NULL;
+        }
+
+        return &e->sources[e->sourcecount];
+}
+
+
+/**
+ * call a function periodically
+ *
+ * @param e event loop
+ * @param seconds interval
+ * @param cb function to call
+ * @param arg argument to cb
+ */
+NftResult events_every(Events * e, double seconds, EventCallback cb,
+                       void *arg)
+{
+        if(!e || seconds <= 0 || !cb)
+                return NFT_FAILURE;
+
+        struct Source *s;
+        if(!(s = _new_source(e)))
+                return NFT_FAILURE;
+
+        if((s->fd = timerfd_create(CLOCK_MONOTONIC,
+                                   TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+        {
+                NFT_LOG_PERROR("timerfd_create()");
+                return NFT_FAILURE;
+        }
+        s->type = SOURCE_TIMER;
+        s->cb = cb;
+        s->arg = arg;
+
+        struct itimerspec t;
+        t.it_interval.tv_sec = (time_t) seconds;
+        t.it_interval.tv_nsec =
+                (long) ((seconds - (double) t.it_interval.tv_sec) *
+                        1000000000.0);
+        t.it_value = t.it_interval;
+        if(timerfd_settime(s->fd, 0, &t, NULL) < 0 || !_add(e, s))
+        {
+                NFT_LOG_PERROR("timerfd_settime()");
+                close(s->fd);
+                return NFT_FAILURE;
+        }
+
+        e->sourcecount++;
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * call a function whenever a descriptor becomes readable (e.g. control
+ * or network input)
+ *
+ * @param e event loop
+ * @param fd descriptor (must stay open as long as the event loop exists)
+ * @param cb function to call
+ * @param arg argument to cb
+ */
+NftResult events_watch(Events * e, int fd, EventCallback cb, void *arg)
+{
+        if(!e || fd < 0 || !cb)
+                return NFT_FAILURE;
+
+        struct Source *s;
+        if(!(s = _new_source(e)))
+                return NFT_FAILURE;
+
+        s->fd = fd;
+        s->type = SOURCE_FD;
+        s->cb = cb;
+        s->arg = arg;
+        if(!_add(e, s))
+                return NFT_FAILURE;
+
+        e->sourcecount++;
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * handle events until an absolute point in time (CLOCK_MONOTONIC)
+ *
+ * @param e event loop
+ * @param t deadline
+ * @result NFT_SUCCESS when deadline is reached (or running became false)
+ */
+NftResult events_wait_until(Events * e, const struct timespec *t)
+{
+        if(!e || !t)
+                return NFT_FAILURE;
+
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value = *t;
+
+        /* a zero value would disarm the timer */
+        if(its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1;
+
+        if(timerfd_settime(e->deadline.fd, TFD_TIMER_ABSTIME, &its, NULL) <
+           0)
+        {
+                NFT_LOG_PERROR("timerfd_settime()");
+                return NFT_FAILURE;
+        }
+
+        e->expired = false;
+        while(!e->expired && *e->running)
+        {
+                if(!_dispatch(e, -1))
+                        return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * handle events until a descriptor becomes readable
+ *
+ * @param e event loop
+ * @param fd descriptor (regular files are always readable)
+ * @param timeout maximum time to wait in seconds (<= 0 = forever)
+ * @result NFT_SUCCESS when fd is readable, timeout elapsed or running
+ *         became false
+ */
+NftResult events_wait_fd(Events * e, int fd, double timeout)
+{
+        if(!e)
+                return NFT_FAILURE;
+
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        end.tv_sec += (time_t) timeout;
+        end.tv_nsec += (long) ((timeout - (double) (time_t) timeout) *
+                               1000000000.0);
+        if(end.tv_nsec >= 1000000000)
+        {
+                end.tv_sec++;
+                end.tv_nsec -= 1000000000;
+        }
+
+        /* wait for fd or any event of the loop (the epoll descriptor is
+         * readable while events are pending) */
+        struct pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = e->epoll;
+        fds[1].events = POLLIN;
+
+        while(*e->running)
+        {
+                int ms = -1;
+                if(timeout > 0)
+                {
+                        struct timespec now;
+                        clock_gettime(CLOCK_MONOTONIC, &now);
+                        long long left =
+                                (long long) (end.tv_sec - now.tv_sec) * 1000 +
+                                (end.tv_nsec - now.tv_nsec) / 1000000;
+                        if(left <= 0)
+                                break;
+                        ms = (int) left;
+                }
+
+                if(poll(fds, 2, ms) < 0)
+                {
+                        if(errno == EINTR)
+                                continue;
+                        NFT_LOG_PERROR("poll()");
+                        return NFT_FAILURE;
+                }
+
+                if(fds[1].revents & POLLIN && !_dispatch(e, 0))
+                        return NFT_FAILURE;
+
+                /* readable, hung up or error (read() will tell) */
+                if(fds[0].revents)
+                        break;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * free event loop (signals stay blocked)
+ */
+void events_destroy(Events * e)
+{
+        if(!e)
+                return;
+
+        unsigned int i;
+        for(i = 0; i < e->sourcecount; i++)
+        {
+                if(e->sources[i].type == SOURCE_TIMER)
+                        close(e->sources[i].fd);
+        }
+
+        if(e->deadline.fd >= 0)
+                close(e->deadline.fd);
+        if(e->signals.fd >= 0)
+                close(e->signals.fd);
+        if(e->epoll >= 0)
+                close(e->epoll);
+
+        free(e);
+}
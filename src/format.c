@@ -0,0 +1,120 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <ctype.h>
+#include <niftyled.h>
+#include "format.h"
+
+
+
+/** 
+ * size of one pixel component in bytes
+ *
+ * @param f pixelformat
+ * @result size in bytes or 0 if components differ in type
+ */
+size_t format_component_size(LedPixelFormat * f)
+{
+        size_t n = led_pixel_format_get_n_components(f);
+        if(n == 0)
+                return 0;
+
+        size_t bpp = led_pixel_format_get_bytes_per_pixel(f);
+
+        /* all components must be of the same type */
+        const char *type = led_pixel_format_get_component_type(f, 0);
+        unsigned int i;
+        for(i = 1; i < n; i++)
+        {
+                if(strcmp(type, led_pixel_format_get_component_type(f, i)) !=
+                   0)
+                        return 0;
+        }
+
+        if(bpp % n != 0)
+                return 0;
+
+        return bpp / n;
+}
+
+
+/**
+ * check if format consists of unsigned integer components only
+ *
+ * @param f pixelformat
+ * @result true if all components are of type u8, u16, u32...
+ */
+bool format_is_unsigned(LedPixelFormat * f)
+{
+        if(format_component_size(f) == 0)
+                return false;
+
+        return led_pixel_format_get_component_type(f, 0)[0] == 'u';
+}
+
+
+/**
+ * get name of a component as used in the colorspace string
+ *
+ * @param f pixelformat
+ * @param component index of component
+ * @result 'R', 'G', 'B', 'A', 'Y'... or '\0' if unknown
+ */
+char format_component_name(LedPixelFormat * f, unsigned int component)
+{
+        const char *colorspace = led_pixel_format_colorspace_to_string(f);
+        if(!colorspace)
+                return '\0';
+
+        /* skip non-letters (e.g. "R'G'B'") */
+        for(; *colorspace; colorspace++)
+        {
+                if(!isalpha((unsigned char) *colorspace))
+                        continue;
+
+                if(component-- == 0)
+                        return toupper((unsigned char) *colorspace);
+        }
+
+        return '\0';
+}
@@ -0,0 +1,604 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <niftyled.h>
+#include "gif.h"
+
+
+/** maximum LZW code width */
+#define GIF_CODE_BITS 12
+/** maximum amount of LZW codes */
+#define GIF_CODES (1 << GIF_CODE_BITS)
+
+
+/** GIF stream descriptor */
+struct _Gif
+{
+        /** stream to read from (not owned) */
+        FILE *file;
+        /** logical screen dimensions */
+        LedFrameCord width, height;
+        /** composited RGBA canvas (the frame shown) */
+        uint8_t *canvas;
+        /** copy of canvas for "restore to previous" disposal */
+        uint8_t *saved;
+        /** color indices of current image */
+        uint8_t *indices;
+        /** size of indices buffer */
+        size_t indices_size;
+        /** global color table (RGB) */
+        uint8_t global[256 * 3];
+        /** entries in global color table (0 = none) */
+        int global_size;
+        /** disposal method of previous image */
+        int disposal;
+        /** area of previous image */
+        int left, top, w, h;
+        /** bytes left in current data sub-block */
+        int block_left;
+        /** true when the terminating sub-block was read */
+        bool block_end;
+        /** LZW dictionary */
+        uint16_t prefix[GIF_CODES];
+        uint8_t suffix[GIF_CODES];
+        uint8_t stack[GIF_CODES + 1];
+};
+
+
+
+/** read little-endian 16 bit value */
+static int _read16(FILE * f)
+{
+        int lo = fgetc(f);
+        int hi = fgetc(f);
+        if(lo == EOF || hi == EOF)
+                return -1;
+
+        return lo | (hi << 8);
+}
+
+
+/** skip data sub-blocks up to (and including) the terminator */
+static NftResult _skip_blocks(FILE * f)
+{
+        int len;
+        while((len = fgetc(f)) > 0)
+        {
+                if(fseek(f, len, SEEK_CUR) != 0)
+                        return NFT_FAILURE;
+        }
+
+        return len == 0 ? NFT_SUCCESS : NFT_FAILURE;
+}
+
+
+/** next byte of image data (-1 at end of data) */
+static int _next_byte(Gif * g)
+{
+        if(g->block_end)
+                return -1;
+
+        if(g->block_left == 0)
+        {
+                int len = fgetc(g->file);
+                if(len <= 0)
+                {
+                        g->block_end = true;
+                        return -1;
+                }
+                g->block_left = len;
+        }
+
+        g->block_left--;
+        return fgetc(g->file);
+}
+
+
+/** decode LZW compressed image data to color indices */
+static NftResult _lzw_decode(Gif * g, size_t pixels)
+{
+        int min = fgetc(g->file);
+        if(min < 1 || min > 11)
+        {
+                NFT_LOG(L_ERROR, "Invalid LZW code size %d", min);
+                return NFT_FAILURE;
+        }
+
+        int clear = 1 << min;
+        int eoi = clear + 1;
+        int size = min + 1;
+        int next = clear + 2;
+        int old = -1;
+        int first = 0;
+
+        int i;
+        for(i = 0; i < clear; i++)
+        {
+                g->prefix[i] = 0;
+                g->suffix[i] = (uint8_t) i;
+        }
+
+        g->block_left = 0;
+        g->block_end = false;
+
+        uint32_t bits = 0;
+        int nbits = 0;
+        size_t pos = 0;
+
+        while(true)
+        {
+                /* fetch next code */
+                while(nbits < size)
+                {
+                        int b = _next_byte(g);
+                        if(b < 0)
+                                goto _ld_end;
+                        bits |= (uint32_t) b << nbits;
+                        nbits += 8;
+                }
+                int code = bits & ((1 << size) - 1);
+                bits >>= size;
+                nbits -= size;
+
+                if(code == clear)
+                {
+                        size = min + 1;
+                        next = clear + 2;
+                        old = -1;
+                        continue;
+                }
+
+                if(code == eoi)
+                        break;
+
+                /* first code after clear */
+                if(old < 0)
+                {
+                        if(code > clear)
+                                goto _ld_end;
+                        if(pos < pixels)
+                                g->indices[pos++] = (uint8_t) code;
+                        old = first = code;
+                        continue;
+                }
+
+                /* unwind string of code */
+                int in = code;
+                int sp = 0;
+                if(code >= next)
+                {
+                        /* code not in table yet (KwKwK) */
+                        if(code > next)
+                                goto _ld_end;
+                        g->stack[sp++] = (uint8_t) first;
+                        code = old;
+                }
+                while(code > eoi)
+                {
+                        g->stack[sp++] = g->suffix[code];
+                        code = g->prefix[code];
+                }
+                first = code;
+                g->stack[sp++] = (uint8_t) first;
+
+                /* add new string to table */
+                if(next < GIF_CODES)
+                {
+                        g->prefix[next] = (uint16_t) old;
+                        g->suffix[next] = (uint8_t) first;
+                        next++;
+                        if(next == (1 << size) && size < GIF_CODE_BITS)
+                                size++;
+                }
+                old = in;
+
+                while(sp > 0 && pos < pixels)
+                        g->indices[pos++] = g->stack[--sp];
+        }
+
+_ld_end:
+        /* pixels missing in truncated data use color 0 */
+        if(pos < pixels)
+                memset(g->indices + pos, 0, pixels - pos);
+
+        /* skip rest of data */
+        if(!g->block_end)
+        {
+                if(g->block_left && fseek(g->file, g->block_left, SEEK_CUR) != 0)
+                        return NFT_FAILURE;
+                return _skip_blocks(g->file);
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** row of canvas an interlaced image row is drawn to */
+static int _interlaced_row(int row, int h)
+{
+        /* pass 1: every 8th row from 0 */
+        int n = (h + 7) / 8;
+        if(row < n)
+                return row * 8;
+        row -= n;
+
+        /* pass 2: every 8th row from 4 */
+        n = (h + 3) / 8;
+        if(row < n)
+                return row * 8 + 4;
+        row -= n;
+
+        /* pass 3: every 4th row from 2 */
+        n = (h + 1) / 4;
+        if(row < n)
+                return row * 4 + 2;
+        row -= n;
+
+        /* pass 4: every 2nd row from 1 */
+        return row * 2 + 1;
+}
+
+
+/** clear area of canvas to transparent */
+static void _clear_area(Gif * g, int left, int top, int w, int h)
+{
+        int y;
+        for(y = top; y < top + h && y < g->height; y++)
+        {
+                if(y < 0 || left >= g->width)
+                        continue;
+                int x0 = left < 0 ? 0 : left;
+                int x1 = left + w > g->width ? g->width : left + w;
+                if(x1 > x0)
+                        memset(g->canvas + ((size_t) y * g->width + x0) * 4,
+                               0, (size_t) (x1 - x0) * 4);
+        }
+}
+
+
+
+/**
+ * check if stream holds a GIF (stream position is restored)
+ *
+ * @param f stream to check
+ * @result true if f is a seekable stream starting with a GIF header
+ */
+bool gif_probe(FILE * f)
+{
+        long pos;
+        if(!f || (pos = ftell(f)) < 0)
+                return false;
+
+        char magic[6];
+        size_t n = fread(magic, 1, sizeof(magic), f);
+
+        if(fseek(f, pos, SEEK_SET) != 0)
+                return false;
+
+        return n == sizeof(magic) &&
+                (memcmp(magic, "GIF87a", 6) == 0 ||
+                 memcmp(magic, "GIF89a", 6) == 0);
+}
+
+
+/**
+ * start decoding GIF from stream
+ *
+ * Only the composited canvas of the current frame and the color indices
+ * of one image are kept in memory, regardless of the amount of frames.
+ *
+ * @param f stream positioned at GIF header (stays owned by caller)
+ * @result decoder or NULL upon error
+ */
+Gif *gif_open(FILE * f)
+{
+        uint8_t header[13];
+        if(fread(header, 1, sizeof(header), f) != sizeof(header) ||
+           (memcmp(header, "GIF87a", 6) != 0 &&
+            memcmp(header, "GIF89a", 6) != 0))
+        {
+                NFT_LOG(L_ERROR, "Not a GIF stream");
+                return NULL;
+        }
+
+        Gif *g;
+        if(!(g = calloc(1, sizeof(Gif))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        g->file = f;
+        g->width = header[6] | (header[7] << 8);
+        g->height = header[8] | (header[9] << 8);
+        if(g->width <= 0 || g->height <= 0)
+        {
+                NFT_LOG(L_ERROR, "Invalid GIF dimensions %dx%d",
+                        g->width, g->height);
+                goto _go_error;
+        }
+
+        /* global color table */
+        if(header[10] & 0x80)
+        {
+                g->global_size = 2 << (header[10] & 0x07);
+                if(fread(g->global, 3, g->global_size, f) !=
+                   (size_t) g->global_size)
+                        goto _go_error;
+        }
+
+        /* canvas starts out transparent */
+        if(!(g->canvas = calloc((size_t) g->width * g->height, 4)))
+        {
+                NFT_LOG_PERROR("calloc()");
+                goto _go_error;
+        }
+
+        return g;
+
+_go_error:
+        gif_close(g);
+        return NULL;
+}
+
+
+/**
+ * decode next frame onto canvas
+ *
+ * @param g decoder
+ * @param delay time to show frame in seconds (0 = none given)
+ * @result NFT_SUCCESS or NFT_FAILURE at end of stream or upon error
+ */
+NftResult gif_read_frame(Gif * g, double *delay)
+{
+        if(!g)
+                return NFT_FAILURE;
+
+        /* settings of graphic control extension */
+        int disposal = 0;
+        int transparent = -1;
+        *delay = 0;
+
+        int type;
+        while((type = fgetc(g->file)) != EOF)
+        {
+                switch (type)
+                {
+                        /* extension */
+                        case 0x21:
+                        {
+                                int label = fgetc(g->file);
+                                if(label == 0xf9)
+                                {
+                                        uint8_t gce[6];
+                                        if(fread(gce, 1, sizeof(gce), g->file)
+                                           != sizeof(gce) || gce[0] != 4)
+                                                return NFT_FAILURE;
+                                        disposal = (gce[1] >> 2) & 0x07;
+                                        if(gce[1] & 0x01)
+                                                transparent = gce[4];
+                                        *delay = (gce[2] | (gce[3] << 8)) /
+                                                100.0;
+                                        /* terminator */
+                                        if(gce[5] != 0)
+                                                return NFT_FAILURE;
+                                }
+                                else if(!_skip_blocks(g->file))
+                                        return NFT_FAILURE;
+                                break;
+                        }
+
+                        /* image */
+                        case 0x2c:
+                        {
+                                int left = _read16(g->file);
+                                int top = _read16(g->file);
+                                int w = _read16(g->file);
+                                int h = _read16(g->file);
+                                int flags = fgetc(g->file);
+                                if(left < 0 || top < 0 || w < 0 || h < 0 ||
+                                   flags == EOF)
+                                        return NFT_FAILURE;
+
+                                /* color table of this image */
+                                uint8_t local[256 * 3];
+                                const uint8_t *colors = g->global;
+                                int colors_size = g->global_size;
+                                if(flags & 0x80)
+                                {
+                                        colors_size = 2 << (flags & 0x07);
+                                        if(fread(local, 3, colors_size,
+                                                 g->file) !=
+                                           (size_t) colors_size)
+                                                return NFT_FAILURE;
+                                        colors = local;
+                                }
+
+                                /* decode color indices */
+                                size_t pixels = (size_t) w * h;
+                                if(pixels > g->indices_size)
+                                {
+                                        uint8_t *tmp;
+                                        if(!(tmp = realloc(g->indices,
+                                                           pixels)))
+                                        {
+                                                NFT_LOG_PERROR("realloc()");
+                                                return NFT_FAILURE;
+                                        }
+                                        g->indices = tmp;
+                                        g->indices_size = pixels;
+                                }
+                                if(!_lzw_decode(g, pixels))
+                                        return NFT_FAILURE;
+
+                                /* dispose previous image */
+                                if(g->disposal == 2)
+                                        _clear_area(g, g->left, g->top,
+                                                    g->w, g->h);
+                                else if(g->disposal == 3 && g->saved)
+                                        memcpy(g->canvas, g->saved,
+                                               (size_t) g->width *
+                                               g->height * 4);
+
+                                /* remember canvas to restore it later */
+                                if(disposal == 3)
+                                {
+                                        size_t size = (size_t) g->width *
+                                                g->height * 4;
+                                        if(!g->saved &&
+                                           !(g->saved = malloc(size)))
+                                        {
+                                                NFT_LOG_PERROR("malloc()");
+                                                return NFT_FAILURE;
+                                        }
+                                        memcpy(g->saved, g->canvas, size);
+                                }
+
+                                /* draw image onto canvas */
+                                int row;
+                                for(row = 0; row < h; row++)
+                                {
+                                        int y = top + ((flags & 0x40) ?
+                                                       _interlaced_row(row, h)
+                                                       : row);
+                                        if(y >= g->height)
+                                                continue;
+
+                                        const uint8_t *src =
+                                                g->indices + (size_t) row * w;
+                                        uint8_t *dst = g->canvas +
+                                                ((size_t) y * g->width +
+                                                 left) * 4;
+                                        int x;
+                                        for(x = 0; x < w &&
+                                            left + x < g->width; x++)
+                                        {
+                                                int i = src[x];
+                                                if(i == transparent)
+                                                        continue;
+                                                if(i < colors_size)
+                                                {
+                                                        dst[x * 4 + 0] =
+                                                                colors[i * 3 + 0];
+                                                        dst[x * 4 + 1] =
+                                                                colors[i * 3 + 1];
+                                                        dst[x * 4 + 2] =
+                                                                colors[i * 3 + 2];
+                                                }
+                                                else
+                                                {
+                                                        memset(dst + x * 4, 0,
+                                                               3);
+                                                }
+                                                dst[x * 4 + 3] = 0xff;
+                                        }
+                                }
+
+                                g->disposal = disposal;
+                                g->left = left;
+                                g->top = top;
+                                g->w = w;
+                                g->h = h;
+
+                                return NFT_SUCCESS;
+                        }
+
+                        /* trailer */
+                        case 0x3b:
+                        {
+                                return NFT_FAILURE;
+                        }
+
+                        default:
+                        {
+                                NFT_LOG(L_ERROR,
+                                        "Invalid GIF block 0x%02x", type);
+                                return NFT_FAILURE;
+                        }
+                }
+        }
+
+        return NFT_FAILURE;
+}
+
+
+/**
+ * get dimensions of canvas
+ */
+void gif_get_dim(Gif * g, LedFrameCord * width, LedFrameCord * height)
+{
+        *width = g->width;
+        *height = g->height;
+}
+
+
+/**
+ * get composited RGBA canvas of current frame
+ */
+const void *gif_get_pixels(Gif * g)
+{
+        return g->canvas;
+}
+
+
+/**
+ * free decoder (stream is left open)
+ */
+void gif_close(Gif * g)
+{
+        if(!g)
+                return;
+
+        free(g->indices);
+        free(g->saved);
+        free(g->canvas);
+        free(g);
+}
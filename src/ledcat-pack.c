@@ -0,0 +1,528 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if HAVE_IMAGEMAGICK == 1
+#include <MagickWand/MagickWand.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <niftyled.h>
+#include "scale.h"
+#include "canvas.h"
+#if HAVE_IMAGEMAGICK == 1
+#include "gif.h"
+#endif
+#include "ledcat.h"
+#include "version.h"
+#include "events.h"
+#include "raw.h"
+#include "magick.h"
+#include "format.h"
+#include "pack.h"
+
+
+
+
+/** main structure to hold global info */
+static struct Ledcat _c;
+/** name of archive to write */
+static char _output[1024];
+
+
+/******************************************************************************/
+/**************************** STATIC FUNCTIONS ********************************/
+/******************************************************************************/
+
+/** signal handler for exiting */
+static void _exit_signal_handler(int signal)
+{
+        NFT_LOG(L_INFO, "Exiting...");
+        _c.running = false;
+}
+
+
+/** print commandline help */
+static void _print_help(char *name)
+{
+        printf("Pre-decode images to a ledcat archive - %s\n"
+               "Usage: %s [options] -o <archive> <file(s)>\n\n"
+               "Choose \"-\" as <file> to read from stdin\n\n"
+               "Valid options:\n"
+               "\t--help\t\t\t-h\t\tThis help text\n"
+               "\t--output <file>\t\t-o <file>\tArchive to write\n"
+               "\t--config <file>\t\t-c <file>\tTake frame dimensions from this prefs file [~/.ledcat.xml]\n"
+               "\t--dimensions <w>x<h>\t-d <w>x<h>\tDefine width and height of frames (no prefs file needed). [auto]\n"
+               "\t--scale <filter>\t-s <filter>\tScale input frames to setup dimensions (\"box\" or \"bilinear\"). --dimensions then defines size of raw input [off]\n"
+               "\t--big-endian\t\t-b\t\tRAW data is big-endian ordered [off]\n"
+#if HAVE_IMAGEMAGICK == 1
+               "\t--raw\t\t\t-r\t\tTreat input files as raw-files (false)\n"
+#endif
+               "\t--format <format>\t-f <format>\tPixelformat of archive (and raw input) [RGB u8]\n"
+               "\t--loglevel <level>\t-l <level>\tOnly show messages with loglevel <level> (info)\n\n",
+               PACKAGE_URL, name);
+
+        /* print loglevels */
+        printf("\nValid loglevels:\n\t");
+        nft_log_print_loglevels();
+        printf("\n\n");
+}
+
+
+/** parse commandline arguments */
+static NftResult _parse_args(int argc, char *argv[])
+{
+        int index, argument;
+
+        static struct option loptions[] = {
+                {"help", 0, 0, 'h'},
+                {"output", required_argument, 0, 'o'},
+                {"loglevel", required_argument, 0, 'l'},
+                {"config", required_argument, 0, 'c'},
+                {"dimensions", required_argument, 0, 'd'},
+                {"scale", required_argument, 0, 's'},
+                {"format", required_argument, 0, 'f'},
+                {"big-endian", no_argument, 0, 'b'},
+#if HAVE_IMAGEMAGICK == 1
+                {"raw", no_argument, 0, 'r'},
+#endif
+                {0, 0, 0, 0}
+        };
+
+#if HAVE_IMAGEMAGICK == 1
+        const char arglist[] = "ho:l:c:d:s:f:br";
+#else
+        const char arglist[] = "ho:l:c:d:s:f:b";
+#endif
+        while((argument =
+               getopt_long(argc, argv, arglist, loptions, &index)) >= 0)
+        {
+
+                switch (argument)
+                {
+                                /** --help */
+                        case 'h':
+                        {
+                                _print_help(argv[0]);
+                                return NFT_FAILURE;
+                        }
+
+                                /** --output */
+                        case 'o':
+                        {
+                                strncpy(_output, optarg, sizeof(_output) - 1);
+                                break;
+                        }
+
+                                /** --config */
+                        case 'c':
+                        {
+                                strncpy(_c.prefsfile, optarg,
+                                        sizeof(_c.prefsfile) - 1);
+                                _c.prefsfile[sizeof(_c.prefsfile) - 1] = '\0';
+                                break;
+                        }
+
+                                /** --dimensions */
+                        case 'd':
+                        {
+                                if(sscanf
+                                   (optarg, "%32dx%32d", (int *) &_c.width,
+                                    (int *) &_c.height) != 2)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid dimension \"%s\" (Use something like 320x400)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                                /** --scale */
+                        case 's':
+                        {
+                                if(!scale_mode_from_string(optarg, &_c.scale))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid scaling filter \"%s\" (Use \"box\" or \"bilinear\")",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                                /** --loglevel */
+                        case 'l':
+                        {
+                                if(!nft_log_level_set
+                                   (nft_log_level_from_string(optarg)))
+                                {
+                                        printf("\nValid loglevels:\n\t");
+                                        nft_log_print_loglevels();
+                                        printf("\n\n");
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                                /** --format */
+                        case 'f':
+                        {
+                                strncpy(_c.pixelformat, optarg,
+                                        sizeof(_c.pixelformat) - 1);
+                                _c.pixelformat[sizeof(_c.pixelformat) - 1] =
+                                        '\0';
+                                break;
+                        }
+
+                                /** --big-endian */
+                        case 'b':
+                        {
+                                _c.is_big_endian = true;
+                                break;
+                        }
+
+#if HAVE_IMAGEMAGICK == 1
+                                /** --raw */
+                        case 'r':
+                        {
+                                _c.raw = true;
+                                break;
+                        }
+#endif
+
+                                /* invalid argument */
+                        case '?':
+                        {
+                                NFT_LOG(L_ERROR, "argument %d is invalid",
+                                        index);
+                                _print_help(argv[0]);
+                                return NFT_FAILURE;
+                        }
+
+                                /* unhandled arguments */
+                        default:
+                        {
+                                NFT_LOG(L_ERROR, "argument %d is invalid",
+                                        index);
+                                break;
+                        }
+                }
+        }
+
+        _c.files = &argv[optind];
+        _c.filecount = argc - optind;
+        return NFT_SUCCESS;
+}
+
+
+/** get frame dimensions from prefs file */
+static NftResult _setup_dim(LedFrameCord * width, LedFrameCord * height)
+{
+        LedPrefs *p;
+        if(!(p = led_prefs_init()))
+                return NFT_FAILURE;
+
+        NftResult r = NFT_FAILURE;
+        LedPrefsNode *pnode;
+        if(!(pnode = led_prefs_node_from_file(p, _c.prefsfile)))
+        {
+                NFT_LOG(L_ERROR, "Failed to open configfile \"%s\"",
+                        _c.prefsfile);
+                goto _sd_exit;
+        }
+
+        LedSetup *s = led_prefs_setup_from_node(p, pnode);
+        led_prefs_node_free(pnode);
+        if(!s)
+        {
+                NFT_LOG(L_ERROR, "No valid setup found in preferences file.");
+                goto _sd_exit;
+        }
+
+        r = led_setup_get_dim(s, width, height);
+        led_setup_destroy(s);
+
+_sd_exit:
+        led_prefs_deinit(p);
+        return r;
+}
+
+
+/** pack all frames of one file */
+static NftResult _pack_file(PackWriter * w, LedPixelFormat * format,
+                            LedFrameCord width, LedFrameCord height,
+                            char *buf, size_t swap_size, const char *file)
+{
+        /* open file */
+        if(strcmp(file, "-") == 0)
+        {
+                _c.fd = STDIN_FILENO;
+        }
+        else if((_c.fd = open(file, O_RDONLY)) < 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to open \"%s\": %s", file,
+                        strerror(errno));
+                return NFT_FAILURE;
+        }
+
+        size_t before = pack_writer_get_frame_count(w);
+        NftResult r = NFT_SUCCESS;
+
+#if HAVE_IMAGEMAGICK == 1
+        if(!_c.raw)
+        {
+                if(!im_open_stream(&_c))
+                {
+                        close(_c.fd);
+                        return NFT_FAILURE;
+                }
+
+                /* every frame of the file with its delay */
+                while(_c.running && im_read_frame(&_c, width, height, buf))
+                {
+                        if(!(r = pack_writer_add(w, buf, _c.delay)))
+                                break;
+                }
+
+                im_close_stream(&_c);
+        }
+        else
+#endif
+        {
+                /* size of raw input frames */
+                LedFrameCord iw = width, ih = height;
+                if(_c.scaler)
+                {
+                        iw = _c.width;
+                        ih = _c.height;
+                }
+                size_t size = led_pixel_format_get_buffer_size(format,
+                                                               iw * ih);
+
+                RawReader *reader;
+                if(!(reader = raw_reader_new(format_component_size(format))))
+                        r = NFT_FAILURE;
+
+                char *in;
+                while(r && _c.running &&
+                      (in = raw_reader_frame(reader, NULL, &_c.running,
+                                             _c.fd, size)))
+                {
+                        if(swap_size > 1)
+                                raw_swap_frame(in, size, swap_size);
+
+                        if(_c.scaler &&
+                           !scaler_run(_c.scaler, in, iw, ih, buf))
+                                r = NFT_FAILURE;
+                        else
+                                r = pack_writer_add(w, _c.scaler ? buf : in,
+                                                    0);
+                }
+
+                raw_reader_destroy(reader);
+                if(_c.fd != STDIN_FILENO)
+                        close(_c.fd);
+        }
+
+        NFT_LOG(L_INFO, "\"%s\": %zu frames", file,
+                pack_writer_get_frame_count(w) - before);
+
+        return r;
+}
+
+
+/******************************************************************************/
+/******************************************************************************/
+/******************************************************************************/
+
+int main(int argc, char *argv[])
+{
+        /* check libniftyled binary version compatibility */
+        if(!LED_CHECK_VERSION)
+                return EXIT_FAILURE;
+
+        /* set default loglevel to INFO */
+        if(!nft_log_level_set(L_INFO))
+        {
+                fprintf(stderr, "nft_log_level_set() error");
+                return EXIT_FAILURE;
+        }
+
+        /* stop packing (archive of frames so far is still written) */
+        signal(SIGINT, _exit_signal_handler);
+        signal(SIGTERM, _exit_signal_handler);
+
+        /* defaults */
+        _c.running = true;
+        strncpy(_c.pixelformat, "RGB u8", sizeof(_c.pixelformat) - 1);
+        _c.pixelformat[sizeof(_c.pixelformat) - 1] = '\0';
+        if(!led_prefs_default_filename
+           (_c.prefsfile, sizeof(_c.prefsfile), ".ledcat.xml"))
+                return EXIT_FAILURE;
+
+        /* parse commandline arguments */
+        if(!_parse_args(argc, argv))
+                return EXIT_FAILURE;
+
+        NFT_LOG(L_INFO, "%s-pack %s (c) D.Hiepler 2006-2014", PACKAGE_NAME,
+                ledcat_version_long());
+
+        if(!_output[0])
+        {
+                NFT_LOG(L_ERROR, "No archive given (use --output)");
+                return EXIT_FAILURE;
+        }
+
+        if(_c.filecount == 0)
+        {
+                NFT_LOG(L_ERROR, "No input file(s) given");
+                return EXIT_FAILURE;
+        }
+
+#if HAVE_IMAGEMAGICK == 1
+        /* initialize imagemagick */
+        if(!_c.raw && !im_init(&_c))
+        {
+                NFT_LOG(L_ERROR, "Failed to initialize ImageMagick");
+                return EXIT_FAILURE;
+        }
+#endif
+
+        int res = EXIT_FAILURE;
+        LedPixelFormat *format = NULL;
+        char *buf = NULL;
+        PackWriter *w = NULL;
+
+        /* frame dimensions (when scaling, --dimensions is the size of raw
+         * input and the setup defines the size of frames) */
+        LedFrameCord width = _c.width, height = _c.height;
+        if(_c.scale != SCALE_NONE || !width || !height)
+        {
+                if(!_setup_dim(&width, &height))
+                        goto m_deinit;
+        }
+        if(width <= 0 || height <= 0)
+        {
+                NFT_LOG(L_ERROR, "Invalid dimensions %dx%d", width, height);
+                goto m_deinit;
+        }
+
+        if(!(format = led_pixel_format_from_string(_c.pixelformat)))
+        {
+                NFT_LOG(L_ERROR, "Invalid pixelformat \"%s\"",
+                        _c.pixelformat);
+                goto m_deinit;
+        }
+
+        size_t size = led_pixel_format_get_buffer_size(format,
+                                                       width * height);
+        if(!(buf = malloc(size)))
+        {
+                NFT_LOG_PERROR("malloc()");
+                goto m_deinit;
+        }
+
+        if(_c.scale != SCALE_NONE &&
+           !(_c.scaler = scaler_new(_c.scale, format, width, height)))
+                goto m_deinit;
+
+#if HAVE_IMAGEMAGICK == 1
+        if(!_c.raw && !im_format(&_c, format))
+        {
+                NFT_LOG(L_ERROR,
+                        "Failed to determine valid ImageMagick format");
+                goto m_deinit;
+        }
+#endif
+
+        /* raw input is converted to native byte order */
+        size_t swap_size = 0;
+        if(!raw_is_native_endian(_c.is_big_endian))
+                swap_size = format_component_size(format);
+
+        /* frames are stored in native byte order */
+        if(!(w = pack_writer_new(_output, width, height,
+                                 led_pixel_format_to_string(format),
+                                 !raw_is_native_endian(false), size)))
+                goto m_deinit;
+
+        NFT_LOG(L_INFO, "Packing %dx%d frames (%s) to \"%s\"",
+                width, height, led_pixel_format_to_string(format), _output);
+
+        size_t i;
+        for(i = 0; i < _c.filecount && _c.running; i++)
+        {
+                if(!_pack_file(w, format, width, height, buf, swap_size,
+                               _c.files[i]))
+                        NFT_LOG(L_WARNING, "Skipped rest of \"%s\"",
+                                _c.files[i]);
+        }
+
+        size_t frames = pack_writer_get_frame_count(w);
+        if(!pack_writer_close(w))
+                goto m_deinit;
+
+        NFT_LOG(L_INFO, "Packed %zu frames", frames);
+        res = EXIT_SUCCESS;
+
+m_deinit:
+        scaler_destroy(_c.scaler);
+        free(buf);
+        led_pixel_format_destroy(format);
+
+#if HAVE_IMAGEMAGICK == 1
+        im_deinit(&_c);
+#endif
+
+        return res;
+}
@@ -49,19 +49,48 @@
 #include <MagickWand/MagickWand.h>
 #endif
 
+#include <stdint.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
+#include <errno.h>
 #include <signal.h>
 #include <getopt.h>
 #include <niftyled.h>
+#include "scale.h"
+#include "canvas.h"
+#if HAVE_IMAGEMAGICK == 1
+#include "gif.h"
+#endif
 #include "ledcat.h"
 #include "cache.h"
 #include "version.h"
+#include "events.h"
 #include "raw.h"
 #include "magick.h"
+#include "playlist.h"
+#include "daemon.h"
+#include "reload.h"
+#include "output.h"
+#include "region.h"
+#include "sync.h"
+#if HAVE_IMAGEMAGICK == 1
+#include "prefetch.h"
+#endif
+#include "correction.h"
+#include "palette.h"
+#include "dirty.h"
+#include "delta.h"
+#include "format.h"
+#include "dither.h"
+#include "blend.h"
+#include "pack.h"
+#if HAVE_LIBAV == 1
+#include "video.h"
+#endif
 
 
 
@@ -69,45 +98,574 @@
 /** main structure to hold global info */
 static struct Ledcat _c;
 
+/** thread reloading prefs file (NULL if not watching it) */
+static Reload *_reload;
+
+/** event loop handling signals & timers while waiting */
+static Events *_events;
+
+/** additional setups fed from the same frame */
+static Output *_outputs[LEDCAT_MAX_OUTPUTS];
+
+/** part of full-size input frames we play (NULL = all) */
+static Region *_region;
+
+/** buffered reader of raw input */
+static RawReader *_reader;
+
+/** indexed input (NULL if input isn't indexed) */
+static Palette *_palette;
+
+/** delta input (NULL if frames are sent complete) */
+static Delta *_delta;
+
+/** chains changed by delta input (NULL if all are refilled every frame) */
+static Dirty *_dirty;
+
+/** group of instances we latch frames with (NULL = not syncing) */
+static Sync *_sync;
+
+/** state of playback reported to clients of daemon */
+static DaemonStats _playing;
+
 
 /******************************************************************************/
 /**************************** STATIC FUNCTIONS ********************************/
 /******************************************************************************/
 
-/** signal handler for exiting */
-void _exit_signal_handler(int signal)
+/** exit on signal */
+static void _exit_event(void *arg)
 {
         NFT_LOG(L_INFO, "Exiting...");
         _c.running = false;
 }
 
-#if ! WIN32
-/** signal handler that prints current fps */
-void _alarm_signal_handler(int signal)
+/** reload prefs file on SIGHUP (exit if not watching it) */
+static void _hangup_event(void *arg)
+{
+        if(!_c.reload)
+        {
+                _exit_event(arg);
+                return;
+        }
+
+        reload_trigger(_reload);
+        size_t i;
+        for(i = 0; i < _c.outputcount; i++)
+                output_reload(_outputs[i]);
+}
+
+/** print current fps periodically */
+static void _fps_event(void *arg)
+{
+        /* syscalls per raw frame read since last report */
+        static unsigned long long frames, syscalls;
+        unsigned long long f, n;
+        raw_reader_get_stats(_reader, &f, &n);
+
+        if(f > frames)
+                NFT_LOG(L_INFO, "FPS: %d (%.2f syscalls per raw frame)",
+                        led_fps_get(),
+                        (double) (n - syscalls) / (f - frames));
+        else
+                NFT_LOG(L_INFO, "FPS: %d", led_fps_get());
+
+        frames = f;
+        syscalls = n;
+
+        /* share of delta frames changed since last report */
+        if(_delta)
+        {
+                static unsigned long long applied, pixels, sent, chains;
+                unsigned long long a, p, s, c;
+                delta_get_stats(_delta, &a, &p);
+                dirty_get_stats(_dirty, &s, &c);
+
+                /* tracker was rebuilt for a reloaded setup */
+                if(s < sent)
+                        sent = chains = 0;
+
+                if(a > applied && s > sent)
+                        NFT_LOG(L_INFO,
+                                "Delta: %.1f pixels changed, %.2f chains refilled per frame",
+                                (double) (p - pixels) / (a - applied),
+                                (double) (c - chains) / (s - sent));
+
+                applied = a;
+                pixels = p;
+                sent = s;
+                chains = c;
+        }
+}
+
+
+/** answer clients of daemon waiting for stats (while playback waits) */
+static void _daemon_event(void *arg)
+{
+        Daemon *daemon = arg;
+
+        _playing.frames_sent = _c.frames_sent;
+        raw_reader_get_stats(_reader, &_playing.frames_read,
+                             &_playing.syscalls);
+        daemon_stats(daemon, &_playing);
+}
+
+
+/** add seconds to a timestamp */
+static void _timespec_add(struct timespec *t, double seconds)
+{
+        long long ns = t->tv_nsec + (long long) (seconds * 1000000000.0);
+        t->tv_sec += ns / 1000000000;
+        t->tv_nsec = ns % 1000000000;
+        if(t->tv_nsec < 0)
+        {
+                t->tv_sec--;
+                t->tv_nsec += 1000000000;
+        }
+}
+
+
+/** seconds from b to a */
+static double _timespec_diff(const struct timespec *a,
+                             const struct timespec *b)
+{
+        return (double) (a->tv_sec - b->tv_sec) +
+                (double) (a->tv_nsec - b->tv_nsec) / 1000000000.0;
+}
+
+
+/** resend & latch the frame shown on all setups */
+static void _refresh(LedHardware * hw)
+{
+        NFT_LOG(L_DEBUG, "Refreshing frame");
+        led_hardware_list_send(hw);
+        led_hardware_list_show(hw);
+
+        size_t i;
+        for(i = 0; i < _c.outputcount; i++)
+                output_refresh(_outputs[i]);
+}
+
+
+/** 
+ * resend the frame currently shown every keepalive interval until 
+ * deadline (hardware chains must still hold that frame) 
+ */
+static NftResult _keepalive(LedHardware * hw, const struct timespec *t)
+{
+        if(_c.keepalive <= 0)
+                return NFT_SUCCESS;
+
+        struct timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        while(_c.running)
+        {
+                _timespec_add(&next, (double) _c.keepalive / 1000);
+                if(_timespec_diff(t, &next) <= 0)
+                        break;
+
+                if(!events_wait_until(_events, &next))
+                        return NFT_FAILURE;
+
+                _refresh(hw);
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** 
+ * read next frame of current file (ImageMagick or raw) 
+ * and its delay in seconds (0 if it has none) 
+ */
+static NftResult _read_frame(LedFrame * frame, char *buf, size_t swap_size,
+                             double *delay)
+{
+        *delay = 0;
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+        {
+                _c.running = false;
+                return NFT_FAILURE;
+        }
+
+#if HAVE_IMAGEMAGICK == 1
+        /* use imagemagick to load file if we're not in "raw-mode" */
+        if(!_c.raw)
+        {
+                /* load full-size frame & play our region of it */
+                if(_region)
+                {
+                        char *in;
+                        if(!(in = region_get_buffer(_region)) ||
+                           !im_read_frame(&_c, _c.width, _c.height, in))
+                                return NFT_FAILURE;
+
+                        region_crop(_region, in, buf);
+                }
+                /* load frame to buffer using ImageMagick */
+                else if(!im_read_frame(&_c, w, h, buf))
+                        return NFT_FAILURE;
+
+                *delay = _c.delay;
+                return NFT_SUCCESS;
+        }
+#endif
+
+        /* input of scaler or canvas has its own size */
+        if(_c.scaler || _c.canvas)
+        {
+                if(_c.width)
+                        w = _c.width;
+                if(_c.height)
+                        h = _c.height;
+        }
+        size_t size = led_pixel_format_get_buffer_size
+                (led_frame_get_format(frame), w * h);
+
+        /* apply changed runs to current frame */
+        if(_delta)
+        {
+                if(delta_read_frame(_delta, _reader, _events, &_c.running,
+                                    _c.fd, buf, w * h, _dirty) < 0)
+                {
+                        _c.running = false;
+                        return NFT_FAILURE;
+                }
+                return NFT_SUCCESS;
+        }
+
+        /* read raw frame (many per syscall, only our region of full-size
+         * frames) */
+        char *in;
+        if(_palette)
+        {
+                uint8_t *index;
+                if(!(index = palette_read_frame(_palette, _reader, _events,
+                                                &_c.running, _c.fd, w * h)))
+                {
+                        _c.running = false;
+                        return NFT_FAILURE;
+                }
+
+                /* expand straight to frame or canvas (or scaler input) */
+                if(_c.scaler)
+                        in = scaler_get_buffer(_c.scaler, w, h);
+                else if(_c.canvas)
+                        in = canvas_get_buffer(_c.canvas, w, h);
+                else
+                        in = buf;
+                if(!in)
+                {
+                        _c.running = false;
+                        return NFT_FAILURE;
+                }
+                palette_expand(palette_get_table(_palette), index, w * h, in);
+
+                if(!_c.scaler)
+                        return NFT_SUCCESS;
+        }
+        else if(_region)
+        {
+                in = buf;
+                if(region_read_frame(_region, _reader, _events, &_c.running,
+                                     _c.fd, in) < 0)
+                {
+                        _c.running = false;
+                        return NFT_FAILURE;
+                }
+        }
+        else if(!(in = raw_reader_frame(_reader, _events, &_c.running,
+                                        _c.fd, size)))
+        {
+                _c.running = false;
+                return NFT_FAILURE;
+        }
+
+        /* convert to native byte order (palette entries already are) */
+        if(swap_size > 1 && !_palette)
+                raw_swap_frame(in, size, swap_size);
+
+        /* scale to frame dimensions (straight from read buffer) */
+        if(_c.scaler)
+        {
+                if(!scaler_run(_c.scaler, in, w, h, buf))
+                {
+                        _c.running = false;
+                        return NFT_FAILURE;
+                }
+        }
+        /* copy to canvas or frame */
+        else if(in != buf)
+        {
+                char *dst = buf;
+                if(_c.canvas && !(dst = canvas_get_buffer(_c.canvas, w, h)))
+                {
+                        _c.running = false;
+                        return NFT_FAILURE;
+                }
+                memcpy(dst, in, size);
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** check if archive can be played to frame */
+static NftResult _pack_check(Pack * pack, LedFrame * frame)
+{
+        LedPixelFormat *f = led_frame_get_format(frame);
+        LedFrameCord w, h, pw, ph;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+        pack_get_dim(pack, &pw, &ph);
+
+        if(strcmp(pack_get_format(pack), led_pixel_format_to_string(f)) != 0
+           || pack_get_frame_size(pack) !=
+           led_pixel_format_get_buffer_size(f, pw * ph))
+        {
+                NFT_LOG(L_ERROR,
+                        "Archive holds \"%s\" frames but we play \"%s\"",
+                        pack_get_format(pack), led_pixel_format_to_string(f));
+                return NFT_FAILURE;
+        }
+
+        /* region is played of full-size frames */
+        if(_region && (pw != _c.width || ph != _c.height))
+        {
+                NFT_LOG(L_ERROR,
+                        "Archive holds %dx%d frames but --dimensions are %dx%d",
+                        pw, ph, _c.width, _c.height);
+                return NFT_FAILURE;
+        }
+
+        /* frames of other size need to be scaled (or scrolled) */
+        if((pw != w || ph != h) && !_region && !_c.scaler && !_c.canvas)
+        {
+                NFT_LOG(L_ERROR,
+                        "Archive holds %dx%d frames but we play %dx%d (use --scale)",
+                        pw, ph, w, h);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** copy frame n of archive (there's nothing to decode) */
+static NftResult _read_pack_frame(Pack * pack, LedFrame * frame, char *buf,
+                                  size_t n, double *delay)
+{
+        /* end of archive? */
+        const void *src;
+        if(!(src = pack_get_frame(pack, n, delay)))
+                return NFT_FAILURE;
+
+        LedFrameCord w, h;
+        pack_get_dim(pack, &w, &h);
+        size_t size = pack_get_frame_size(pack);
+
+        /* copy region out of archive (only its rows are touched) */
+        char *in = buf;
+        if(_region)
+        {
+                region_crop(_region, src, buf);
+                size = led_frame_get_buffersize(frame);
+        }
+        else
+        {
+                /* copy to scaler or canvas if frame size differs */
+                if(_c.scaler || _c.canvas)
+                {
+                        if(!(in = _c.scaler ?
+                             scaler_get_buffer(_c.scaler, w, h) :
+                             canvas_get_buffer(_c.canvas, w, h)))
+                                return NFT_FAILURE;
+                }
+                memcpy(in, src, size);
+        }
+
+        /* archive from a machine of other byte order? */
+        if(!raw_is_native_endian(pack_is_big_endian(pack)))
+                raw_swap_frame(in, size, format_component_size
+                               (led_frame_get_format(frame)));
+
+        /* scale to frame dimensions */
+        if(_c.scaler && !scaler_run(_c.scaler, in, w, h, buf))
+                return NFT_FAILURE;
+
+        return NFT_SUCCESS;
+}
+
+
+/** copy cached frame to dst (expanding index frames) */
+static void _cached_copy(CachedFrame * f, void *dst)
+{
+        if(f->palette)
+                palette_expand(f->palette, f->frame, f->size, dst);
+        else
+                memcpy(dst, f->frame, f->size);
+}
+
+
+#if HAVE_IMAGEMAGICK == 1
+/** start decoding files of playlist ahead (if enabled) */
+static NftResult _prefetch_start(Playlist * playlist, Prefetch ** prefetch)
 {
-        NFT_LOG(L_INFO, "FPS: %d", led_fps_get());
+        *prefetch = NULL;
+        if(_c.raw || _c.video || !_c.prefetch)
+                return NFT_SUCCESS;
+
+        /* one thread per CPU (but not more than files ahead) */
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int threads = cpus > 0 ? (unsigned int) cpus : 1;
+        if(threads > _c.prefetch)
+                threads = _c.prefetch;
+
+        /* files are only decoded once if they get cached */
+        if(!(*prefetch = prefetch_new(playlist, !_c.no_caching,
+                                      _c.prefetch, threads)))
+        {
+                NFT_LOG(L_ERROR, "Failed to start decode-ahead pool");
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
 }
 #endif
 
 
+/** 
+ * fill chains from frame, send it and latch it in respect to fps 
+ * (or at deadline if one is given) 
+ */
+static NftResult _output_frame(LedHardware * hw, LedFrame * out,
+                               Dither * dither, char *buf, int fps,
+                               const struct timespec *deadline)
+{
+        /* keep previous frame alive while it's held */
+        if(deadline && !_keepalive(hw, deadline))
+                return NFT_FAILURE;
+
+        /* quantize to 8 bit (differs every frame) */
+        if(dither)
+                dither_run(dither, buf);
+
+        /* print raw frame for debugging */
+        led_frame_print_buffer(out);
+
+        /* fill chain of every hardware from frame (only the ones showing
+         * changed pixels of delta input) & send it */
+        LedHardware *h;
+        size_t i;
+        for(h = hw, i = 0; h; h = led_hardware_list_get_next(h), i++)
+        {
+                if(!dirty_chain(_dirty, i))
+                        continue;
+
+                if(!led_chain_fill_from_frame(led_hardware_get_chain(h), out))
+                {
+                        NFT_LOG(L_ERROR, "Error while mapping frame");
+                        break;
+                }
+
+                if(_dirty)
+                        led_hardware_send(h);
+        }
+
+        /* send frame to hardware(s) (of all setups) */
+        NFT_LOG(L_DEBUG, "Sending frame");
+        if(!_dirty)
+                led_hardware_list_send(hw);
+        dirty_sent(_dirty);
+        for(i = 0; i < _c.outputcount; i++)
+        {
+                if(!output_send(_outputs[i], out))
+                        return NFT_FAILURE;
+        }
+
+        /* time the previous frame was shown */
+        static struct timespec shown;
+
+        /* delay in respect to fps (or until deadline) */
+        struct timespec t = shown;
+        if(deadline)
+                t = *deadline;
+        else
+                _timespec_add(&t, 1.0 / fps);
+
+        /* latch on the grid shared with other instances */
+        if(_sync)
+                sync_deadline(_sync, &t, &t);
+
+        if(!events_wait_until(_events, &t))
+                return NFT_FAILURE;
+
+        /* latch hardware (all setups right after each other) */
+        NFT_LOG(L_DEBUG, "Showing frame");
+        led_hardware_list_show(hw);
+        for(i = 0; i < _c.outputcount; i++)
+                output_show(_outputs[i]);
+
+        if(_sync)
+                sync_shown(_sync);
+
+        clock_gettime(CLOCK_MONOTONIC, &shown);
+
+        /* increase framecount */
+        _c.frames_sent++;
+
+        /* save time when frame is displayed */
+        if(!led_fps_sample())
+                return NFT_FAILURE;
+
+        return NFT_SUCCESS;
+}
+
 
 /** print commandline help */
 static void _print_help(char *name)
 {
         printf("Send image to LED hardware - %s\n"
                "Usage: %s [options] <file(s)>\n\n"
-               "Choose \"-\" as <file> to read from stdin\n\n"
+               "Choose \"-\" as <file> to read from stdin. Directories play all files in them in natural order.\n\n"
                "Valid options:\n"
                "\t--help\t\t\t-h\t\tThis help text\n"
                "\t--plugin-help\t\t-p\t\tList of installed plugins + information\n"
-               "\t--config <file>\t\t-c <file>\tLoad this prefs file [~/.ledcat.xml]\n"
+               "\t--config <file>\t\t-c <file>\tLoad this prefs file [~/.ledcat.xml]. Give more to feed their setups from the same frame (<file>,box or <file>,bilinear scales frames to a setup of other dimensions)\n"
+               "\t--playlist <file>\t-i <file>\tPlay files listed in <file> (\"-\" for stdin) after the ones on the commandline. One per line: <file>[<TAB>fps=<n>][<TAB>duration=<seconds>]\n"
+               "\t--daemon <socket>\t-U <socket>\tKeep running and play jobs queued on unix socket <socket> (lines \"play <path>\", \"playlist <file>\", \"load <file>\", \"clear\", \"pause\", \"resume\", \"seek <frame>\", \"fps <n>\", \"next\", \"prev\" or \"stats\") after the files given [off]\n"
+               "\t--reload\t\t-Y\t\tRebuild setup when the prefs file changes or on SIGHUP (instead of exiting), swapping it in between two frames [off]\n"
+               "\t--sync <addr>:<port>\t-C <addr>:<port>\tLatch frames together with all instances using the same multicast group (e.g. 239.255.76.67:7667) & report skew between them. Hosts need synchronized clocks (NTP/PTP) [off]\n"
                "\t--no-cache\t\t-n\t\tDon't use frame cache [off]\n"
+               "\t--hugepages\t\t-H\t\tBack frame cache with huge pages (reserved ones or transparent huge pages) [off]\n"
                "\t--dimensions <w>x<h>\t-d <w>x<h>\tDefine width and height of input frames. [auto]\n"
+               "\t--scale <filter>\t-s <filter>\tScale input frames to setup dimensions (\"box\" or \"bilinear\"). --dimensions then defines size of raw input [off]\n"
+               "\t--region <x>,<y>,<w>,<h>\t-A <x>,<y>,<w>,<h>\tOnly play this part of full-size input frames (--dimensions then defines size of input). Lets several instances share one large display [off]\n"
+               "\t--scroll <dir>[,<px/s>]\t-S <dir>[,<px/s>]\tScroll a viewport over each input image (\"left\", \"right\", \"up\" or \"down\"). --dimensions then defines size of raw input [off]\n"
+               "\t--wrap\t\t\t-w\t\tWrap around the image edges when scrolling [off]\n"
                "\t--big-endian\t\t-b\t\tRAW data is big-endian ordered [off]\n"
+               "\t--palette\t\t-x\t\tRAW input is indexed: records of 'P',<first>,<count-1>,<entries in --format> update the palette, 'F',<w*h 8-bit indices> is a frame [off]\n"
+               "\t--delta\t\t\t-e\t\tRAW input frames only change the current frame: <runs> then <runs> times <offset>,<count>,<count pixels> (32-bit little-endian, in pixels). Only chains showing changed pixels are refilled & sent [off]\n"
                "\t--loop\t\t\t-L\t\tDon't exit after last file but start over with first [off]\n"
-               "\t--fps <n>\t\t-F <n>\t\tFramerate to play multiple frames at. (Ignored when --signal is used) [25]\n"
+               "\t--fps <n>\t\t-F <n>\t\tFramerate to play multiple frames at. (Ignored when --signal is used or frames carry their own delay) [25]\n"
+               "\t--refresh <n>\t\t-R <n>\t\tFramerate of the hardware for crossfades & interpolation [fps]\n"
+               "\t--crossfade <ms>\t-X <ms>\tCrossfade between files for <ms> milliseconds [0]\n"
+               "\t--duration <s>\t\t-u <s>\t\tShow every file for <s> seconds. Stills are held without resending them (playlist entries can set their own) [0 = until file ends]\n"
+               "\t--keepalive <ms>\t-K <ms>\tResend the shown frame every <ms> milliseconds while holding it (for hardware that needs a refresh) [0 = off]\n"
+               "\t--interpolate\t\t-I\t\tInterpolate between frames to play them at --refresh rate [off]\n"
+               "\t--gamma <g>\t\t-G <g>\t\tApply gamma correction to input frames [1.0]\n"
+               "\t--brightness <b>\t-B <b>\t\tScale brightness of input frames (0.0 - 1.0) [1.0]\n"
+               "\t--white-balance <r>,<g>,<b>\t-W <r>,<g>,<b>\tGain of red, green & blue channel (0.0 - 1.0) [1.0,1.0,1.0]\n"
+               "\t--dither\t\t-D\t\tTemporally dither u16 input to 8 bit for the hardware [off]\n"
+#if HAVE_LIBAV == 1
+               "\t--video\t\t\t-V\t\tDecode input files as video, played at their own timestamps [off]\n"
+#endif
 #if HAVE_IMAGEMAGICK == 1
-               "\t--raw\t\t\t-r\t\tTreat input files as raw-files (false)\n"
+               "\t--raw\t\t\t-r\t\tTreat input files as raw-files (LZ4 or zstd compressed input is decompressed automatically) (false)\n"
+               "\t--prefetch <n>\t\t-P <n>\t\tDecode <n> files ahead on worker threads (0 = off) [4]\n"
 #endif
                "\t--format <format>\t-f <format>\tPixelformat of raw frame - doesn't have effect without --raw. (s. http://gegl.org/babl/ for supported formats)\n"
                "\t--loglevel <level>\t-l <level>\tOnly show messages with loglevel <level> (info)\n\n",
@@ -132,21 +690,49 @@ static NftResult _parse_args(int argc, char *argv[])
                 {"loglevel", required_argument, 0, 'l'},
                 {"config", required_argument, 0, 'c'},
                 {"dimensions", required_argument, 0, 'd'},
+                {"scale", required_argument, 0, 's'},
+                {"scroll", required_argument, 0, 'S'},
+                {"region", required_argument, 0, 'A'},
+                {"wrap", no_argument, 0, 'w'},
                 {"fps", required_argument, 0, 'F'},
+                {"refresh", required_argument, 0, 'R'},
+                {"crossfade", required_argument, 0, 'X'},
+                {"duration", required_argument, 0, 'u'},
+                {"keepalive", required_argument, 0, 'K'},
+                {"interpolate", no_argument, 0, 'I'},
                 {"format", required_argument, 0, 'f'},
                 {"big-endian", no_argument, 0, 'b'},
+                {"palette", no_argument, 0, 'x'},
+                {"delta", no_argument, 0, 'e'},
                 {"loop", no_argument, 0, 'L'},
+                {"playlist", required_argument, 0, 'i'},
+                {"daemon", required_argument, 0, 'U'},
+                {"reload", no_argument, 0, 'Y'},
+                {"sync", required_argument, 0, 'C'},
                 {"no-cache", no_argument, 0, 'n'},
+                {"hugepages", no_argument, 0, 'H'},
+                {"gamma", required_argument, 0, 'G'},
+                {"brightness", required_argument, 0, 'B'},
+                {"white-balance", required_argument, 0, 'W'},
+                {"dither", no_argument, 0, 'D'},
 #if HAVE_IMAGEMAGICK == 1
                 {"raw", no_argument, 0, 'r'},
+                {"prefetch", required_argument, 0, 'P'},
+#endif
+#if HAVE_LIBAV == 1
+                {"video", no_argument, 0, 'V'},
 #endif
                 {0, 0, 0, 0}
         };
 
-#if HAVE_IMAGEMAGICK == 1
-        const char arglist[] = "hpl:c:d:F:f:bLnr";
+#if HAVE_IMAGEMAGICK == 1 && HAVE_LIBAV == 1
+        const char arglist[] = "hpl:c:i:U:YC:d:s:S:A:wF:R:X:u:K:If:bxeLnHG:B:W:DrP:V";
+#elif HAVE_IMAGEMAGICK == 1
+        const char arglist[] = "hpl:c:i:U:YC:d:s:S:A:wF:R:X:u:K:If:bxeLnHG:B:W:DrP:";
+#elif HAVE_LIBAV == 1
+        const char arglist[] = "hpl:c:i:U:YC:d:s:S:A:wF:R:X:u:K:If:bxeLnHG:B:W:DV";
 #else
-        const char arglist[] = "hpl:c:d:F:f:bLn";
+        const char arglist[] = "hpl:c:i:U:YC:d:s:S:A:wF:R:X:u:K:If:bxeLnHG:B:W:D";
 #endif
         while((argument =
                getopt_long(argc, argv, arglist, loptions, &index)) >= 0)
@@ -172,8 +758,35 @@ static NftResult _parse_args(int argc, char *argv[])
                         case 'c':
                         {
                                 /* save filename for later */
-                                strncpy(_c.prefsfile, optarg,
-                                        sizeof(_c.prefsfile));
+                                if(!_c.prefs_given)
+                                {
+                                        strncpy(_c.prefsfile, optarg,
+                                                sizeof(_c.prefsfile) - 1);
+                                        _c.prefsfile[sizeof(_c.prefsfile) -
+                                                     1] = '\0';
+                                        _c.prefs_given = true;
+                                        break;
+                                }
+
+                                /* more setups fed from the same frame */
+                                if(_c.outputcount >= LEDCAT_MAX_OUTPUTS)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Too many setups (max. %d)",
+                                                LEDCAT_MAX_OUTPUTS + 1);
+                                        return NFT_FAILURE;
+                                }
+
+                                /* "<file>,<filter>" scales frames to setup */
+                                ScaleMode mode = SCALE_NONE;
+                                char *comma = strrchr(optarg, ',');
+                                if(comma &&
+                                   scale_mode_from_string(comma + 1, &mode))
+                                        *comma = '\0';
+
+                                strncpy(_c.outputs[_c.outputcount], optarg,
+                                        sizeof(_c.outputs[0]) - 1);
+                                _c.output_scale[_c.outputcount++] = mode;
                                 break;
                         }
 
@@ -184,6 +797,36 @@ static NftResult _parse_args(int argc, char *argv[])
                                 break;
                         }
 
+                        /** --playlist */
+                        case 'i':
+                        {
+                                strncpy(_c.playlist, optarg,
+                                        sizeof(_c.playlist) - 1);
+                                break;
+                        }
+
+                        /** --daemon */
+                        case 'U':
+                        {
+                                strncpy(_c.daemon, optarg,
+                                        sizeof(_c.daemon) - 1);
+                                break;
+                        }
+
+                        /** --reload */
+                        case 'Y':
+                        {
+                                _c.reload = true;
+                                break;
+                        }
+
+                        /** --sync */
+                        case 'C':
+                        {
+                                strncpy(_c.sync, optarg, sizeof(_c.sync) - 1);
+                                break;
+                        }
+
                         /** --dimensions */
                         case 'd':
                         {
@@ -199,6 +842,55 @@ static NftResult _parse_args(int argc, char *argv[])
                                 break;
                         }
 
+                        /** --scale */
+                        case 's':
+                        {
+                                if(!scale_mode_from_string(optarg, &_c.scale))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid scaling filter \"%s\" (Use \"box\" or \"bilinear\")",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --scroll */
+                        case 'S':
+                        {
+                                if(!canvas_scroll_from_string
+                                   (optarg, &_c.scroll, &_c.scroll_speed))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid scroll definition \"%s\" (Use something like left,30)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --region */
+                        case 'A':
+                        {
+                                if(!region_from_string
+                                   (optarg, &_c.region_x, &_c.region_y,
+                                    &_c.region_width, &_c.region_height))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid region \"%s\" (Use something like 0,0,64,32)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --wrap */
+                        case 'w':
+                        {
+                                _c.wrap = true;
+                                break;
+                        }
+
                         /** --fps */
                         case 'F':
                         {
@@ -213,6 +905,123 @@ static NftResult _parse_args(int argc, char *argv[])
                                 break;
                         }
 
+                        /** --gamma */
+                        case 'G':
+                        {
+                                if(sscanf(optarg, "%lf", &_c.gamma) != 1 ||
+                                   _c.gamma <= 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid gamma \"%s\" (Use a positive number like 2.2)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --brightness */
+                        case 'B':
+                        {
+                                if(sscanf(optarg, "%lf", &_c.brightness) != 1
+                                   || _c.brightness < 0
+                                   || _c.brightness > 1)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid brightness \"%s\" (Use a value from 0.0 to 1.0)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --white-balance */
+                        case 'W':
+                        {
+                                if(sscanf(optarg, "%lf,%lf,%lf",
+                                          &_c.white[0], &_c.white[1],
+                                          &_c.white[2]) != 3 ||
+                                   _c.white[0] < 0 || _c.white[0] > 1 ||
+                                   _c.white[1] < 0 || _c.white[1] > 1 ||
+                                   _c.white[2] < 0 || _c.white[2] > 1)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid white balance \"%s\" (Use something like 1.0,0.8,0.7)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --dither */
+                        case 'D':
+                        {
+                                _c.dither = true;
+                                break;
+                        }
+
+                        /** --refresh */
+                        case 'R':
+                        {
+                                if(sscanf(optarg, "%32d", &_c.refresh) != 1 ||
+                                   _c.refresh <= 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid refresh rate \"%s\" (Use a positive integer)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --crossfade */
+                        case 'X':
+                        {
+                                if(sscanf(optarg, "%32d", &_c.crossfade) != 1
+                                   || _c.crossfade < 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid crossfade duration \"%s\" (Use milliseconds)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --duration */
+                        case 'u':
+                        {
+                                if(sscanf(optarg, "%lf", &_c.duration) != 1
+                                   || _c.duration < 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid duration \"%s\" (Use seconds)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --keepalive */
+                        case 'K':
+                        {
+                                if(sscanf(optarg, "%32d", &_c.keepalive) != 1
+                                   || _c.keepalive < 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid keepalive interval \"%s\" (Use milliseconds)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /** --interpolate */
+                        case 'I':
+                        {
+                                _c.interpolate = true;
+                                break;
+                        }
+
                         /** --loglevel */
                         case 'l':
                         {
@@ -232,7 +1041,9 @@ static NftResult _parse_args(int argc, char *argv[])
                         case 'f':
                         {
                                 strncpy(_c.pixelformat, optarg,
-                                        sizeof(_c.pixelformat));
+                                        sizeof(_c.pixelformat) - 1);
+                                _c.pixelformat[sizeof(_c.pixelformat) - 1] =
+                                        '\0';
                                 break;
                         }
 
@@ -243,6 +1054,28 @@ static NftResult _parse_args(int argc, char *argv[])
                                 _c.raw = true;
                                 break;
                         }
+
+                        /** --prefetch */
+                        case 'P':
+                        {
+                                if(sscanf(optarg, "%32u", &_c.prefetch) != 1)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid amount of files to prefetch \"%s\" (Use a positive integer or 0)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+#endif
+
+#if HAVE_LIBAV == 1
+                        /** --video */
+                        case 'V':
+                        {
+                                _c.video = true;
+                                break;
+                        }
 #endif
 
                         /** --big-endian */
@@ -252,6 +1085,20 @@ static NftResult _parse_args(int argc, char *argv[])
                                 break;
                         }
 
+                        /** --palette */
+                        case 'x':
+                        {
+                                _c.palette = true;
+                                break;
+                        }
+
+                        /** --delta */
+                        case 'e':
+                        {
+                                _c.delta = true;
+                                break;
+                        }
+
 
                         /** --no-cache */
                         case 'n':
@@ -260,6 +1107,13 @@ static NftResult _parse_args(int argc, char *argv[])
                                 break;
                         }
 
+                        /** --hugepages */
+                        case 'H':
+                        {
+                                _c.hugepages = true;
+                                break;
+                        }
+
                                 /* invalid argument */
                         case '?':
                         {
@@ -310,6 +1164,28 @@ int main(int argc, char *argv[])
         LedFrameCord height;
         /* frame cache */
         Cache *cache = NULL;
+        /* color correction */
+        Correction *correction = NULL;
+        /* temporal dithering */
+        Dither *dither = NULL;
+        /* last frame shown (to blend from) */
+        char *prev = NULL;
+        /* current frame while blending */
+        char *cur = NULL;
+#if HAVE_IMAGEMAGICK == 1
+        /* decode-ahead pool */
+        Prefetch *prefetch = NULL;
+#endif
+#if HAVE_LIBAV == 1
+        /* video decoder of current file */
+        Video *video = NULL;
+#endif
+        /* archive of current file */
+        Pack *pack = NULL;
+        /* files to play */
+        Playlist *playlist = NULL;
+        /* job server (NULL if not running as daemon) */
+        Daemon *daemon = NULL;
 
 
 
@@ -325,21 +1201,19 @@ int main(int argc, char *argv[])
         }
 
 
-        /* initialize exit handlers */
-#if WIN32
-        int signals[] = { SIGINT, SIGABRT };
-#else
-        int signals[] = { SIGHUP, SIGINT, SIGQUIT, SIGABRT };
-#endif
+        /* handle signals as events (before any thread is started, so
+         * they inherit the blocked signals) */
+        if(!(_events = events_new(&_c.running)))
+                return EXIT_FAILURE;
+        int signals[] = { SIGINT, SIGQUIT, SIGABRT };
         unsigned int i;
         for(i = 0; i < sizeof(signals) / sizeof(int); i++)
         {
-                if(signal(signals[i], _exit_signal_handler) == SIG_ERR)
-                {
-                        NFT_LOG_PERROR("signal()");
+                if(!events_on_signal(_events, signals[i], _exit_event, NULL))
                         return EXIT_FAILURE;
-                }
         }
+        if(!events_on_signal(_events, SIGHUP, _hangup_event, NULL))
+                return EXIT_FAILURE;
 
 
 
@@ -352,6 +1226,9 @@ int main(int argc, char *argv[])
 #if HAVE_IMAGEMAGICK == 1
         /* default handle-input-as-raw */
         _c.raw = false;
+
+        /* default amount of files decoded ahead */
+        _c.prefetch = 4;
 #endif
 
         /* default looping */
@@ -363,8 +1240,14 @@ int main(int argc, char *argv[])
         /* use caching by default */
         _c.no_caching = false;
 
+        /* no color correction by default */
+        _c.gamma = 1.0;
+        _c.brightness = 1.0;
+        _c.white[0] = _c.white[1] = _c.white[2] = 1.0;
+
         /* default pixel-format */
-        strncpy(_c.pixelformat, "RGB u8", sizeof(_c.pixelformat));
+        strncpy(_c.pixelformat, "RGB u8", sizeof(_c.pixelformat) - 1);
+        _c.pixelformat[sizeof(_c.pixelformat) - 1] = '\0';
 
         /* default prefs-filename */
         if(!led_prefs_default_filename
@@ -434,11 +1317,81 @@ int main(int argc, char *argv[])
         if(!led_setup_get_dim(s, &width, &height)) {
                 goto m_deinit;
         }
-        /* override value from commandline? */
-        if(_c.width) {
+        /* override value from commandline? (when scaling or scrolling, the
+         * commandline defines the size of raw input frames instead) */
+        if(_c.scale != SCALE_NONE && _c.scroll != SCROLL_NONE)
+        {
+                NFT_LOG(L_ERROR, "--scale and --scroll can't be combined");
+                goto m_deinit;
+        }
+        if(_c.video && (_c.scale != SCALE_NONE || _c.scroll != SCROLL_NONE))
+        {
+                NFT_LOG(L_ERROR,
+                        "--video is scaled by the decoder and can't be combined with --scale or --scroll");
+                goto m_deinit;
+        }
+        /* a region is played of full-size frames (of --dimensions) */
+        if(_c.region_width)
+        {
+                if(_c.scale != SCALE_NONE || _c.scroll != SCROLL_NONE ||
+                   _c.video)
+                {
+                        NFT_LOG(L_ERROR,
+                                "--region can't be combined with --scale, --scroll or --video");
+                        goto m_deinit;
+                }
+                if(!_c.width || !_c.height)
+                {
+                        NFT_LOG(L_ERROR,
+                                "--region needs --dimensions of full-size input frames");
+                        goto m_deinit;
+                }
+                width = _c.region_width;
+                height = _c.region_height;
+        }
+        /* indexed input is expanded from raw streams */
+        if(_c.palette)
+        {
+#if HAVE_IMAGEMAGICK == 1
+                if(!_c.raw)
+                {
+                        NFT_LOG(L_ERROR, "--palette needs --raw");
+                        goto m_deinit;
+                }
+#endif
+                if(_c.region_width || _c.video)
+                {
+                        NFT_LOG(L_ERROR,
+                                "--palette can't be combined with --region or --video");
+                        goto m_deinit;
+                }
+        }
+        /* delta input changes the frame that's sent (nothing in between
+         * may change it) */
+        if(_c.delta)
+        {
+#if HAVE_IMAGEMAGICK == 1
+                if(!_c.raw)
+                {
+                        NFT_LOG(L_ERROR, "--delta needs --raw");
+                        goto m_deinit;
+                }
+#endif
+                if(_c.palette || _c.region_width || _c.video ||
+                   _c.scale != SCALE_NONE || _c.scroll != SCROLL_NONE ||
+                   _c.crossfade || _c.interpolate || _c.dither)
+                {
+                        NFT_LOG(L_ERROR,
+                                "--delta can't be combined with --palette, --region, --video, --scale, --scroll, --crossfade, --interpolate or --dither");
+                        goto m_deinit;
+                }
+        }
+        bool input_size = (_c.scale != SCALE_NONE ||
+                           _c.scroll != SCROLL_NONE || _c.region_width);
+        if(_c.width && !input_size) {
                 width = _c.width;
         }
-        if(_c.height) {
+        if(_c.height && !input_size) {
                 height = _c.height;
         }
         /* validate dimensions */
@@ -466,13 +1419,25 @@ int main(int argc, char *argv[])
         if(!(frame = led_frame_new(width, height, format)))
                 goto m_deinit;
 
+        /* frame the chains are filled from */
+        LedFrame *out = frame;
+
+        /* dither to an 8 bit frame before filling the chains? */
+        if(_c.dither)
+        {
+                if(!(dither = dither_new(format, width, height)))
+                        goto m_deinit;
+
+                out = dither_get_frame(dither);
+        }
+
 
         /* precalc memory offsets for actual mapping */
         LedHardware *ch;
         for(ch = hw; ch; ch = led_hardware_list_get_next(ch))
         {
                 if(!led_chain_map_from_frame
-                   (led_hardware_get_chain(ch), frame))
+                   (led_hardware_get_chain(ch), out))
                         goto m_deinit;
         }
 
@@ -480,6 +1445,131 @@ int main(int argc, char *argv[])
         if(!led_hardware_list_refresh_gain(hw))
                 goto m_deinit;
 
+        /* rebuild setup when prefs file changes (or on SIGHUP) */
+        if(_c.reload)
+        {
+                LedFrameCord sw, sh;
+                if(!led_setup_get_dim(s, &sw, &sh) ||
+                   !(_reload = reload_new(_c.prefsfile, out, sw, sh)))
+                        goto m_deinit;
+        }
+
+        /* additional setups fed from the same frame */
+        size_t o;
+        for(o = 0; o < _c.outputcount; o++)
+        {
+                if(!(_outputs[o] = output_new(p, _c.outputs[o], out,
+                                              _c.output_scale[o],
+                                              _c.reload)))
+                        goto m_deinit;
+        }
+
+        /* scale input frames of any size to frame dimensions */
+        if(_c.scale != SCALE_NONE)
+        {
+                if(!(_c.scaler = scaler_new(_c.scale, format, width, height)))
+                        goto m_deinit;
+        }
+
+        /* read raw input frames (records of indexed input are bytes) */
+        if(!(_reader = raw_reader_new(_c.palette ? 1 :
+                                      format_component_size(format))))
+                goto m_deinit;
+
+        /* play part of full-size input frames */
+        if(_c.region_width)
+        {
+                if(!(_region = region_new(format, _c.width, _c.height,
+                                            _c.region_x, _c.region_y,
+                                            width, height)))
+                        goto m_deinit;
+        }
+
+        /* load input images to a canvas and scroll a viewport over it */
+        if(_c.scroll != SCROLL_NONE)
+        {
+                /* default: one pixel per frame */
+                if(_c.scroll_speed <= 0)
+                        _c.scroll_speed = _c.fps;
+
+                if(!(_c.canvas = canvas_new(format, width, height, _c.scroll,
+                                            _c.scroll_speed, _c.wrap)))
+                        goto m_deinit;
+        }
+
+        /* raw frames are converted to native byte order once when they are
+         * read, so the frame (and every cached copy) is always native */
+        size_t swap_size = 0;
+        if(!raw_is_native_endian(_c.is_big_endian))
+        {
+                if((swap_size = format_component_size(format)) == 0)
+                {
+                        NFT_LOG(L_ERROR,
+                                "Can't convert byte order of \"%s\" (mixed component types)",
+                                _c.pixelformat);
+                        goto m_deinit;
+                }
+        }
+        led_frame_set_big_endian(frame, !raw_is_native_endian(false));
+
+        /* buffers to blend between frames */
+        size_t blend_size = 0;
+        if(_c.crossfade || _c.interpolate)
+        {
+                /* default hardware framerate */
+                if(!_c.refresh)
+                        _c.refresh = _c.fps;
+
+                blend_size = format_component_size(format);
+                if(!(blend_size == 4 || (format_is_unsigned(format) &&
+                                         blend_size <= 2)))
+                {
+                        NFT_LOG(L_ERROR,
+                                "Blending only supports u8, u16 and float pixelformats (not \"%s\")",
+                                _c.pixelformat);
+                        goto m_deinit;
+                }
+
+                if(!(prev = malloc(led_frame_get_buffersize(frame))) ||
+                   !(cur = malloc(led_frame_get_buffersize(frame))))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        goto m_deinit;
+                }
+
+                NFT_LOG(L_INFO, "Blending at %d fps (crossfade: %d ms, interpolation: %s)",
+                        _c.refresh, _c.crossfade,
+                        _c.interpolate ? "on" : "off");
+        }
+
+        /* build color correction tables */
+        if(_c.gamma != 1.0 || _c.brightness != 1.0 ||
+           _c.white[0] != 1.0 || _c.white[1] != 1.0 || _c.white[2] != 1.0)
+        {
+                if(!(correction = correction_new(format, _c.gamma,
+                                                 _c.brightness, _c.white)))
+                        goto m_deinit;
+        }
+
+        /* expand index frames with a lookup-table (corrected once per
+         * palette update unless frames are scaled afterwards) */
+        if(_c.palette)
+        {
+                if(!(_palette = palette_new(format, swap_size,
+                                            _c.scaler ? NULL : correction,
+                                            !_c.no_caching && !_c.scaler)))
+                        goto m_deinit;
+        }
+
+        /* apply changed runs to the frame (corrected once when they're
+         * applied) & only refill chains showing them */
+        if(_c.delta)
+        {
+                if(!(_delta = delta_new(format, swap_size, correction)) ||
+                   !(_dirty = dirty_new(hw, out)))
+                        goto m_deinit;
+        }
+
 #if HAVE_IMAGEMAGICK == 1
         /* determine format that ImageMagick should provide */
         if(!_c.raw)
@@ -493,8 +1583,42 @@ int main(int argc, char *argv[])
         }
 #endif
 
+        /* files to play (commandline arguments first, then playlist).
+         * Entries are enumerated when they're reached, decode-ahead
+         * looks as far ahead as it decodes, one entry is kept to step
+         * back to */
+        size_t window = 2;
+#if HAVE_IMAGEMAGICK == 1
+        window += _c.prefetch;
+#endif
+        if(!(playlist = playlist_new(_c.do_loop, window)))
+                goto m_deinit;
+        size_t n;
+        for(n = 0; n < _c.filecount; n++)
+        {
+                if(!playlist_add_path(playlist, _c.files[n]))
+                        goto m_deinit;
+        }
+        if(_c.playlist[0] && !playlist_add_list(playlist, _c.playlist))
+                goto m_deinit;
+
+        /* accept jobs on socket? */
+        if(_c.daemon[0])
+        {
+                if(!(daemon = daemon_new(_c.daemon, _c.do_loop, window)) ||
+                   !events_watch(_events, daemon_get_fd(daemon),
+                                 _daemon_event, daemon))
+                        goto m_deinit;
+
+                /* play jobs only if no files were given */
+                if(playlist_is_empty(playlist))
+                {
+                        playlist_destroy(playlist);
+                        playlist = NULL;
+                }
+        }
         /* do we have at least one filename? */
-        if(!_c.files[0])
+        else if(playlist_is_empty(playlist))
         {
                 NFT_LOG(L_ERROR, "No input file(s) given");
                 goto m_deinit;
@@ -506,22 +1630,9 @@ int main(int argc, char *argv[])
                 goto m_deinit;
 
 
-#if ! WIN32
-        /* initialize alarm-signal handler for periodical fps output */
-        {
-                struct sigaction sa;
-                struct itimerval timer;
-
-                memset(&sa, 0, sizeof(sa));
-                sa.sa_handler = &_alarm_signal_handler;
-                sigaction(SIGALRM, &sa, NULL);
-                timer.it_value.tv_sec = 1;
-                timer.it_value.tv_usec = 0;
-                timer.it_interval.tv_sec = 1;
-                timer.it_interval.tv_usec = 0;
-                setitimer(ITIMER_REAL, &timer, NULL);
-        }
-#endif
+        /* periodical fps output */
+        if(!events_every(_events, 1, _fps_event, NULL))
+                goto m_deinit;
 
 
         /* get data-buffer of frame to write our pixels to */
@@ -544,28 +1655,178 @@ int main(int argc, char *argv[])
         if(_c.no_caching)
                 cache_disable(cache, true);
 
+        /* back cache with huge pages */
+        cache_hugepages(cache, _c.hugepages);
+
+
+
+
+
+#if HAVE_IMAGEMAGICK == 1
+        /* decode files ahead of playback? */
+        if(playlist && !_prefetch_start(playlist, &prefetch))
+                goto m_deinit;
+#endif
+
+        /* agree with other instances on when to latch frames */
+        if(_c.sync[0])
+        {
+                int rate = (_c.crossfade || _c.interpolate) ?
+                        _c.refresh : _c.fps;
+                if(!(_sync = sync_new(_events, &_c.running, _c.sync, rate)))
+                        goto m_deinit;
+        }
+
+        /* true if prev holds a frame */
+        bool prev_valid = false;
 
+        /* time the last frame was latched */
+        struct timespec latch;
+        /* time the last frame should be shown (0 = in respect to fps) */
+        double hold = 0;
 
+        /* n-th file played (counting loops) */
+        unsigned long seq;
+        /* current playlist entry */
+        PlaylistEntry entry;
 
+        /* state requested by clients of daemon */
+        bool paused = false;
+        struct timespec paused_at;
+        bool stop_job = false;
+        int skip = 0;
 
-        /* walk all files (supplied as commandline arguments) and output them */
-        size_t filecount;
-        for(filecount = 0; filecount < _c.filecount; filecount++)
+        /* walk all files (from commandline & playlist, then jobs of
+         * daemon) and output them */
+        for(seq = 0; _c.running; seq++)
         {
+                /* skip files (requested by client) */
+                if(skip)
+                {
+                        /* released entries can't be played again */
+                        long target = (long) seq - 1 + skip;
+                        long first = playlist ?
+                                (long) playlist_first(playlist) : 0;
+                        if(target < first)
+                        {
+                                NFT_LOG(L_WARNING,
+                                        "Can't step back further than entry %ld",
+                                        first);
+                                target = first;
+                        }
+                        seq = (unsigned long) target;
+                        skip = 0;
+                        hold = 0;
+                }
+
+                /* entries before the previous one aren't needed anymore
+                 * (release them first so seq fits into the window) */
+                if(playlist)
+                        playlist_release(playlist, seq ? seq - 1 : 0);
+
+                /* job done (or looping while others are queued)? */
+                if(!playlist || stop_job ||
+                   (daemon && _c.do_loop && daemon_pending(daemon)) ||
+                   !playlist_get(playlist, seq, &entry))
+                {
+                        if(!daemon)
+                                break;
 
-                NFT_LOG(L_DEBUG, "Getting pixels from \"%s\"",
-                        _c.files[filecount]);
+                        /* stopped job isn't held */
+                        if(stop_job)
+                                hold = 0;
+                        stop_job = false;
+
+#if HAVE_IMAGEMAGICK == 1
+                        prefetch_destroy(prefetch);
+                        prefetch = NULL;
+#endif
+                        playlist_destroy(playlist);
+
+                        /* switch to next job (frame shown stays latched) */
+                        if(!(playlist = daemon_next_job(daemon, _events,
+                                                         &_c.running)))
+                                break;
+#if HAVE_IMAGEMAGICK == 1
+                        if(!_prefetch_start(playlist, &prefetch))
+                                break;
+#endif
+
+                        /* start with first entry of job */
+                        seq = -1;
+                        continue;
+                }
+
+                /* clients may step back to entries not released yet */
+                daemon_playing(daemon, seq - playlist_first(playlist));
+
+                char *file = entry.filename;
+                int fps = entry.fps ? entry.fps : _c.fps;
+
+                memcpy(_playing.file, entry.filename, sizeof(_playing.file));
+                _playing.seq = seq;
+
+                NFT_LOG(L_DEBUG, "Getting pixels from \"%s\"", file);
+
+                /* time this entry ends (if it has a duration) */
+                double duration = entry.duration > 0 ? entry.duration :
+                        _c.duration;
+                struct timespec entry_end;
+                bool entry_end_set = false;
 
 
                 /* check if file is already cached */
-                CachedFrame *f;
+                CachedFrame *f = NULL;
                 bool cached_frame_found;
 
+                /* crossfade to first frame of a file */
+                bool first_frame = true;
+
+                /* true when the canvas holds the image of this file */
+                bool canvas_loaded = false;
+                /* frames of this file shown on the canvas */
+                unsigned long canvas_frame = 0;
+
+                /* time to show current frame in seconds (0 = in respect
+                 * to fps) */
+                double delay = 0;
+
+                /* next frame of archive */
+                size_t pack_frame = 0;
+
+                /* next frame of this file to show */
+                unsigned long file_frame = 0;
+
+                /* true when file was decoded to its end (frames of files
+                 * cut short don't stay cached) */
+                bool decoded_all = false;
+
+#if HAVE_LIBAV == 1
+                /* time the first frame of a video was shown */
+                struct timespec video_start;
+                bool video_started = false;
+
+                /* decode video (never cached) */
+                if(_c.video)
+                {
+                        if(!(video = video_open(file, format,
+                                                width, height, fps)))
+                                continue;
+
+                        cached_frame_found = false;
+                }
+                else
+#endif
                 if((!_c.no_caching) &&
-                   (f = cache_frame_get(cache, _c.files[filecount])))
+                   (f = cache_frame_get(cache, file)))
                 {
-                        /* copy frame to buffer */
-                        memcpy(buf, f->frame, f->size);
+                        /* copy frame to buffer (or canvas) */
+                        char *dst = buf;
+                        if(_c.canvas && !(dst = canvas_get_buffer
+                                          (_c.canvas, f->width, f->height)))
+                                continue;
+                        _cached_copy(f, dst);
+                        delay = f->delay;
 
                         /* mark current frame as cached */
                         cached_frame_found = true;
@@ -575,28 +1836,50 @@ int main(int argc, char *argv[])
                         /* current frame not found in cache */
                         cached_frame_found = false;
 
+#if HAVE_IMAGEMAGICK == 1
+                        /* file already decoded ahead? */
+                        if(prefetch &&
+                           prefetch_swap(prefetch, seq, &_c.mw))
+                        {
+                                _c.preloaded = true;
+                                _c.fd = -1;
+                        }
+                        else
+#endif
                         /* open file */
-                        if(_c.files[filecount][0] == '-' &&
-                           strlen(_c.files[filecount]) == 1)
+                        if(file[0] == '-' &&
+                           strlen(file) == 1)
                         {
                                 _c.fd = STDIN_FILENO;
                         }
                         else
                         {
                                 if((_c.fd =
-                                    open(_c.files[filecount], O_RDONLY)) < 0)
+                                    open(file, O_RDONLY)) < 0)
                                 {
                                         NFT_LOG(L_ERROR,
                                                 "Failed to open \"%s\": %s",
-                                                _c.files[filecount],
+                                                file,
                                                 strerror(errno));
                                         continue;
                                 }
                         }
 
+                        /* archive of pre-decoded frames? */
+                        if(pack_probe(_c.fd))
+                        {
+                                pack = pack_open(_c.fd);
+                                close(_c.fd);
+                                if(!pack || !_pack_check(pack, frame))
+                                {
+                                        pack_close(pack);
+                                        pack = NULL;
+                                        continue;
+                                }
+                        }
 #if HAVE_IMAGEMAGICK == 1
                         /** initialize stream for ImageMagick */
-                        if(!_c.raw)
+                        else if(!_c.raw && !_c.preloaded)
                         {
                                 if(!(im_open_stream(&_c)))
                                         continue;
@@ -610,133 +1893,419 @@ int main(int argc, char *argv[])
                 while(_c.running)
                 {
 
-                        if(!cached_frame_found)
+                        /* use reloaded setup from now on */
+                        if(reload_swap(_reload, &s))
                         {
-#if HAVE_IMAGEMAGICK == 1
-                                /* use imagemagick to load file if we're not in
-                                 * "raw-mode" */
-                                if(!_c.raw)
+                                hw = led_setup_get_hardware(s);
+
+                                /* fill new chains from the frame shown
+                                 * (keepalive & paused refreshes resend them
+                                 * before the next frame is sent) */
+                                LedHardware *h;
+                                for(h = hw; h;
+                                    h = led_hardware_list_get_next(h))
                                 {
-                                        /* load frame to buffer using
-                                         * ImageMagick */
-                                        if(!im_read_frame
-                                           (&_c, width, height, buf))
-                                                break;
+                                        if(!led_chain_fill_from_frame
+                                           (led_hardware_get_chain(h), out))
+                                        {
+                                                NFT_LOG(L_ERROR,
+                                                        "Error while mapping frame");
+                                                goto m_deinit;
+                                        }
+                                }
 
+                                /* chains of new setup show other pixels */
+                                if(_dirty)
+                                {
+                                        dirty_destroy(_dirty);
+                                        if(!(_dirty = dirty_new(hw, out)))
+                                                goto m_deinit;
                                 }
-                                else
+                        }
+                        for(o = 0; o < _c.outputcount; o++)
+                                output_swap(_outputs[o]);
+
+                        /* apply requests of clients (waiting while paused or
+                         * while the previous frame is held) */
+                        DaemonRequest req;
+                        bool was_paused = paused;
+                        while(_c.running)
+                        {
+                                if(daemon_poll(daemon, &req))
                                 {
-#endif
-                                        /* get frame dimensions */
-                                        LedFrameCord w,h;
-                                        if(!led_frame_get_dim(frame, &w, &h))
+                                        if(req.fps)
+                                                _c.fps = fps = req.fps;
+
+                                        if(req.pause > 0 && !paused)
+                                                clock_gettime(CLOCK_MONOTONIC,
+                                                              &paused_at);
+                                        if(req.pause)
+                                                paused = (req.pause > 0);
+
+                                        /* seek in archive or cache */
+                                        CachedFrame *s = NULL;
+                                        if(req.seek >= 0 && pack)
+                                                pack_frame = req.seek;
+                                        else if(req.seek >= 0 &&
+                                                cached_frame_found &&
+                                                !_c.canvas &&
+                                                (s = cache_frame_nth
+                                                 (cache, file, req.seek)))
                                         {
-                                                _c.running = false;
-                                                break;
+                                                f = s;
+                                                _cached_copy(f, buf);
+                                                delay = f->delay;
                                         }
+                                        else if(req.seek >= 0)
+                                                NFT_LOG(L_WARNING,
+                                                        "Can't seek to frame %ld of \"%s\" (only archives & cached files)",
+                                                        req.seek, file);
+                                        if(req.seek >= 0 && (pack || s))
+                                                file_frame = req.seek;
+
+                                        if(req.clear)
+                                                stop_job = true;
+                                        skip += req.skip;
+                                }
 
-                                        /* read raw frame */
-                                        int bytes_read = raw_read_frame
-                                           (&_c.running, buf, _c.fd,
-                                            led_pixel_format_get_buffer_size
-                                            (led_frame_get_format(frame),
-                                             w * h));
+                                if(stop_job || skip)
+                                        break;
 
-                                        if(bytes_read < 0)
-                                        {
-                                                _c.running = false;
+                                /* time stood still while paused */
+                                if(was_paused && !paused)
+                                {
+                                        struct timespec now;
+                                        clock_gettime(CLOCK_MONOTONIC, &now);
+                                        double p = _timespec_diff(&now,
+                                                                  &paused_at);
+                                        _timespec_add(&latch, p);
+                                        if(entry_end_set)
+                                                _timespec_add(&entry_end, p);
+#if HAVE_LIBAV == 1
+                                        if(video_started)
+                                                _timespec_add(&video_start,
+                                                              p);
+#endif
+                                }
+                                was_paused = paused;
+
+                                _playing.frame = file_frame ?
+                                        file_frame - 1 : 0;
+                                _playing.fps = fps;
+                                _playing.paused = paused;
+
+                                /* hold frame until resumed, refresh it for
+                                 * hardware that needs it */
+                                double wait = (double) _c.keepalive / 1000;
+                                if(!paused)
+                                {
+                                        /* wait for most of a long hold
+                                         * here, reading the next frame one
+                                         * period before it's due */
+                                        if(!daemon || hold <= 0)
+                                                break;
+                                        struct timespec now;
+                                        clock_gettime(CLOCK_MONOTONIC, &now);
+                                        double left = _timespec_diff(&latch,
+                                                                     &now) +
+                                                hold - 1.0 / fps;
+                                        if(left <= 0)
+                                                break;
+                                        if(wait <= 0 || wait > left)
+                                                wait = left;
+                                }
+                                daemon_wait(daemon, _events, wait);
+                                if(_c.keepalive > 0)
+                                        _refresh(hw);
+                        }
+                        if(stop_job || skip)
+                                break;
+
+                        /* time to latch this frame (if not in respect to fps) */
+                        struct timespec deadline;
+                        bool deadline_set = false;
+
+                        /* previous frame is shown for its own delay */
+                        if(hold > 0)
+                        {
+                                deadline = latch;
+                                _timespec_add(&deadline, hold);
+                                deadline_set = true;
+                        }
+
+                        /* duration of entry over? */
+                        if(entry_end_set &&
+                           _timespec_diff(&entry_end, deadline_set ?
+                                          &deadline : &latch) <= 0)
+                                break;
+
+                        if(!cached_frame_found && !canvas_loaded)
+                        {
+#if HAVE_LIBAV == 1
+                                /* get next frame from video decoder */
+                                if(video)
+                                {
+                                        double pts;
+                                        if(!video_read_frame(video, _events,
+                                                             &_c.running,
+                                                             buf, &pts))
                                                 break;
+                                        NFT_LOG(L_DEBUG, "Video frame at %.3f s",
+                                                pts);
+
+                                        /* latch frame at its own timestamp */
+                                        if(!video_started)
+                                        {
+                                                clock_gettime(CLOCK_MONOTONIC,
+                                                              &video_start);
+                                                video_started = true;
                                         }
-#if HAVE_IMAGEMAGICK == 1
+                                        deadline = video_start;
+                                        _timespec_add(&deadline, pts);
+                                        deadline_set = true;
                                 }
+                                else
 #endif
+                                if(pack)
+                                {
+                                        if(!_read_pack_frame(pack, frame, buf,
+                                                             pack_frame++,
+                                                             &delay))
+                                                break;
+                                }
+                                else if(!_read_frame(frame, buf, swap_size,
+                                                     &delay))
+                                {
+                                        decoded_all = true;
+                                        break;
+                                }
+
+                                /* decoded frame (or canvas image) */
+                                char *decoded = buf;
+                                size_t decoded_size =
+                                        led_frame_get_buffersize(frame);
+                                LedFrameCord dw = width, dh = height;
+                                if(_c.canvas)
+                                {
+                                        canvas_get_dim(_c.canvas, &dw, &dh);
+                                        decoded = canvas_get_buffer
+                                                (_c.canvas, dw, dh);
+                                        decoded_size =
+                                                canvas_get_size(_c.canvas);
+                                        canvas_loaded = true;
+                                        decoded_all = true;
+                                }
+
+                                /* index frames were expanded from a
+                                 * corrected palette & are cached as
+                                 * indices (unless they were scaled) */
+                                void *cached = decoded;
+                                size_t cached_size = decoded_size;
+                                const PaletteTable *table = NULL;
+                                if(_palette && !_c.scaler && !pack)
+                                {
+                                        cached = palette_get_index(_palette);
+                                        cached_size = (size_t) dw * dh;
+                                        table = palette_get_table(_palette);
+                                }
 
-                                /* cache frame */
-                                if(!
-                                   (cache_frame_put
-                                    (cache, buf,
-                                     led_frame_get_buffersize(frame),
-                                     _c.files[filecount])))
+                                /* apply color correction once, so cached
+                                 * frames are stored corrected (delta runs
+                                 * were corrected when they were applied) */
+                                if(correction && !table &&
+                                   !(_delta && !pack))
+                                        correction_apply(correction, decoded,
+                                                         decoded_size);
+
+                                /* cache frame (video frames and archives
+                                 * are never cached) */
+                                if(!_c.video && !pack &&
+                                   !(cache_frame_put
+                                    (cache, cached, cached_size, dw, dh,
+                                     delay, table, file)))
                                 {
                                         NFT_LOG(L_ERROR,
                                                 "Failed to cache frame \"%s\"",
-                                                _c.files[filecount]);
+                                                file);
                                         break;
                                 }
 
                         }
 
 
-                        /* set endianness (flag will be changed when conversion
-                         * occurs) */
-                        led_frame_set_big_endian(frame, _c.is_big_endian);
-
-            /* print raw frame for debugging */
-            led_frame_print_buffer(frame);
+                        /* move viewport over canvas */
+                        if(_c.canvas &&
+                           !canvas_view(_c.canvas,
+                                        (double) canvas_frame++ / fps,
+                                        buf))
+                                break;
 
-                        /* fill chain of every hardware from frame */
-                        LedHardware *h;
-                        for(h = hw; h; h = led_hardware_list_get_next(h))
+                        /* blend from previous frame? */
+                        unsigned int steps = 0;
+                        if(prev_valid)
                         {
-                                if(!led_chain_fill_from_frame
-                                   (led_hardware_get_chain(h), frame))
+                                if(_c.crossfade && first_frame)
+                                        steps = _c.crossfade * _c.refresh /
+                                                1000;
+                                else if(_c.interpolate)
+                                        steps = _c.refresh / fps;
+
+                                /* frames held for their own time blend
+                                 * over the time the previous one is shown
+                                 * (interpolation) or at most that long
+                                 * (crossfade) */
+                                if(deadline_set)
                                 {
-                                        NFT_LOG(L_ERROR,
-                                                "Error while mapping frame");
-                                        break;
+                                        double span = _timespec_diff(&deadline,
+                                                                     &latch);
+                                        unsigned int fit = span > 0 ?
+                                                (unsigned int) (span *
+                                                                _c.refresh) :
+                                                0;
+                                        if(_c.interpolate &&
+                                           !(_c.crossfade && first_frame))
+                                                steps = fit;
+                                        else if(steps > fit)
+                                                steps = fit;
                                 }
                         }
+                        first_frame = false;
+
+                        bool sent = true;
+                        if(steps > 1)
+                        {
+                                size_t size = led_frame_get_buffersize(frame);
+                                memcpy(cur, buf, size);
+
+                                unsigned int k;
+                                for(k = 1; k < steps && _c.running; k++)
+                                {
+                                        /* steps end at the deadline of
+                                         * the frame (if it has one) */
+                                        struct timespec step = deadline;
+                                        if(deadline_set)
+                                                _timespec_add(&step,
+                                                              -(double)
+                                                              (steps -
+                                                               k) /
+                                                              _c.refresh);
+
+                                        blend_frames(buf, prev, cur, size,
+                                                     blend_size,
+                                                     (k << 16) / steps);
+                                        if(!(sent = _output_frame
+                                             (hw, out, dither, buf,
+                                              _c.refresh,
+                                              deadline_set ? &step :
+                                              NULL)))
+                                                break;
+                                }
 
-                        /* send frame to hardware(s) */
-                        NFT_LOG(L_DEBUG, "Sending frame");
-                        led_hardware_list_send(hw);
+                                memcpy(buf, cur, size);
+                        }
 
-                        /* delay in respect to fps */
-                        if(!led_fps_delay(_c.fps))
+                        /* output frame */
+                        if(!sent ||
+                           !_output_frame(hw, out, dither, buf,
+                                          _c.interpolate ? _c.refresh :
+                                          fps, deadline_set ? &deadline :
+                                          NULL))
                                 break;
 
-                        /* latch hardware */
-                        NFT_LOG(L_DEBUG, "Showing frame");
-                        led_hardware_list_show(hw);
+                        /* remember when frame was latched & for how long
+                         * it should be shown */
+                        if(deadline_set)
+                                latch = deadline;
+                        else
+                                clock_gettime(CLOCK_MONOTONIC, &latch);
+                        hold = _c.canvas ? 0 : delay;
+                        file_frame++;
 
-                        /* increase framecount */
-                        _c.frames_sent++;
+                        /* entry ends its duration after first frame */
+                        if(duration > 0 && !entry_end_set)
+                        {
+                                entry_end = latch;
+                                _timespec_add(&entry_end, duration);
+                                entry_end_set = true;
+                        }
 
-                        /* save time when frame is displayed */
-                        if(!led_fps_sample())
-                                break;
+                        /* remember frame to blend from */
+                        if(prev)
+                        {
+                                memcpy(prev, buf,
+                                       led_frame_get_buffersize(frame));
+                                prev_valid = true;
+                        }
 
-                        /* if frame is from cache, there are no more frames
-                         * since this can't be a stream */
-                        if(cached_frame_found)
-                                break;
+                        /* if frame is from cache, play next cached frame
+                         * of this file (if any) */
+                        if(cached_frame_found && !_c.canvas)
+                        {
+                                if(!(f = cache_frame_next(cache, f)))
+                                        break;
+
+                                _cached_copy(f, buf);
+                                delay = f->delay;
+                        }
 
                 }
 
                 /* close file if not from cache */
+                if(pack)
+                {
+                        pack_close(pack);
+                        pack = NULL;
+                }
+                else
+#if HAVE_LIBAV == 1
+                if(video)
+                {
+                        video_close(video);
+                        video = NULL;
+                }
+                else
+#endif
                 if(!cached_frame_found)
                 {
+                        if(!decoded_all)
+                                cache_file_drop(cache, file);
+
+                        region_close(_region);
+                        if(_c.fd != STDIN_FILENO)
+                                raw_reader_reset(_reader);
 #if HAVE_IMAGEMAGICK == 1
                         if(!_c.raw)
                                 im_close_stream(&_c);
-#else
-                        close(_c.fd);
+                        else
 #endif
+                        /* raw input (stdin stays open) */
+                        if(_c.fd != STDIN_FILENO)
+                        {
+                                close(_c.fd);
+                                _c.fd = -1;
+                        }
                 }
 
                 /* reset flag */
                 cached_frame_found = false;
 
-                /* loop endlessly? */
-                if((_c.running) &&                  // still running?
-                   _c.do_loop &&                    // do loop?
-                   (filecount+1 >= _c.filecount))   // last file?
+                /* show last frame until entry's duration is over */
+                if(entry_end_set)
                 {
-                        /* start over by resetting the for-loop */
-                        filecount = -1;
+                        double left = _timespec_diff(&entry_end, &latch);
+                        hold = left > 0 ? left : 0;
                 }
         }
 
+        /* hold last frame */
+        if(_c.running && hold > 0)
+        {
+                struct timespec deadline = latch;
+                _timespec_add(&deadline, hold);
+                if(!_keepalive(hw, &deadline) || !events_wait_until(_events, &deadline))
+                        goto m_deinit;
+        }
+
 
         /* all ok */
         res = EXIT_SUCCESS;
@@ -745,13 +2314,60 @@ int main(int argc, char *argv[])
 m_deinit:
         NFT_LOG(L_VERBOSE, "[%llu] frames sent", _c.frames_sent);
 
+#if HAVE_IMAGEMAGICK == 1
+        /* stop decode-ahead pool */
+        prefetch_destroy(prefetch);
+#endif
+
+        /* stop accepting jobs */
+        daemon_destroy(daemon);
+
+        /* free playlist */
+        playlist_destroy(playlist);
+
         /* free frame cache */
         if(!_c.no_caching)
                 cache_destroy(cache);
 
+        /* free color correction */
+        correction_destroy(correction);
+
+        /* free scaler */
+        scaler_destroy(_c.scaler);
+
+        /* free canvas */
+        canvas_destroy(_c.canvas);
+        region_destroy(_region);
+
+        /* free raw reader */
+        raw_reader_destroy(_reader);
+
+        /* free palette (after cache, its tables are played from there) */
+        palette_destroy(_palette);
+
+        /* free delta input */
+        delta_destroy(_delta);
+        dirty_destroy(_dirty);
+
+        /* free ditherer */
+        dither_destroy(dither);
+
+        /* free blend buffers */
+        free(prev);
+        free(cur);
+
         /* free setup */
         led_setup_destroy(s);
 
+        /* free additional setups */
+        for(o = 0; o < _c.outputcount; o++)
+                output_destroy(_outputs[o]);
+
+        /* stop watching prefs file */
+        Reload *reload = _reload;
+        _reload = NULL;
+        reload_destroy(reload);
+
         /* free frame */
         led_frame_destroy(frame);
 
@@ -763,5 +2379,11 @@ m_deinit:
         im_deinit(&_c);
 #endif
 
+        /* leave sync group */
+        sync_destroy(_sync);
+
+        /* free event loop */
+        events_destroy(_events);
+
         return res;
 }
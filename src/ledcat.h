@@ -46,6 +46,10 @@
 #define _LEDCAT_H
 
 
+/** maximum amount of setups fed from the same frame (besides the main one) */
+#define LEDCAT_MAX_OUTPUTS      7
+
+
 /** global structure to hold various information */
 struct Ledcat
 {
@@ -53,8 +57,24 @@ struct Ledcat
         bool                            running;
         /** name of preferences-file */
         char                            prefsfile[1024];
+        /** true if prefsfile was given on the commandline */
+        bool                            prefs_given;
+        /** prefs files of additional setups fed from the same frame */
+        char                            outputs[LEDCAT_MAX_OUTPUTS][1024];
+        /** filter to scale frames to each additional setup */
+        ScaleMode                       output_scale[LEDCAT_MAX_OUTPUTS];
+        /** amount of additional setups */
+        size_t                          outputcount;
         /** pixelformat of raw frame */
         char                            pixelformat[1024];
+        /** playlist file to play ("" = none) */
+        char                            playlist[1024];
+        /** unix socket to accept jobs on ("" = not running as daemon) */
+        char                            daemon[1024];
+        /** true to reload prefs file when it changes (or on SIGHUP) */
+        bool                            reload;
+        /** multicast group to sync with other instances ("" = off) */
+        char                            sync[64];
         /** array with filenames to cat */
         char                          **files;
         /** amount of filenames to cat */
@@ -65,16 +85,63 @@ struct Ledcat
         FILE                           *file;
         /** requested framerate */
         int                             fps;
+        /** framerate of the hardware while blending */
+        int                             refresh;
+        /** duration of crossfade between files in milliseconds */
+        int                             crossfade;
+        /** time to show every file in seconds (0 = until it ends) */
+        double                          duration;
+        /** interval to resend the shown frame while holding it in
+         * milliseconds (0 = off) */
+        int                             keepalive;
+        /** true to interpolate between frames at refresh rate */
+        bool                            interpolate;
         /** input frame width (in pixels) */
         LedFrameCord                    width;
         /** input frame height (in pixels) */
         LedFrameCord                    height;
         /** true if raw-input data is big-endian ordered */
         bool                            is_big_endian;
+        /** true if raw input is indexed (palette updates & index frames) */
+        bool                            palette;
+        /** true if raw input frames are changed pixel runs */
+        bool                            delta;
         /** true if we should endlessly loop through files */
         bool                            do_loop;
         /** true if caching should be disabled */
         bool                            no_caching;
+        /** true to back frame cache with huge pages */
+        bool                            hugepages;
+        /** filter used to scale input frames to frame dimensions */
+        ScaleMode                       scale;
+        /** scaler (NULL if input isn't scaled) */
+        Scaler                         *scaler;
+        /** left edge of region played of full-size input frames */
+        LedFrameCord                    region_x;
+        /** top edge of region */
+        LedFrameCord                    region_y;
+        /** region width (0 = play complete input frames) */
+        LedFrameCord                    region_width;
+        /** region height */
+        LedFrameCord                    region_height;
+        /** direction to scroll viewport over input images */
+        ScrollDirection                 scroll;
+        /** scroll speed in pixels per second (0 = one pixel per frame) */
+        double                          scroll_speed;
+        /** true to wrap around when scrolling */
+        bool                            wrap;
+        /** canvas input images are loaded to (NULL if not scrolling) */
+        Canvas                         *canvas;
+        /** gamma exponent applied to input frames (1.0 = off) */
+        double                          gamma;
+        /** brightness applied to input frames (0.0 - 1.0) */
+        double                          brightness;
+        /** white balance (gain of red, green & blue) */
+        double                          white[3];
+        /** true to temporally dither u16 input to 8 bit */
+        bool                            dither;
+        /** true to decode input files as video */
+        bool                            video;
 #if HAVE_IMAGEMAGICK == 1
         /** true to treat input as raw-data, false to use ImageMagick */
         bool                            raw;
@@ -84,9 +151,17 @@ struct Ledcat
         StorageType                     storage;
         /** ImageMagick wand */
         MagickWand                     *mw;
+        /** delay of last image read in seconds (0 = none) */
+        double                          delay;
+        /** GIF decoded frame by frame (NULL if not a GIF) */
+        Gif                            *gif;
+        /** true if mw holds a file decoded ahead that wasn't read yet */
+        bool                            preloaded;
+        /** amount of files to decode ahead (0 = off) */
+        unsigned int                    prefetch;
+#endif
         /** frames sent to LED setup */
         long long unsigned int          frames_sent;
-#endif
 };
 
 
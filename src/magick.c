@@ -51,6 +51,9 @@
 
 #include <unistd.h>
 #include <niftyled.h>
+#include "scale.h"
+#include "canvas.h"
+#include "gif.h"
 #include "ledcat.h"
 #include "magick.h"
 
@@ -126,6 +129,13 @@ NftResult im_open_stream(struct Ledcat *c)
                         NFT_LOG_PERROR("fdopen()");
                         return false;
                 }
+
+                /* decode GIF frame by frame instead of loading all frames */
+                if(gif_probe(c->file))
+                {
+                        if(!(c->gif = gif_open(c->file)))
+                                return false;
+                }
         }
 #endif
         return true;
@@ -137,15 +147,36 @@ NftResult im_open_stream(struct Ledcat *c)
  */
 void im_close_stream(struct Ledcat *c)
 {
+#if HAVE_IMAGEMAGICK == 1
+        /* stop GIF decoder */
+        gif_close(c->gif);
+        c->gif = NULL;
+#endif
+
         if(c->file)
         {
-                /* close stream */
+                /* close stream (closes the descriptor it wraps) */
                 fclose(c->file);
                 c->file = NULL;
+                c->fd = -1;
         }
 
-        /* close file */
-        close(c->fd);
+#if HAVE_IMAGEMAGICK == 1
+        /* drop images that weren't read (of a file cut short or decoded
+         * ahead), so the next file doesn't continue with them */
+        c->preloaded = false;
+        ClearMagickWand(c->mw);
+        MagickSetAntialias(c->mw, false);
+        MagickSetInterpolateMethod(c->mw, IntegerInterpolatePixel);
+#endif
+
+        /* close file (not opened if file was decoded ahead, already
+         * closed if a stream wrapped it) */
+        if(c->fd >= 0)
+        {
+                close(c->fd);
+                c->fd = -1;
+        }
 }
 
 
@@ -158,7 +189,8 @@ NftResult im_format(struct Ledcat *c, LedPixelFormat * format)
 
         /* determine map format for MagickGetImagePixels */
         strncpy(c->map, led_pixel_format_colorspace_to_string(format),
-                sizeof(c->map));
+                sizeof(c->map) - 1);
+        c->map[sizeof(c->map) - 1] = '\0';
 
         /* copy string to tmp buffer */
         char type[16];
@@ -198,15 +230,41 @@ NftResult im_read_frame(struct Ledcat * c, size_t width, size_t height,
 {
 #if HAVE_IMAGEMAGICK == 1
 
+        /* decode next frame of GIF stream */
+        if(c->gif)
+        {
+                double delay;
+                if(!gif_read_frame(c->gif, &delay))
+                        return false;
+
+                LedFrameCord w, h;
+                gif_get_dim(c->gif, &w, &h);
+                ClearMagickWand(c->mw);
+                if(!MagickConstituteImage(c->mw, w, h, "RGBA", CharPixel,
+                                          gif_get_pixels(c->gif)))
+                {
+                        im_error(c->mw);
+                        return false;
+                }
+                c->delay = delay;
+        }
         /* is there an image from a previous read? */
-        if(MagickHasNextImage(c->mw))
+        else if(MagickHasNextImage(c->mw))
         {
                 MagickNextImage(c->mw);
         }
+        /* file was already decoded ahead? */
+        else if(c->preloaded)
+        {
+                c->preloaded = false;
+
+                /* start with first image */
+                MagickSetFirstIterator(c->mw);
+        }
         else
         {
                 /* end-of-stream? */
-                if(feof(c->file))
+                if(!c->file || feof(c->file))
                         return false;
 
                 /* read file */
@@ -216,8 +274,16 @@ NftResult im_read_frame(struct Ledcat * c, size_t width, size_t height,
                         return false;
                 }
 
-                /* reset iterator in case we read more than one file */
-                // MagickResetIterator(c->mw);
+                /* start with first image (of an animation) */
+                MagickSetFirstIterator(c->mw);
+        }
+
+        /* delay of this image (0 if it has none) */
+        if(!c->gif)
+        {
+                size_t ticks = MagickGetImageTicksPerSecond(c->mw);
+                c->delay = ticks ? (double) MagickGetImageDelay(c->mw) /
+                        (double) ticks : 0;
         }
 
 
@@ -227,8 +293,43 @@ NftResult im_read_frame(struct Ledcat * c, size_t width, size_t height,
          * PixelSetColor(pw, "black"); MagickSetImageBackgroundColor(c->mw,
          * pw); DestroyPixelWand(pw); */
 
-        /* get raw-buffer from imagemagick */
-        if(!
+        /* load whole image as canvas? */
+        if(c->canvas)
+        {
+                size_t w = MagickGetImageWidth(c->mw);
+                size_t h = MagickGetImageHeight(c->mw);
+                void *dst;
+                if(!(dst = canvas_get_buffer(c->canvas, w, h)))
+                        return false;
+
+                if(!(MagickExportImagePixels
+                     (c->mw, 0, 0, w, h, c->map, c->storage, dst)))
+                {
+                        im_error(c->mw);
+                        return false;
+                }
+        }
+        /* scale whole image to frame dimensions? */
+        else if(c->scaler)
+        {
+                size_t w = MagickGetImageWidth(c->mw);
+                size_t h = MagickGetImageHeight(c->mw);
+                void *src;
+                if(!(src = scaler_get_buffer(c->scaler, w, h)))
+                        return false;
+
+                if(!(MagickExportImagePixels
+                     (c->mw, 0, 0, w, h, c->map, c->storage, src)))
+                {
+                        im_error(c->mw);
+                        return false;
+                }
+
+                if(!scaler_run(c->scaler, src, w, h, buf))
+                        return false;
+        }
+        /* get raw-buffer from imagemagick (crop to frame dimensions) */
+        else if(!
            (MagickExportImagePixels
             (c->mw, 0, 0, width, height, c->map, c->storage, buf)))
         {
@@ -0,0 +1,308 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Every frame is decoded once & filled into the chains of all setups.
+ * Setups with other dimensions than the frame get their own frame the
+ * output frame is scaled to. All setups are sent before the deadline of
+ * a frame & latched right after each other.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <niftyled.h>
+#include "scale.h"
+#include "events.h"
+#include "raw.h"
+#include "reload.h"
+#include "output.h"
+
+
+
+/** one additional setup */
+struct _Output
+{
+        /** prefs file of setup */
+        char prefsfile[1024];
+        /** setup */
+        LedSetup *s;
+        /** list of LED hardware adapters of setup */
+        LedHardware *hw;
+        /** frame the chains are filled from (own frame if scaled) */
+        LedFrame *frame;
+        /** scaler from output frame to own frame (NULL if not scaled) */
+        Scaler *scaler;
+        /** true if frame belongs to us */
+        bool own_frame;
+        /** thread reloading prefs file (NULL if not watching it) */
+        Reload *reload;
+};
+
+
+
+/**
+ * create setup from prefs file & map it to the output frame
+ *
+ * @param p preferences context
+ * @param prefsfile prefs file of setup
+ * @param out frame the main setup is filled from
+ * @param mode filter to scale out to the dimensions of this setup
+ *        (SCALE_NONE if they must be equal)
+ * @param reload true to rebuild setup when prefs file changes
+ * @result new output or NULL upon error
+ */
+Output *output_new(LedPrefs * p, const char *prefsfile, LedFrame * out,
+                   ScaleMode mode, bool reload)
+{
+        if(!p || !prefsfile || !out)
+                return NULL;
+
+        Output *o;
+        if(!(o = calloc(1, sizeof(Output))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+        strncpy(o->prefsfile, prefsfile, sizeof(o->prefsfile) - 1);
+
+        /* parse prefs-file */
+        LedPrefsNode *pnode;
+        if(!(pnode = led_prefs_node_from_file(p, prefsfile)))
+        {
+                NFT_LOG(L_ERROR, "Failed to open configfile \"%s\"",
+                        prefsfile);
+                goto _on_error;
+        }
+
+        o->s = led_prefs_setup_from_node(p, pnode);
+        led_prefs_node_free(pnode);
+        if(!o->s)
+        {
+                NFT_LOG(L_ERROR, "No valid setup found in \"%s\".",
+                        prefsfile);
+                goto _on_error;
+        }
+
+        /* scale to setup dimensions? */
+        LedFrameCord w, h, ow, oh;
+        if(!led_setup_get_dim(o->s, &w, &h) ||
+           !led_frame_get_dim(out, &ow, &oh))
+                goto _on_error;
+
+        o->frame = out;
+        if(w != ow || h != oh)
+        {
+                if(mode == SCALE_NONE)
+                {
+                        NFT_LOG(L_ERROR,
+                                "Setup \"%s\" is %dx%d but frames are %dx%d (use --config %s,box or %s,bilinear)",
+                                prefsfile, w, h, ow, oh, prefsfile,
+                                prefsfile);
+                        goto _on_error;
+                }
+
+                LedPixelFormat *f = led_frame_get_format(out);
+                if(!(o->frame = led_frame_new(w, h, f)))
+                        goto _on_error;
+                o->own_frame = true;
+                if(!(o->scaler = scaler_new(mode, f, w, h)))
+                        goto _on_error;
+                led_frame_set_big_endian(o->frame,
+                                         !raw_is_native_endian(false));
+
+                NFT_LOG(L_INFO, "Scaling frames to %dx%d for \"%s\" (%s)",
+                        w, h, prefsfile, scale_mode_to_string(mode));
+        }
+
+        /* initialize pixel->led mapping */
+        if(!(o->hw = led_setup_get_hardware(o->s)) ||
+           !led_hardware_list_refresh_mapping(o->hw))
+                goto _on_error;
+
+        /* precalc memory offsets for actual mapping */
+        LedHardware *ch;
+        for(ch = o->hw; ch; ch = led_hardware_list_get_next(ch))
+        {
+                if(!led_chain_map_from_frame
+                   (led_hardware_get_chain(ch), o->frame))
+                        goto _on_error;
+        }
+
+        /* set correct gain to hardware */
+        if(!led_hardware_list_refresh_gain(o->hw))
+                goto _on_error;
+
+        if(reload && !(o->reload = reload_new(prefsfile, o->frame, w, h)))
+                goto _on_error;
+
+        return o;
+
+_on_error:
+        output_destroy(o);
+        return NULL;
+}
+
+
+/**
+ * fill chains from output frame & send them (without latching)
+ */
+NftResult output_send(Output * o, LedFrame * out)
+{
+        if(!o || !out)
+                return NFT_FAILURE;
+
+        /* resample to our frame */
+        if(o->scaler)
+        {
+                LedFrameCord w, h;
+                if(!led_frame_get_dim(out, &w, &h) ||
+                   !scaler_run(o->scaler, led_frame_get_buffer(out), w, h,
+                               led_frame_get_buffer(o->frame)))
+                        return NFT_FAILURE;
+        }
+
+        LedHardware *h;
+        for(h = o->hw; h; h = led_hardware_list_get_next(h))
+        {
+                if(!led_chain_fill_from_frame(led_hardware_get_chain(h),
+                                              o->frame))
+                {
+                        NFT_LOG(L_ERROR, "Error while mapping frame for \"%s\"",
+                                o->prefsfile);
+                        break;
+                }
+        }
+
+        led_hardware_list_send(o->hw);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * latch frame sent last
+ */
+void output_show(Output * o)
+{
+        if(!o)
+                return;
+
+        led_hardware_list_show(o->hw);
+}
+
+
+/**
+ * resend & latch the frame shown (hardware chains still hold it)
+ */
+void output_refresh(Output * o)
+{
+        if(!o)
+                return;
+
+        led_hardware_list_send(o->hw);
+        led_hardware_list_show(o->hw);
+}
+
+
+/**
+ * reload prefs file now (if watching it)
+ */
+void output_reload(Output * o)
+{
+        if(!o)
+                return;
+
+        reload_trigger(o->reload);
+}
+
+
+/**
+ * use reloaded setup from now on (called between frames)
+ */
+void output_swap(Output * o)
+{
+        if(!o)
+                return;
+
+        if(!reload_swap(o->reload, &o->s))
+                return;
+
+        o->hw = led_setup_get_hardware(o->s);
+
+        /* fill new chains from the frame shown (already scaled to our
+         * frame, reloaded setups keep its dimensions). Keepalive & paused
+         * refreshes resend them before the next frame is sent */
+        LedHardware *h;
+        for(h = o->hw; h; h = led_hardware_list_get_next(h))
+        {
+                if(!led_chain_fill_from_frame(led_hardware_get_chain(h),
+                                              o->frame))
+                {
+                        NFT_LOG(L_ERROR, "Error while mapping frame for \"%s\"",
+                                o->prefsfile);
+                        break;
+                }
+        }
+}
+
+
+/**
+ * free output
+ */
+void output_destroy(Output * o)
+{
+        if(!o)
+                return;
+
+        if(o->s)
+                led_setup_destroy(o->s);
+        reload_destroy(o->reload);
+        scaler_destroy(o->scaler);
+        if(o->own_frame)
+                led_frame_destroy(o->frame);
+        free(o);
+}
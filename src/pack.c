@@ -0,0 +1,514 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <niftyled.h>
+#include "pack.h"
+
+
+/** file magic */
+#define PACK_MAGIC              "LEDPACK"
+/** size of header */
+#define PACK_HEADER_SIZE        128
+/** size of one index entry */
+#define PACK_ENTRY_SIZE         16
+/** size of pixelformat string */
+#define PACK_FORMAT_SIZE        64
+
+
+/** mapped archive */
+struct _Pack
+{
+        /** mapping of whole file */
+        const uint8_t *map;
+        /** size of mapping */
+        size_t map_size;
+        /** frame dimensions */
+        LedFrameCord width, height;
+        /** flags from header */
+        uint32_t flags;
+        /** amount of frames */
+        size_t frames;
+        /** size of one frame */
+        size_t frame_size;
+        /** index */
+        const uint8_t *index;
+        /** pixelformat (NULL terminated) */
+        char format[PACK_FORMAT_SIZE + 1];
+};
+
+
+/** archive being written */
+struct _PackWriter
+{
+        /** output file */
+        FILE *file;
+        /** header values */
+        LedFrameCord width, height;
+        uint32_t flags;
+        size_t frame_size;
+        char format[PACK_FORMAT_SIZE];
+        /** current write offset */
+        uint64_t offset;
+        /** index (grows with every frame) */
+        uint8_t *index;
+        /** amount of frames written */
+        size_t frames;
+        /** amount of entries index has space for */
+        size_t index_size;
+};
+
+
+
+static uint32_t _get32(const uint8_t * b)
+{
+        return (uint32_t) b[0] | ((uint32_t) b[1] << 8) |
+                ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24);
+}
+
+
+static uint64_t _get64(const uint8_t * b)
+{
+        return (uint64_t) _get32(b) | ((uint64_t) _get32(b + 4) << 32);
+}
+
+
+static void _put32(uint8_t * b, uint32_t v)
+{
+        b[0] = v;
+        b[1] = v >> 8;
+        b[2] = v >> 16;
+        b[3] = v >> 24;
+}
+
+
+static void _put64(uint8_t * b, uint64_t v)
+{
+        _put32(b, (uint32_t) v);
+        _put32(b + 4, (uint32_t) (v >> 32));
+}
+
+
+/** write padding so offset is aligned */
+static NftResult _pad(PackWriter * w, size_t align)
+{
+        static const uint8_t zero[PACK_ALIGN];
+        size_t pad = (align - w->offset % align) % align;
+        if(pad && fwrite(zero, 1, pad, w->file) != pad)
+        {
+                NFT_LOG_PERROR("fwrite()");
+                return NFT_FAILURE;
+        }
+        w->offset += pad;
+        return NFT_SUCCESS;
+}
+
+
+
+/**
+ * check if file is a pack archive
+ *
+ * @param fd file descriptor (position is not changed)
+ * @result true if file starts with pack magic
+ */
+bool pack_probe(int fd)
+{
+        char magic[sizeof(PACK_MAGIC)];
+        if(pread(fd, magic, sizeof(magic), 0) != sizeof(magic))
+                return false;
+
+        return memcmp(magic, PACK_MAGIC, sizeof(magic)) == 0;
+}
+
+
+/**
+ * map archive into memory
+ *
+ * @param fd file descriptor of archive (may be closed afterwards)
+ * @result archive or NULL upon error
+ */
+Pack *pack_open(int fd)
+{
+        struct stat st;
+        if(fstat(fd, &st) != 0)
+        {
+                NFT_LOG_PERROR("fstat()");
+                return NULL;
+        }
+
+        if(st.st_size < PACK_HEADER_SIZE)
+        {
+                NFT_LOG(L_ERROR, "Archive truncated");
+                return NULL;
+        }
+
+        Pack *p;
+        if(!(p = calloc(1, sizeof(Pack))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        p->map_size = st.st_size;
+        void *map;
+        if((map = mmap(NULL, p->map_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+           MAP_FAILED)
+        {
+                NFT_LOG_PERROR("mmap()");
+                free(p);
+                return NULL;
+        }
+        p->map = map;
+
+        /* frames are mostly read in order */
+        madvise(map, p->map_size, MADV_SEQUENTIAL);
+
+        /* parse header */
+        const uint8_t *h = p->map;
+        if(memcmp(h, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+           _get32(h + 8) != PACK_VERSION)
+        {
+                NFT_LOG(L_ERROR, "Unsupported archive (version %u)",
+                        _get32(h + 8));
+                goto _po_error;
+        }
+        p->flags = _get32(h + 12);
+        p->width = _get32(h + 16);
+        p->height = _get32(h + 20);
+        uint64_t frames = _get64(h + 24);
+        p->frame_size = _get64(h + 32);
+        uint64_t index = _get64(h + 40);
+        memcpy(p->format, h + 48, PACK_FORMAT_SIZE);
+
+        /* validate index */
+        if(p->width <= 0 || p->height <= 0 || !p->frame_size ||
+           index > p->map_size ||
+           frames > (p->map_size - index) / PACK_ENTRY_SIZE)
+        {
+                NFT_LOG(L_ERROR, "Archive corrupt");
+                goto _po_error;
+        }
+        p->frames = frames;
+        p->index = p->map + index;
+
+        size_t i;
+        for(i = 0; i < p->frames; i++)
+        {
+                uint64_t offset = _get64(p->index + i * PACK_ENTRY_SIZE);
+                if(offset > p->map_size ||
+                   p->frame_size > p->map_size - offset)
+                {
+                        NFT_LOG(L_ERROR, "Archive corrupt (frame %zu)", i);
+                        goto _po_error;
+                }
+        }
+
+        NFT_LOG(L_DEBUG, "Mapped archive: %zu frames %dx%d (%s)",
+                p->frames, p->width, p->height, p->format);
+
+        return p;
+
+_po_error:
+        pack_close(p);
+        return NULL;
+}
+
+
+/**
+ * get frame dimensions of archive
+ */
+void pack_get_dim(Pack * p, LedFrameCord * width, LedFrameCord * height)
+{
+        *width = p->width;
+        *height = p->height;
+}
+
+
+/**
+ * get pixelformat string of archive
+ */
+const char *pack_get_format(Pack * p)
+{
+        return p->format;
+}
+
+
+/**
+ * true if frame data in archive is big-endian
+ */
+bool pack_is_big_endian(Pack * p)
+{
+        return p->flags & PACK_BIG_ENDIAN;
+}
+
+
+/**
+ * get size of one frame in bytes
+ */
+size_t pack_get_frame_size(Pack * p)
+{
+        return p->frame_size;
+}
+
+
+/**
+ * get amount of frames in archive
+ */
+size_t pack_get_frame_count(Pack * p)
+{
+        return p->frames;
+}
+
+
+/**
+ * get frame from archive (without copying)
+ *
+ * @param p archive
+ * @param n index of frame
+ * @param delay time to show frame in seconds (0 = none)
+ * @result pointer to frame data or NULL if n is out of range
+ */
+const void *pack_get_frame(Pack * p, size_t n, double *delay)
+{
+        if(n >= p->frames)
+                return NULL;
+
+        const uint8_t *e = p->index + n * PACK_ENTRY_SIZE;
+        *delay = _get32(e + 8) / 1000000.0;
+        return p->map + _get64(e);
+}
+
+
+/**
+ * unmap archive
+ */
+void pack_close(Pack * p)
+{
+        if(!p)
+                return;
+
+        if(p->map)
+                munmap((void *) p->map, p->map_size);
+
+        free(p);
+}
+
+
+
+/**
+ * start writing an archive
+ *
+ * @param filename file to create
+ * @param width width of frames
+ * @param height height of frames
+ * @param format pixelformat string of frames
+ * @param big_endian true if frame data is big-endian
+ * @param frame_size size of one frame in bytes
+ * @result writer or NULL upon error
+ */
+PackWriter *pack_writer_new(const char *filename, LedFrameCord width,
+                            LedFrameCord height, const char *format,
+                            bool big_endian, size_t frame_size)
+{
+        if(strlen(format) >= PACK_FORMAT_SIZE)
+        {
+                NFT_LOG(L_ERROR, "Pixelformat \"%s\" too long", format);
+                return NULL;
+        }
+
+        PackWriter *w;
+        if(!(w = calloc(1, sizeof(PackWriter))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        w->width = width;
+        w->height = height;
+        w->flags = big_endian ? PACK_BIG_ENDIAN : 0;
+        w->frame_size = frame_size;
+        strncpy(w->format, format, sizeof(w->format) - 1);
+        w->format[sizeof(w->format) - 1] = '\0';
+
+        if(!(w->file = fopen(filename, "wb")))
+        {
+                NFT_LOG(L_ERROR, "Failed to create \"%s\"", filename);
+                free(w);
+                return NULL;
+        }
+
+        /* reserve header (written when closing) */
+        uint8_t header[PACK_HEADER_SIZE] = { 0 };
+        if(fwrite(header, 1, sizeof(header), w->file) != sizeof(header))
+        {
+                NFT_LOG_PERROR("fwrite()");
+                fclose(w->file);
+                free(w);
+                return NULL;
+        }
+        w->offset = sizeof(header);
+
+        return w;
+}
+
+
+/**
+ * append frame to archive
+ *
+ * @param w writer
+ * @param frame frame data (frame_size bytes)
+ * @param delay time to show frame in seconds (0 = none)
+ * @result NFT_SUCCESS or NFT_FAILURE
+ */
+NftResult pack_writer_add(PackWriter * w, const void *frame, double delay)
+{
+        /* grow index */
+        if(w->frames >= w->index_size)
+        {
+                size_t size = w->index_size ? w->index_size * 2 : 256;
+                uint8_t *tmp;
+                if(!(tmp = realloc(w->index, size * PACK_ENTRY_SIZE)))
+                {
+                        NFT_LOG_PERROR("realloc()");
+                        return NFT_FAILURE;
+                }
+                w->index = tmp;
+                w->index_size = size;
+        }
+
+        if(!_pad(w, PACK_ALIGN))
+                return NFT_FAILURE;
+
+        if(fwrite(frame, 1, w->frame_size, w->file) != w->frame_size)
+        {
+                NFT_LOG_PERROR("fwrite()");
+                return NFT_FAILURE;
+        }
+
+        uint8_t *e = w->index + w->frames * PACK_ENTRY_SIZE;
+        _put64(e, w->offset);
+        _put32(e + 8, delay > 0 ? (uint32_t) (delay * 1000000.0 + 0.5) : 0);
+        _put32(e + 12, 0);
+
+        w->offset += w->frame_size;
+        w->frames++;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * get amount of frames written so far
+ */
+size_t pack_writer_get_frame_count(PackWriter * w)
+{
+        return w->frames;
+}
+
+
+/**
+ * write index & header and close archive
+ *
+ * @param w writer (freed)
+ * @result NFT_SUCCESS or NFT_FAILURE
+ */
+NftResult pack_writer_close(PackWriter * w)
+{
+        if(!w)
+                return NFT_FAILURE;
+
+        NftResult r = NFT_FAILURE;
+
+        /* index */
+        if(!_pad(w, 8))
+                goto _pwc_exit;
+        uint64_t index = w->offset;
+        if(w->frames &&
+           fwrite(w->index, PACK_ENTRY_SIZE, w->frames, w->file) != w->frames)
+        {
+                NFT_LOG_PERROR("fwrite()");
+                goto _pwc_exit;
+        }
+
+        /* header */
+        uint8_t h[PACK_HEADER_SIZE] = { 0 };
+        memcpy(h, PACK_MAGIC, sizeof(PACK_MAGIC));
+        _put32(h + 8, PACK_VERSION);
+        _put32(h + 12, w->flags);
+        _put32(h + 16, w->width);
+        _put32(h + 20, w->height);
+        _put64(h + 24, w->frames);
+        _put64(h + 32, w->frame_size);
+        _put64(h + 40, index);
+        memcpy(h + 48, w->format, PACK_FORMAT_SIZE);
+
+        if(fseek(w->file, 0, SEEK_SET) != 0 ||
+           fwrite(h, 1, sizeof(h), w->file) != sizeof(h))
+        {
+                NFT_LOG_PERROR("fwrite()");
+                goto _pwc_exit;
+        }
+
+        r = NFT_SUCCESS;
+
+_pwc_exit:
+        if(fclose(w->file) != 0)
+        {
+                NFT_LOG_PERROR("fclose()");
+                r = NFT_FAILURE;
+        }
+        free(w->index);
+        free(w);
+        return r;
+}
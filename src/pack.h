@@ -0,0 +1,94 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PACK_H
+#define _PACK_H
+
+
+/**
+ * ledcat pack archive: frames pre-decoded to a pixelformat, played by
+ * mapping the file into memory. All integers are little-endian.
+ *
+ *   header (128 bytes):
+ *     0  "LEDPACK\0"
+ *     8  u32 version
+ *    12  u32 flags (PACK_BIG_ENDIAN if frame data is big-endian)
+ *    16  u32 width, u32 height
+ *    24  u64 amount of frames
+ *    32  u64 size of one frame in bytes
+ *    40  u64 offset of index
+ *    48  char[64] pixelformat string
+ *   frames (each aligned to PACK_ALIGN bytes)
+ *   index (16 bytes per frame):
+ *     u64 offset of frame, u32 delay in microseconds (0 = none), u32 0
+ */
+#define PACK_VERSION            1
+/** frame data is big-endian */
+#define PACK_BIG_ENDIAN         (1 << 0)
+/** alignment of frames in archive */
+#define PACK_ALIGN              64
+
+
+/** archive mapped for playback */
+typedef struct _Pack            Pack;
+/** archive being written */
+typedef struct _PackWriter      PackWriter;
+
+
+bool                            pack_probe(int fd);
+Pack                           *pack_open(int fd);
+void                            pack_get_dim(Pack * p, LedFrameCord * width, LedFrameCord * height);
+const char                     *pack_get_format(Pack * p);
+bool                            pack_is_big_endian(Pack * p);
+size_t                          pack_get_frame_size(Pack * p);
+size_t                          pack_get_frame_count(Pack * p);
+const void                     *pack_get_frame(Pack * p, size_t n, double *delay);
+void                            pack_close(Pack * p);
+
+PackWriter                     *pack_writer_new(const char *filename, LedFrameCord width, LedFrameCord height, const char *format, bool big_endian, size_t frame_size);
+NftResult                       pack_writer_add(PackWriter * w, const void *frame, double delay);
+size_t                          pack_writer_get_frame_count(PackWriter * w);
+NftResult                       pack_writer_close(PackWriter * w);
+
+
+#endif /** _PACK_H */
@@ -0,0 +1,406 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <niftyled.h>
+#include "simd.h"
+#include "events.h"
+#include "raw.h"
+#include "correction.h"
+#include "palette.h"
+
+
+/** amount of palette entries (8-bit indices) */
+#define PALETTE_ENTRIES         256
+
+
+/** immutable color table (cached frames keep referring to theirs) */
+struct _PaletteTable
+{
+        /** previously used table */
+        struct _PaletteTable *prev;
+        /** size of one pixel in bytes */
+        size_t bpp;
+        /** size of one entry in bytes (bpp padded to 4 or 8 bytes, so
+         * entries can be copied with one load & store) */
+        size_t stride;
+        /** PALETTE_ENTRIES * stride bytes */
+        uint8_t *lut;
+};
+
+
+/** indexed input descriptor */
+struct _Palette
+{
+        /** size of one pixel in bytes */
+        size_t bpp;
+        /** component size to convert entries to native byte order (0 =
+         * native) */
+        size_t swap_size;
+        /** applied to entries once when they're set (NULL = none) */
+        Correction *correction;
+        /** true to keep tables that were replaced (for cached frames) */
+        bool retain;
+        /** current table */
+        PaletteTable *table;
+        /** aligned copy of entries being set */
+        void *entries;
+        /** index frame read last */
+        uint8_t *index;
+};
+
+
+
+/** create table (copy of current one, if any) */
+static PaletteTable *_table_new(Palette * p)
+{
+        PaletteTable *t;
+        if(!(t = calloc(1, sizeof(PaletteTable))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        t->bpp = p->bpp;
+        t->stride = p->bpp <= 4 ? 4 : (p->bpp <= 8 ? 8 : p->bpp);
+
+        if(!(t->lut = calloc(PALETTE_ENTRIES, t->stride)))
+        {
+                NFT_LOG_PERROR("calloc()");
+                free(t);
+                return NULL;
+        }
+
+        if(p->table)
+                memcpy(t->lut, p->table->lut, PALETTE_ENTRIES * t->stride);
+        t->prev = p->table;
+        p->table = t;
+
+        return t;
+}
+
+
+/** set entries of the current palette */
+static NftResult _update(Palette * p, size_t first, size_t count,
+                         const char *src)
+{
+        size_t size = count * p->bpp;
+
+        /* native byte order, color corrected (records aren't aligned) */
+        char *entries = memcpy(p->entries, src, size);
+        if(p->swap_size > 1)
+                raw_swap_frame(entries, size, p->swap_size);
+        if(p->correction)
+                correction_apply(p->correction, entries, size);
+
+        /* nothing changed? */
+        PaletteTable *t = p->table;
+        size_t i;
+        for(i = 0; i < count; i++)
+        {
+                if(memcmp(t->lut + (first + i) * t->stride,
+                          entries + i * p->bpp, p->bpp) != 0)
+                        break;
+        }
+        if(i == count)
+                return NFT_SUCCESS;
+
+        /* frames expanded with current table may be cached */
+        if(p->retain && !(t = _table_new(p)))
+                return NFT_FAILURE;
+
+        for(i = 0; i < count; i++)
+                memcpy(t->lut + (first + i) * t->stride,
+                       entries + i * p->bpp, p->bpp);
+
+        return NFT_SUCCESS;
+}
+
+
+#if SIMD_AVX2
+/** 
+ * expand 8 pixels per step by gathering 4-byte entries
+ *
+ * @result amount of pixels expanded 
+ */
+static size_t _expand_gather(const PaletteTable * t, const uint8_t * index,
+                             size_t n, uint8_t * dst)
+{
+        size_t bpp = t->bpp;
+
+        /* pack first bpp bytes of every entry (per 128-bit lane) */
+        int8_t pattern[32];
+        size_t j;
+        for(j = 0; j < 32; j++)
+        {
+                size_t k = j % 16;
+                pattern[j] = k < 4 * bpp ? (int8_t) ((k / bpp) * 4 +
+                                                     k % bpp) : -1;
+        }
+        __m256i pack = _mm256_loadu_si256((__m256i *) pattern);
+
+        /* every lane is stored as 16 bytes, the second store of a step
+         * ends 16 - 4 * bpp bytes behind it (overwritten by the next one) */
+        size_t i;
+        for(i = 0; i + 8 <= n && (n - i) * bpp >= 4 * bpp + 16; i += 8)
+        {
+                __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)
+                                                                 (index +
+                                                                  i)));
+                __m256i v = _mm256_i32gather_epi32((const int *) t->lut, x,
+                                                   4);
+                v = _mm256_shuffle_epi8(v, pack);
+                _mm_storeu_si128((__m128i *) (dst + i * bpp),
+                                 _mm256_castsi256_si128(v));
+                _mm_storeu_si128((__m128i *) (dst + i * bpp + 4 * bpp),
+                                 _mm256_extracti128_si256(v, 1));
+        }
+
+        return i;
+}
+#endif
+
+
+
+/**
+ * create indexed input state
+ *
+ * @param f pixelformat of palette entries (and of expanded frames)
+ * @param swap_size component size to convert entries to native byte order
+ *        (0 = native)
+ * @param correction applied to entries when they're set (NULL = none)
+ * @param retain true to keep replaced tables valid (so frames can be
+ *        cached as indices)
+ * @result newly allocated palette (all entries black) or NULL
+ */
+Palette *palette_new(LedPixelFormat * f, size_t swap_size,
+                     Correction * correction, bool retain)
+{
+        Palette *p;
+        if(!(p = calloc(1, sizeof(Palette))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        p->bpp = led_pixel_format_get_bytes_per_pixel(f);
+        p->swap_size = swap_size;
+        p->correction = correction;
+        p->retain = retain;
+
+        if(!(p->entries = malloc(PALETTE_ENTRIES * p->bpp)))
+        {
+                NFT_LOG_PERROR("malloc()");
+                free(p);
+                return NULL;
+        }
+
+        if(!_table_new(p))
+        {
+                free(p->entries);
+                free(p);
+                return NULL;
+        }
+
+        NFT_LOG(L_INFO, "Indexed input: %d entries of %zu bytes (%s)",
+                PALETTE_ENTRIES, p->bpp,
+#if SIMD_AVX2
+                p->bpp <= 4 ? SIMD_NAME : "lookup-table"
+#else
+                "lookup-table"
+#endif
+                );
+
+        return p;
+}
+
+
+/**
+ * read records until the next index frame (applying palette updates)
+ *
+ * @param p palette acquired by palette_new()
+ * @param reader reader to read records with
+ * @param pixels amount of pixels of one frame
+ * @result index frame (valid until next read) or NULL at end of file or
+ *         on error
+ */
+uint8_t *palette_read_frame(Palette * p, RawReader * reader, Events * events,
+                            bool * running, int fd, size_t pixels)
+{
+        for(;;)
+        {
+                char *tag;
+                if(!(tag = raw_reader_frame(reader, events, running, fd, 1)))
+                        return NULL;
+
+                switch (*tag)
+                {
+                        case PALETTE_TAG_FRAME:
+                        {
+                                p->index = (uint8_t *)
+                                        raw_reader_frame(reader, events,
+                                                         running, fd, pixels);
+                                return p->index;
+                        }
+
+                        case PALETTE_TAG_UPDATE:
+                        {
+                                uint8_t *h;
+                                if(!(h = (uint8_t *)
+                                     raw_reader_frame(reader, events, running,
+                                                      fd, 2)))
+                                        return NULL;
+
+                                size_t first = h[0], count = h[1] + 1;
+                                if(first + count > PALETTE_ENTRIES)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Palette update of entries %zu - %zu exceeds %d entries",
+                                                first, first + count - 1,
+                                                PALETTE_ENTRIES);
+                                        return NULL;
+                                }
+
+                                char *entries;
+                                if(!(entries = raw_reader_frame(reader, events,
+                                                                running, fd,
+                                                                count *
+                                                                p->bpp)) ||
+                                   !_update(p, first, count, entries))
+                                        return NULL;
+                                break;
+                        }
+
+                        default:
+                        {
+                                NFT_LOG(L_ERROR,
+                                        "Invalid record in indexed input (tag 0x%02x)",
+                                        (uint8_t) * tag);
+                                return NULL;
+                        }
+                }
+        }
+}
+
+
+/**
+ * get index frame read last (valid until next read)
+ */
+uint8_t *palette_get_index(Palette * p)
+{
+        return p->index;
+}
+
+
+/**
+ * get current color table (stays valid until palette is destroyed if
+ * it was created to retain tables)
+ */
+const PaletteTable *palette_get_table(Palette * p)
+{
+        return p->table;
+}
+
+
+/**
+ * expand index frame to pixels
+ *
+ * @param t color table
+ * @param index 8-bit indices
+ * @param n amount of pixels
+ * @param dst buffer of n pixels
+ */
+void palette_expand(const PaletteTable * t, const uint8_t * index, size_t n,
+                    void *dst)
+{
+        uint8_t *d = dst;
+        size_t bpp = t->bpp;
+        size_t i = 0;
+
+#if SIMD_AVX2
+        /* (gathering 8-byte entries isn't faster than copying them) */
+        if(t->stride == 4)
+                i = _expand_gather(t, index, n, d);
+#endif
+
+        /* copy whole (padded) entries, the padding is overwritten by the
+         * next pixel. The last pixels are copied exactly */
+        size_t padded = n * bpp >= t->stride ?
+                (n * bpp - t->stride) / bpp + 1 : 0;
+        if(t->stride == 4)
+        {
+                for(; i < padded; i++)
+                        memcpy(d + i * bpp, t->lut + index[i] * 4, 4);
+        }
+        else if(t->stride == 8)
+        {
+                for(; i < padded; i++)
+                        memcpy(d + i * bpp, t->lut + index[i] * 8, 8);
+        }
+
+        for(; i < n; i++)
+                memcpy(d + i * bpp, t->lut + index[i] * t->stride, bpp);
+}
+
+
+/**
+ * free palette and all its tables
+ */
+void palette_destroy(Palette * p)
+{
+        if(!p)
+                return;
+
+        PaletteTable *t, *prev;
+        for(t = p->table; t; t = prev)
+        {
+                prev = t->prev;
+                free(t->lut);
+                free(t);
+        }
+
+        free(p->entries);
+        free(p);
+}
@@ -0,0 +1,76 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PALETTE_H
+#define _PALETTE_H
+
+
+/**
+ * Indexed raw input (--palette) is a stream of records, each starting
+ * with a tag byte:
+ *
+ *   'P' <first> <count - 1> <count entries>
+ *       set palette entries first ... first + count - 1. Every entry is
+ *       one pixel of the raw pixelformat (unset entries are black)
+ *   'F' <width * height indices>
+ *       one frame of 8-bit palette indices
+ */
+#define PALETTE_TAG_UPDATE      'P'
+#define PALETTE_TAG_FRAME       'F'
+
+
+/** indexed input state (current palette) */
+typedef struct _Palette         Palette;
+/** color table index frames are expanded with */
+typedef struct _PaletteTable    PaletteTable;
+
+
+Palette                        *palette_new(LedPixelFormat * f, size_t swap_size, Correction * correction, bool retain);
+uint8_t                        *palette_read_frame(Palette * p, RawReader * reader, Events * events, bool * running, int fd, size_t pixels);
+uint8_t                        *palette_get_index(Palette * p);
+const PaletteTable             *palette_get_table(Palette * p);
+void                            palette_expand(const PaletteTable * t, const uint8_t * index, size_t n, void *dst);
+void                            palette_destroy(Palette * p);
+
+
+#endif /** _PALETTE_H */
@@ -0,0 +1,574 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <niftyled.h>
+#include "playlist.h"
+
+
+
+/** kind of playlist source */
+typedef enum
+{
+        /** file or directory */
+        SOURCE_PATH = 0,
+        /** file listing one entry per line */
+        SOURCE_LIST,
+} SourceType;
+
+
+/** where entries come from */
+struct Source
+{
+        /** kind of source */
+        SourceType type;
+        /** path of file, directory or list */
+        char *path;
+};
+
+
+/** playlist descriptor */
+struct _Playlist
+{
+        /** sources in order of playback */
+        struct Source *sources;
+        /** amount of sources */
+        size_t sourcecount;
+        /** true to start over after last entry */
+        bool loop;
+
+        /** current source */
+        size_t source;
+        /** true if current source was started */
+        bool started;
+        /** list being read */
+        FILE *list;
+        /** directory of list (prepended to relative entries) */
+        char list_dir[1024];
+        /** true if current source is a directory */
+        bool dir;
+        /** names of directory being played (point into dir_arena) */
+        char **dir_names;
+        /** storage of all names of directory */
+        char *dir_arena;
+        /** amount of names in directory */
+        size_t dir_count;
+        /** next name of directory */
+        size_t dir_pos;
+        /** current pass through all sources */
+        unsigned long pass;
+        /** true if current pass yielded an entry */
+        bool yielded;
+
+        /** entries read but not released (entry seq is window[seq % size]) */
+        PlaylistEntry *window;
+        /** size of window */
+        size_t window_size;
+        /** first entry not released */
+        unsigned long base;
+        /** amount of entries read */
+        unsigned long count;
+        /** true after last entry was read */
+        bool end;
+        /** protects everything (prefetch workers read ahead) */
+        pthread_mutex_t mutex;
+};
+
+
+
+/** natural order ("frame2" before "frame10") */
+static int _compare_names(const void *a, const void *b)
+{
+        return strverscmp(*(char *const *) a, *(char *const *) b);
+}
+
+
+/** read all names of directory & sort them */
+static NftResult _scan_dir(Playlist * p, const char *path)
+{
+        DIR *d;
+        if(!(d = opendir(path)))
+        {
+                NFT_LOG(L_ERROR, "Failed to open directory \"%s\": %s", path,
+                        strerror(errno));
+                return NFT_FAILURE;
+        }
+
+        /* names are stored back to back in one buffer */
+        size_t arena_size = 0, arena_used = 0;
+        size_t *offsets = NULL;
+        size_t count = 0, offsets_size = 0;
+        NftResult r = NFT_FAILURE;
+
+        struct dirent *de;
+        while((de = readdir(d)))
+        {
+                /* skip hidden files, "." & ".." */
+                if(de->d_name[0] == '.')
+                        continue;
+
+                /* skip anything but regular files (and symlinks to them) */
+                if(de->d_type != DT_UNKNOWN && de->d_type != DT_REG &&
+                   de->d_type != DT_LNK)
+                        continue;
+
+                size_t len = strlen(de->d_name) + 1;
+                if(arena_used + len > arena_size)
+                {
+                        size_t size = arena_size ? arena_size * 2 : 4096;
+                        while(size < arena_used + len)
+                                size *= 2;
+                        char *tmp;
+                        if(!(tmp = realloc(p->dir_arena, size)))
+                                goto _sd_exit;
+                        p->dir_arena = tmp;
+                        arena_size = size;
+                }
+                if(count >= offsets_size)
+                {
+                        size_t size = offsets_size ? offsets_size * 2 : 256;
+                        size_t *tmp;
+                        if(!(tmp = realloc(offsets, size * sizeof(size_t))))
+                                goto _sd_exit;
+                        offsets = tmp;
+                        offsets_size = size;
+                }
+
+                offsets[count++] = arena_used;
+                memcpy(p->dir_arena + arena_used, de->d_name, len);
+                arena_used += len;
+        }
+
+        /* turn offsets into pointers now that the arena doesn't move */
+        if(count && !(p->dir_names = malloc(count * sizeof(char *))))
+                goto _sd_exit;
+        size_t i;
+        for(i = 0; i < count; i++)
+                p->dir_names[i] = p->dir_arena + offsets[i];
+
+        qsort(p->dir_names, count, sizeof(char *), _compare_names);
+        p->dir_count = count;
+        p->dir_pos = 0;
+
+        NFT_LOG(L_DEBUG, "Directory \"%s\": %zu files", path, count);
+        r = NFT_SUCCESS;
+
+_sd_exit:
+        if(!r)
+                NFT_LOG_PERROR("realloc()");
+        free(offsets);
+        closedir(d);
+        return r;
+}
+
+
+/** free names of directory */
+static void _free_dir(Playlist * p)
+{
+        free(p->dir_names);
+        free(p->dir_arena);
+        p->dir_names = NULL;
+        p->dir_arena = NULL;
+        p->dir_count = 0;
+}
+
+
+/** parse one line of a list ("<file>[\t<key>=<value>...]") */
+static bool _parse_line(Playlist * p, char *line, PlaylistEntry * e)
+{
+        /* strip newline */
+        line[strcspn(line, "\r\n")] = '\0';
+
+        /* skip empty lines & comments */
+        if(line[0] == '\0' || line[0] == '#')
+                return false;
+
+        char *opts = strchr(line, '\t');
+        if(opts)
+                *opts++ = '\0';
+
+        /* relative to directory of list */
+        int len;
+        if(line[0] != '/' && p->list_dir[0])
+                len = snprintf(e->filename, sizeof(e->filename), "%s/%s",
+                               p->list_dir, line);
+        else
+                len = snprintf(e->filename, sizeof(e->filename), "%s", line);
+        if(len < 0 || (size_t) len >= sizeof(e->filename))
+        {
+                NFT_LOG(L_WARNING, "Skipping \"%s\" (path too long)", line);
+                return false;
+        }
+
+        /* per-entry settings */
+        char *opt, *save;
+        for(opt = opts ? strtok_r(opts, "\t", &save) : NULL; opt;
+            opt = strtok_r(NULL, "\t", &save))
+        {
+                if(sscanf(opt, "fps=%32d", &e->fps) == 1 && e->fps > 0)
+                        continue;
+                if(sscanf(opt, "duration=%lf", &e->duration) == 1 &&
+                   e->duration >= 0)
+                        continue;
+
+                NFT_LOG(L_WARNING, "Ignoring invalid option \"%s\" of \"%s\"",
+                        opt, e->filename);
+        }
+
+        return true;
+}
+
+
+/** read next entry from sources */
+static bool _read_entry(Playlist * p, PlaylistEntry * e)
+{
+        while(true)
+        {
+                /* end of all sources? */
+                if(p->source >= p->sourcecount)
+                {
+                        /* don't spin over sources without entries */
+                        if(!p->loop || !p->yielded)
+                                return false;
+
+                        p->source = 0;
+                        p->pass++;
+                        p->yielded = false;
+                }
+
+                struct Source *s = &p->sources[p->source];
+                memset(e, 0, sizeof(PlaylistEntry));
+                e->pass = p->pass;
+
+                switch (s->type)
+                {
+                        case SOURCE_PATH:
+                        {
+                                /* directory (scanned again every pass) */
+                                struct stat st;
+                                if(!p->started)
+                                {
+                                        p->started = true;
+                                        p->dir = (strcmp(s->path, "-") != 0 &&
+                                                  stat(s->path, &st) == 0 &&
+                                                  S_ISDIR(st.st_mode));
+                                        if(p->dir && !_scan_dir(p, s->path))
+                                                break;
+                                }
+
+                                if(p->dir)
+                                {
+                                        if(p->dir_pos >= p->dir_count)
+                                                break;
+
+                                        snprintf(e->filename,
+                                                 sizeof(e->filename), "%s/%s",
+                                                 s->path,
+                                                 p->dir_names[p->dir_pos++]);
+                                        p->yielded = true;
+                                        return true;
+                                }
+
+                                /* single file */
+                                snprintf(e->filename, sizeof(e->filename),
+                                         "%s", s->path);
+                                p->source++;
+                                p->started = false;
+                                p->yielded = true;
+                                return true;
+                        }
+
+                        case SOURCE_LIST:
+                        {
+                                if(!p->started)
+                                {
+                                        p->started = true;
+                                        if(strcmp(s->path, "-") == 0)
+                                        {
+                                                /* stdin can't be read twice */
+                                                if(p->pass > 0)
+                                                        break;
+                                                p->list = stdin;
+                                                p->list_dir[0] = '\0';
+                                        }
+                                        else
+                                        {
+                                                if(!(p->list =
+                                                     fopen(s->path, "r")))
+                                                {
+                                                        NFT_LOG(L_ERROR,
+                                                                "Failed to open playlist \"%s\": %s",
+                                                                s->path,
+                                                                strerror(errno));
+                                                        break;
+                                                }
+
+                                                /* directory of list */
+                                                snprintf(p->list_dir,
+                                                         sizeof(p->list_dir),
+                                                         "%s", s->path);
+                                                char *slash = strrchr
+                                                        (p->list_dir, '/');
+                                                if(slash)
+                                                        *slash = '\0';
+                                                else
+                                                        p->list_dir[0] = '\0';
+                                        }
+                                }
+
+                                if(!p->list)
+                                        break;
+
+                                char line[2048];
+                                while(fgets(line, sizeof(line), p->list))
+                                {
+                                        if(_parse_line(p, line, e))
+                                        {
+                                                p->yielded = true;
+                                                return true;
+                                        }
+                                }
+                                break;
+                        }
+                }
+
+                /* source exhausted */
+                if(p->list && p->list != stdin)
+                        fclose(p->list);
+                p->list = NULL;
+                _free_dir(p);
+                p->dir = false;
+                p->started = false;
+                p->source++;
+        }
+}
+
+
+/**
+ * create empty playlist
+ *
+ * @param loop true to start over after last entry
+ * @param window amount of entries that may be read ahead of playback
+ * @result new playlist or NULL
+ */
+Playlist *playlist_new(bool loop, size_t window)
+{
+        Playlist *p;
+        if(!(p = calloc(1, sizeof(Playlist))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        p->loop = loop;
+        p->window_size = window ? window : 1;
+        if(!(p->window = calloc(p->window_size, sizeof(PlaylistEntry))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                free(p);
+                return NULL;
+        }
+        pthread_mutex_init(&p->mutex, NULL);
+
+        return p;
+}
+
+
+/** add source */
+static NftResult _add(Playlist * p, SourceType type, const char *path)
+{
+        struct Source *tmp;
+        if(!(tmp = realloc(p->sources,
+                           (p->sourcecount + 1) * sizeof(struct Source))))
+        {
+                NFT_LOG_PERROR("realloc()");
+                return NFT_FAILURE;
+        }
+        p->sources = tmp;
+
+        if(!(p->sources[p->sourcecount].path = strdup(path)))
+        {
+                NFT_LOG_PERROR("strdup()");
+                return NFT_FAILURE;
+        }
+        p->sources[p->sourcecount].type = type;
+        p->sourcecount++;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * add file or directory (all files in it, in natural order) to playlist
+ */
+NftResult playlist_add_path(Playlist * p, const char *path)
+{
+        return _add(p, SOURCE_PATH, path);
+}
+
+
+/**
+ * add list of entries to playlist (read when reached, "-" for stdin)
+ */
+NftResult playlist_add_list(Playlist * p, const char *filename)
+{
+        return _add(p, SOURCE_LIST, filename);
+}
+
+
+/**
+ * true if nothing was added to playlist
+ */
+bool playlist_is_empty(Playlist * p)
+{
+        return p->sourcecount == 0;
+}
+
+
+/**
+ * get entry of playlist (entries are read when they are first requested)
+ *
+ * @param p playlist
+ * @param seq sequence number of entry (n-th entry played, counting loops)
+ * @param e copy of entry
+ * @result NFT_SUCCESS or NFT_FAILURE if seq is past the end, already
+ *         released or too far ahead of the oldest unreleased entry
+ */
+NftResult playlist_get(Playlist * p, unsigned long seq, PlaylistEntry * e)
+{
+        NftResult r = NFT_FAILURE;
+        pthread_mutex_lock(&p->mutex);
+
+        if(seq < p->base || seq >= p->base + p->window_size)
+                goto _pg_exit;
+
+        /* read up to requested entry */
+        while(p->count <= seq)
+        {
+                if(p->end ||
+                   !_read_entry(p, &p->window[p->count % p->window_size]))
+                {
+                        p->end = true;
+                        goto _pg_exit;
+                }
+                p->count++;
+        }
+
+        *e = p->window[seq % p->window_size];
+        r = NFT_SUCCESS;
+
+_pg_exit:
+        pthread_mutex_unlock(&p->mutex);
+        return r;
+}
+
+
+/**
+ * release entries before seq (they won't be requested anymore)
+ */
+void playlist_release(Playlist * p, unsigned long seq)
+{
+        pthread_mutex_lock(&p->mutex);
+        if(seq > p->base)
+                p->base = seq;
+        pthread_mutex_unlock(&p->mutex);
+}
+
+
+/**
+ * @result oldest entry that can still be gotten (the ones before are
+ *         released)
+ */
+unsigned long playlist_first(Playlist * p)
+{
+        pthread_mutex_lock(&p->mutex);
+        unsigned long first = p->base;
+        pthread_mutex_unlock(&p->mutex);
+        return first;
+}
+
+
+/**
+ * true if seq is after the last entry of the playlist
+ */
+bool playlist_past_end(Playlist * p, unsigned long seq)
+{
+        pthread_mutex_lock(&p->mutex);
+        bool end = p->end && seq >= p->count;
+        pthread_mutex_unlock(&p->mutex);
+        return end;
+}
+
+
+/**
+ * free playlist
+ */
+void playlist_destroy(Playlist * p)
+{
+        if(!p)
+                return;
+
+        if(p->list && p->list != stdin)
+                fclose(p->list);
+        _free_dir(p);
+
+        size_t i;
+        for(i = 0; i < p->sourcecount; i++)
+                free(p->sources[i].path);
+        free(p->sources);
+        free(p->window);
+        pthread_mutex_destroy(&p->mutex);
+        free(p);
+}
@@ -0,0 +1,76 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PLAYLIST_H
+#define _PLAYLIST_H
+
+
+/** one entry of a playlist */
+typedef struct
+{
+        /** file to play */
+        char                            filename[1024];
+        /** framerate of this entry (0 = default) */
+        int                             fps;
+        /** time to show this entry in seconds (0 = until its last frame) */
+        double                          duration;
+        /** how often the playlist was started over before this entry */
+        unsigned long                   pass;
+} PlaylistEntry;
+
+/** files to play, enumerated lazily from paths, directories & lists */
+typedef struct _Playlist        Playlist;
+
+
+Playlist                       *playlist_new(bool loop, size_t window);
+NftResult                       playlist_add_path(Playlist * p, const char *path);
+NftResult                       playlist_add_list(Playlist * p, const char *filename);
+bool                            playlist_is_empty(Playlist * p);
+NftResult                       playlist_get(Playlist * p, unsigned long seq, PlaylistEntry * e);
+void                            playlist_release(Playlist * p, unsigned long seq);
+unsigned long                   playlist_first(Playlist * p);
+bool                            playlist_past_end(Playlist * p, unsigned long seq);
+void                            playlist_destroy(Playlist * p);
+
+
+#endif /** _PLAYLIST_H */
@@ -0,0 +1,377 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <MagickWand/MagickWand.h>
+#include <niftyled.h>
+#include "gif.h"
+#include "pack.h"
+#include "playlist.h"
+#include "prefetch.h"
+
+
+
+/** state of one decode slot */
+typedef enum
+{
+        /** slot may be (re)used for the next file */
+        SLOT_FREE = 0,
+        /** worker is decoding into slot */
+        SLOT_BUSY,
+        /** slot holds decoded file */
+        SLOT_READY,
+        /** file couldn't be decoded (or is decoded by playback) */
+        SLOT_FAILED,
+} SlotState;
+
+
+/** one file decoded ahead */
+struct Slot
+{
+        /** wand holding the decoded images */
+        MagickWand *wand;
+        /** sequence number of file in slot */
+        unsigned long seq;
+        /** state of slot */
+        SlotState state;
+};
+
+
+/** decode-ahead pool */
+struct _Prefetch
+{
+        /** files to decode */
+        Playlist *playlist;
+        /** true to decode only the first pass through the playlist */
+        bool once;
+        /** sequence number after last entry of playlist (0 = unknown) */
+        unsigned long limit;
+        /** ring of slots (file with sequence n lives in slot n % slotcount) */
+        struct Slot *slots;
+        /** amount of slots */
+        unsigned int slotcount;
+        /** worker threads */
+        pthread_t *threads;
+        /** amount of worker threads started */
+        unsigned int threadcount;
+        /** sequence number of next file to decode */
+        unsigned long next;
+        /** sequence number of next file to hand to playback */
+        unsigned long consumed;
+        /** true to stop worker threads */
+        bool stop;
+        /** protects everything above */
+        pthread_mutex_t mutex;
+        /** signalled when a slot changed state */
+        pthread_cond_t changed;
+};
+
+
+
+/** true if a worker may start decoding the next file */
+static bool _job_available(Prefetch * p)
+{
+        if(p->limit && p->next >= p->limit)
+                return false;
+
+        return p->next < p->consumed + p->slotcount;
+}
+
+
+/** true if file is a GIF or archive (decoded by playback) */
+static bool _decoded_by_playback(const char *file)
+{
+        FILE *f;
+        if(!(f = fopen(file, "r")))
+                return false;
+
+        bool result = gif_probe(f) || pack_probe(fileno(f));
+        fclose(f);
+        return result;
+}
+
+
+/** worker thread: decode files in order into free slots */
+static void *_worker_thread(void *arg)
+{
+        Prefetch *p = arg;
+
+        pthread_mutex_lock(&p->mutex);
+        while(true)
+        {
+                while(!p->stop && !_job_available(p))
+                        pthread_cond_wait(&p->changed, &p->mutex);
+
+                if(p->stop)
+                        break;
+
+                /* claim next file */
+                unsigned long seq = p->next++;
+                struct Slot *s = &p->slots[seq % p->slotcount];
+                s->seq = seq;
+                s->state = SLOT_BUSY;
+                pthread_mutex_unlock(&p->mutex);
+
+                /* decode (streams can't be read ahead, GIFs are decoded
+                 * frame by frame and archives are mapped by playback) */
+                PlaylistEntry e;
+                bool ok = false, end = false;
+                if(!playlist_get(p->playlist, seq, &e))
+                {
+                        /* past the end (or already played) */
+                        end = playlist_past_end(p->playlist, seq);
+                }
+                else if(!(p->once && e.pass > 0) &&
+                        strcmp(e.filename, "-") != 0 &&
+                        !_decoded_by_playback(e.filename))
+                {
+                        ClearMagickWand(s->wand);
+                        MagickSetAntialias(s->wand, false);
+                        MagickSetInterpolateMethod(s->wand,
+                                                   IntegerInterpolatePixel);
+                        ok = MagickReadImage(s->wand, e.filename);
+                }
+
+                pthread_mutex_lock(&p->mutex);
+                if(end && (!p->limit || seq < p->limit))
+                        p->limit = seq;
+                s->state = ok ? SLOT_READY : SLOT_FAILED;
+                pthread_cond_broadcast(&p->changed);
+        }
+        pthread_mutex_unlock(&p->mutex);
+
+        return NULL;
+}
+
+
+/** wait until slot of seq is decoded (call with mutex held) */
+static struct Slot *_wait_slot(Prefetch * p, unsigned long seq)
+{
+        struct Slot *s = &p->slots[seq % p->slotcount];
+        while(s->seq != seq || (s->state != SLOT_READY &&
+                                s->state != SLOT_FAILED))
+                pthread_cond_wait(&p->changed, &p->mutex);
+
+        return s;
+}
+
+
+/**
+ * start pool decoding files in order
+ *
+ * @param playlist files to decode (needs a window of at least slots + 1)
+ * @param once true to decode only the first pass through the playlist
+ *        (later passes are served from the cache)
+ * @param slots amount of files kept decoded ahead
+ * @param threads amount of worker threads
+ * @result pool or NULL upon error
+ */
+Prefetch *prefetch_new(Playlist * playlist, bool once, unsigned int slots,
+                       unsigned int threads)
+{
+        if(!playlist || !slots || !threads)
+                return NULL;
+
+        Prefetch *p;
+        if(!(p = calloc(1, sizeof(Prefetch))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        p->playlist = playlist;
+        p->once = once;
+        p->slotcount = slots;
+        pthread_mutex_init(&p->mutex, NULL);
+        pthread_cond_init(&p->changed, NULL);
+
+        if(!(p->slots = calloc(slots, sizeof(struct Slot))) ||
+           !(p->threads = calloc(threads, sizeof(pthread_t))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                goto _pn_error;
+        }
+
+        /* one wand per slot (wands aren't shared between threads) */
+        unsigned int i;
+        for(i = 0; i < slots; i++)
+        {
+                if(!(p->slots[i].wand = NewMagickWand()))
+                        goto _pn_error;
+                p->slots[i].state = SLOT_FREE;
+        }
+
+        /* start workers */
+        for(i = 0; i < threads; i++)
+        {
+                if(pthread_create(&p->threads[i], NULL, _worker_thread, p) !=
+                   0)
+                {
+                        NFT_LOG_PERROR("pthread_create()");
+                        goto _pn_error;
+                }
+                p->threadcount++;
+        }
+
+        NFT_LOG(L_DEBUG, "Decoding %u files ahead using %u threads",
+                slots, threads);
+
+        return p;
+
+_pn_error:
+        prefetch_destroy(p);
+        return NULL;
+}
+
+
+/**
+ * hand decoded file to playback
+ *
+ * Files must be requested in order of their sequence number (skipped
+ * numbers are dropped). Blocks only if the file isn't decoded yet.
+ *
+ * @param p pool
+ * @param seq sequence number of file (n-th file played, counting loops)
+ * @param wand wand to swap with the one holding the decoded file (the
+ *        passed wand is cleared and reused by the pool)
+ * @result NFT_SUCCESS if *wand now holds the decoded file, NFT_FAILURE if
+ *         the file wasn't read ahead and must be read by the caller
+ */
+NftResult prefetch_swap(Prefetch * p, unsigned long seq, MagickWand ** wand)
+{
+        if(!p || !wand)
+                return NFT_FAILURE;
+
+        pthread_mutex_lock(&p->mutex);
+
+        /* out of sequence or beyond last file? */
+        if(seq < p->consumed || (p->limit && seq >= p->limit))
+        {
+                pthread_mutex_unlock(&p->mutex);
+                return NFT_FAILURE;
+        }
+
+        /* drop files that were skipped (e.g. cached). Free slots wake
+         * workers waiting for one, files no worker claimed yet are never
+         * decoded */
+        struct Slot *s;
+        for(; p->consumed < seq; p->consumed++)
+        {
+                if(p->consumed >= p->next)
+                {
+                        p->consumed = p->next = seq;
+                        break;
+                }
+
+                s = _wait_slot(p, p->consumed);
+                s->state = SLOT_FREE;
+                pthread_cond_broadcast(&p->changed);
+        }
+
+        /* our file wasn't claimed yet? (read by caller) */
+        if(seq >= p->next)
+        {
+                p->consumed = p->next = seq + 1;
+                pthread_cond_broadcast(&p->changed);
+                pthread_mutex_unlock(&p->mutex);
+                return NFT_FAILURE;
+        }
+
+        /* get our file */
+        s = _wait_slot(p, seq);
+        bool ok = (s->state == SLOT_READY);
+        if(ok)
+        {
+                MagickWand *tmp = *wand;
+                *wand = s->wand;
+                s->wand = tmp;
+        }
+        s->state = SLOT_FREE;
+        p->consumed++;
+
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->mutex);
+
+        return ok ? NFT_SUCCESS : NFT_FAILURE;
+}
+
+
+/**
+ * stop workers and free pool
+ */
+void prefetch_destroy(Prefetch * p)
+{
+        if(!p)
+                return;
+
+        /* stop workers (a running decode is finished first) */
+        pthread_mutex_lock(&p->mutex);
+        p->stop = true;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->mutex);
+
+        unsigned int i;
+        for(i = 0; i < p->threadcount; i++)
+                pthread_join(p->threads[i], NULL);
+
+        if(p->slots)
+        {
+                for(i = 0; i < p->slotcount; i++)
+                {
+                        if(p->slots[i].wand)
+                                DestroyMagickWand(p->slots[i].wand);
+                }
+        }
+
+        pthread_cond_destroy(&p->changed);
+        pthread_mutex_destroy(&p->mutex);
+        free(p->threads);
+        free(p->slots);
+        free(p);
+}
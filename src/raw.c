@@ -41,8 +41,19 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#define _GNU_SOURCE
 #include <niftyled.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include "simd.h"
+#include "events.h"
+#include "decompress.h"
+#include "raw.h"
 
 /* we need this for fd_set on windows */
 #if WIN32
@@ -50,56 +61,387 @@
 #endif
 
 
+/** minimum size of read buffer (many small frames per read()) */
+#define RAW_READER_SIZE         (256 * 1024)
+
+
+/** buffered reader descriptor */
+struct _RawReader
+{
+        /** alignment of frames handed out */
+        size_t align;
+        /** read buffer */
+        char *buffer;
+        /** size of buffer in bytes */
+        size_t size;
+        /** offset of next frame in buffer */
+        size_t start;
+        /** bytes in buffer (from start of buffer) */
+        size_t end;
+        /** buffer a misaligned frame is copied to */
+        char *bounce;
+        /** size of bounce in bytes */
+        size_t bounce_size;
+        /** descriptor frames are requested for (-1 = none) */
+        int fd;
+        /** descriptor data is actually read from (fd or decoded stream) */
+        int src;
+        /** decompressor if fd is compressed */
+        Decompressor *decompressor;
+        /** true once the first bytes of fd were checked for compression */
+        bool probed;
+        /** frames handed out */
+        unsigned long long frames;
+        /** read() & poll() calls */
+        unsigned long long syscalls;
+};
+
+
+
+/** make buffer hold at least size bytes after start */
+static NftResult _reserve(RawReader * r, size_t size)
+{
+        /* move remainder to start of buffer */
+        if(r->start)
+        {
+                memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+                r->end -= r->start;
+                r->start = 0;
+        }
+
+        /* room for two frames (so the next one can be read meanwhile) */
+        size_t want = size * 2 > RAW_READER_SIZE ? size * 2 :
+                RAW_READER_SIZE;
+        if(r->size >= want)
+                return NFT_SUCCESS;
+
+        char *buffer;
+        if(!(buffer = realloc(r->buffer, want)))
+        {
+                NFT_LOG_PERROR("realloc()");
+                return NFT_FAILURE;
+        }
+        r->buffer = buffer;
+        r->size = want;
+
+        return NFT_SUCCESS;
+}
+
+
+/** start reading from another descriptor */
+static void _switch(RawReader * r, int fd)
+{
+        raw_reader_reset(r);
+        r->fd = fd;
+        r->src = fd;
+
+#ifdef F_SETPIPE_SZ
+        /* let writer queue more frames in a pipe (best effort) */
+        struct stat st;
+        if(fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+                fcntl(fd, F_SETPIPE_SZ, RAW_READER_SIZE);
+#endif
+}
+
 
 
 /**
- * read a complete raw pixel-frame
+ * create reader that pulls as many raw frames per read() as available
+ *
+ * @param align alignment of frames handed out (e.g. component size)
+ * @result newly allocated reader or NULL
  */
-int raw_read_frame(bool * running, char *buf, int fd, size_t size)
+RawReader *raw_reader_new(size_t align)
 {
+        RawReader *r;
+        if(!(r = calloc(1, sizeof(RawReader))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
 
-        ssize_t bytes_to_read, bytes_read = 0;
+        r->align = align ? align : sizeof(double);
+        r->fd = -1;
+        r->src = -1;
 
-        for(bytes_to_read = size;
-            bytes_to_read > 0; bytes_to_read -= bytes_read)
+        return r;
+}
+
+
+/**
+ * get next complete raw pixel-frame (compressed input is detected
+ * from its first bytes & decompressed transparently)
+ *
+ * @param r reader acquired by raw_reader_new()
+ * @param events event loop handled while waiting for data (NULL = just
+ *        block in read())
+ * @param running stop waiting when this becomes false
+ * @param fd descriptor to read from
+ * @param size size of one frame in bytes
+ * @result frame (owned by reader, valid until next call & may be
+ *         modified) or NULL at end of file or on error
+ */
+char *raw_reader_frame(RawReader * r, Events * events, bool * running,
+                       int fd, size_t size)
+{
+        if(fd != r->fd)
+                _switch(r, fd);
+
+        /* read until a complete frame is buffered (& input was probed) */
+        while(!r->probed || r->end - r->start < size)
         {
-                /* read from stdin? */
-                // ~ if(fd == STDIN_FILENO)
-                // ~ {
-                // ~ /* prepare stuff for select() */
-                // ~ fd_set fds;
-                // ~ struct timeval tv;
-                // ~ FD_ZERO(&fds);
-                // ~ FD_SET(fd, &fds);
-                // ~ tv.tv_sec = 0;
-                // ~ tv.tv_usec = 500;
-
-                // ~ /* wait for incoming data */
-                // ~ while(*running && (select(1, &fds, NULL, NULL, &tv) ==
-                // 0));
-                // ~ }
+                if((r->size - r->start < size || r->end == r->size) &&
+                   !_reserve(r, size))
+                        return NULL;
+
+                /* wait for incoming data (handling signals meanwhile) */
+                if(events)
+                {
+                        r->syscalls++;
+                        if(!events_wait_fd(events, r->src, 0))
+                                return NULL;
+                }
 
                 /* break loop if we're not running anymore */
                 if(!*running)
-                        break;
+                        return NULL;
 
-                /* read data into buffer */
-                if((bytes_read = read(fd, buf, bytes_to_read)) < 0)
+                /* read as much as fits */
+                ssize_t bytes_read;
+                r->syscalls++;
+                if((bytes_read = read(r->src, r->buffer + r->end,
+                                      r->size - r->end)) < 0)
                 {
-						/* catch EINTR whe reading from the pipe */
-						if(fd == STDIN_FILENO && (errno == EINTR || errno == EAGAIN))
-						        return 0;
-						
+                        if(errno == EINTR || errno == EAGAIN)
+                                continue;
+
                         NFT_LOG_PERROR("read()");
-                        return -1;
+                        return NULL;
                 }
 
                 /* end of file? */
                 if(bytes_read == 0)
-                        return -1;
+                {
+                        /* input too short to be compressed */
+                        if(!r->probed)
+                        {
+                                r->probed = true;
+                                continue;
+                        }
+                        return NULL;
+                }
 
-                buf += bytes_read;
+                r->end += bytes_read;
+
+                /* decode compressed input on a thread from now on */
+                if(!r->probed && r->end >= DECOMPRESS_PROBE_SIZE)
+                {
+                        r->probed = true;
+                        if(decompress_probe(r->buffer, r->end))
+                        {
+                                if(!(r->decompressor =
+                                     decompress_new(fd, r->buffer, r->end)))
+                                        return NULL;
+                                r->src = decompress_get_fd(r->decompressor);
+                                r->start = 0;
+                                r->end = 0;
+                        }
+                }
+        }
+
+        char *frame = r->buffer + r->start;
+        r->start += size;
+        r->frames++;
+
+        /* hand out frame in place if it's aligned */
+        if((uintptr_t) frame % r->align == 0)
+                return frame;
+
+        if(r->bounce_size < size)
+        {
+                free(r->bounce);
+                if(!(r->bounce = malloc(size)))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        r->bounce_size = 0;
+                        return NULL;
+                }
+                r->bounce_size = size;
         }
+        memcpy(r->bounce, frame, size);
+
+        return r->bounce;
+}
 
-        return bytes_read;
+
+/**
+ * drop buffered data (call before the descriptor is closed)
+ */
+void raw_reader_reset(RawReader * r)
+{
+        if(!r)
+                return;
+
+        /* stop reading fd before it's closed */
+        decompress_destroy(r->decompressor);
+        r->decompressor = NULL;
+        r->probed = false;
+
+        r->start = 0;
+        r->end = 0;
+        r->fd = -1;
+        r->src = -1;
+}
+
+
+/**
+ * get amount of frames handed out & syscalls made to read them
+ */
+void raw_reader_get_stats(RawReader * r, unsigned long long *frames,
+                          unsigned long long *syscalls)
+{
+        *frames = r ? r->frames : 0;
+        *syscalls = r ? r->syscalls : 0;
+}
+
+
+/**
+ * free reader
+ */
+void raw_reader_destroy(RawReader * r)
+{
+        if(!r)
+                return;
+
+        decompress_destroy(r->decompressor);
+        free(r->buffer);
+        free(r->bounce);
+        free(r);
+}
+
+
+/**
+ * check if raw data of the given byte order can be used without conversion
+ *
+ * @param big_endian true if raw data is big-endian ordered
+ * @result true if byte order matches this machine
+ */
+bool raw_is_native_endian(bool big_endian)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return big_endian;
+#else
+        return !big_endian;
+#endif
+}
+
+
+/**
+ * swap byte order of all components in a raw frame
+ *
+ * @param buf raw frame data
+ * @param size size of buf in bytes
+ * @param component_size size of one component in bytes (2, 4 or 8)
+ */
+void raw_swap_frame(void *buf, size_t size, size_t component_size)
+{
+        uint8_t *p = buf;
+        size_t i = 0;
+
+#if SIMD_VECTOR_BYTES
+        for(; i + SIMD_VECTOR_BYTES <= size; i += SIMD_VECTOR_BYTES)
+        {
+#if SIMD_AVX2
+                __m256i m;
+                switch (component_size)
+                {
+                        case 2:
+                                m = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                                     9, 8, 11, 10, 13, 12,
+                                                     15, 14, 1, 0, 3, 2, 5,
+                                                     4, 7, 6, 9, 8, 11, 10,
+                                                     13, 12, 15, 14);
+                                break;
+                        case 4:
+                                m = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                                     11, 10, 9, 8, 15, 14,
+                                                     13, 12, 3, 2, 1, 0, 7,
+                                                     6, 5, 4, 11, 10, 9, 8,
+                                                     15, 14, 13, 12);
+                                break;
+                        case 8:
+                                m = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                                     15, 14, 13, 12, 11, 10,
+                                                     9, 8, 7, 6, 5, 4, 3, 2,
+                                                     1, 0, 15, 14, 13, 12,
+                                                     11, 10, 9, 8);
+                                break;
+                        default:
+                                return;
+                }
+                __m256i x = _mm256_loadu_si256((__m256i *) (p + i));
+                _mm256_storeu_si256((__m256i *) (p + i),
+                                    _mm256_shuffle_epi8(x, m));
+#elif SIMD_SSE2
+                __m128i x = _mm_loadu_si128((__m128i *) (p + i));
+                switch (component_size)
+                {
+                        case 8:
+                                /* reverse 16-bit words of every qword */
+                                x = _mm_shufflelo_epi16(x,
+                                                        _MM_SHUFFLE(0, 1, 2,
+                                                                    3));
+                                x = _mm_shufflehi_epi16(x,
+                                                        _MM_SHUFFLE(0, 1, 2,
+                                                                    3));
+                                break;
+                        case 4:
+                                /* swap 16-bit words of every dword */
+                                x = _mm_shufflelo_epi16(x,
+                                                        _MM_SHUFFLE(2, 3, 0,
+                                                                    1));
+                                x = _mm_shufflehi_epi16(x,
+                                                        _MM_SHUFFLE(2, 3, 0,
+                                                                    1));
+                                break;
+                        case 2:
+                                break;
+                        default:
+                                return;
+                }
+                /* swap bytes of every 16-bit word */
+                x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+                _mm_storeu_si128((__m128i *) (p + i), x);
+#elif SIMD_NEON
+                uint8x16_t x = vld1q_u8(p + i);
+                switch (component_size)
+                {
+                        case 2:
+                                x = vrev16q_u8(x);
+                                break;
+                        case 4:
+                                x = vrev32q_u8(x);
+                                break;
+                        case 8:
+                                x = vrev64q_u8(x);
+                                break;
+                        default:
+                                return;
+                }
+                vst1q_u8(p + i, x);
+#endif
+        }
+#endif
+
+        /* rest */
+        for(; i + component_size <= size; i += component_size)
+        {
+                size_t a, b;
+                for(a = i, b = i + component_size - 1; a < b; a++, b--)
+                {
+                        uint8_t t = p[a];
+                        p[a] = p[b];
+                        p[b] = t;
+                }
+        }
 }
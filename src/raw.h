@@ -45,7 +45,17 @@
 #define _RAW_H
 
 
-int                             raw_read_frame(bool * running, char *buf, int fd, size_t size);
+/** buffered reader handing out raw frames */
+typedef struct _RawReader       RawReader;
+
+
+RawReader                      *raw_reader_new(size_t align);
+char                           *raw_reader_frame(RawReader * r, Events * events, bool * running, int fd, size_t size);
+void                            raw_reader_reset(RawReader * r);
+void                            raw_reader_get_stats(RawReader * r, unsigned long long *frames, unsigned long long *syscalls);
+void                            raw_reader_destroy(RawReader * r);
+bool                            raw_is_native_endian(bool big_endian);
+void                            raw_swap_frame(void *buf, size_t size, size_t component_size);
 
 
 
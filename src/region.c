@@ -0,0 +1,354 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <niftyled.h>
+#include "events.h"
+#include "decompress.h"
+#include "raw.h"
+#include "region.h"
+
+
+/** region descriptor */
+struct _Region
+{
+        /** bytes per pixel */
+        size_t bpp;
+        /** width of full-size input frames */
+        LedFrameCord input_width;
+        /** height of full-size input frames */
+        LedFrameCord input_height;
+        /** left edge of region */
+        LedFrameCord x;
+        /** top edge of region */
+        LedFrameCord y;
+        /** region width */
+        LedFrameCord width;
+        /** region height */
+        LedFrameCord height;
+        /** one full-size decoded image (allocated when first needed) */
+        void *buffer;
+        /** mapping of current input file (NULL if not mapped) */
+        const char *map;
+        /** size of map in bytes */
+        size_t map_size;
+        /** offset of next frame in map */
+        size_t pos;
+        /** descriptor of current input file (-1 = none) */
+        int fd;
+};
+
+
+
+/** size of one full-size input frame in bytes */
+static size_t _input_size(Region * r)
+{
+        return (size_t) r->input_width * r->input_height * r->bpp;
+}
+
+
+/** 
+ * offsets of first & last byte (+1) a full-size frame at pos holds of the
+ * region 
+ */
+static void _span(Region * r, size_t pos, size_t * start, size_t * end)
+{
+        size_t stride = (size_t) r->input_width * r->bpp;
+
+        *start = pos + r->y * stride + r->x * r->bpp;
+        *end = pos + (r->y + r->height - 1) * stride +
+                (r->x + r->width) * r->bpp;
+}
+
+
+/** map input file (if it's a regular file) */
+static NftResult _map(Region * r, int fd)
+{
+        r->fd = fd;
+
+        /* only regular files can be mapped (pipes are read) */
+        struct stat st;
+        off_t pos;
+        if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+           (pos = lseek(fd, 0, SEEK_CUR)) < 0 || pos >= st.st_size)
+                return NFT_FAILURE;
+
+        void *map;
+        if((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+           MAP_FAILED)
+        {
+                NFT_LOG_PERROR("mmap()");
+                return NFT_FAILURE;
+        }
+
+        /* compressed files are decoded by the reader */
+        if(decompress_probe((char *) map + pos, st.st_size - pos))
+        {
+                munmap(map, st.st_size);
+                return NFT_FAILURE;
+        }
+
+        r->map = map;
+        r->map_size = st.st_size;
+        r->pos = pos;
+
+        /* don't read ahead rows of other regions, only our own rows are
+         * requested for every frame */
+        madvise(map, r->map_size, MADV_RANDOM);
+
+        return NFT_SUCCESS;
+}
+
+
+/** ask kernel to read rows of the region at pos ahead */
+static void _prefetch(Region * r, size_t pos)
+{
+        if(pos + _input_size(r) > r->map_size)
+                return;
+
+        size_t start, end;
+        _span(r, pos, &start, &end);
+
+        /* align to page */
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        start -= start % page;
+        madvise((void *) (r->map + start), end - start, MADV_WILLNEED);
+}
+
+
+
+/**
+ * parse region definition
+ *
+ * @param s "<x>,<y>,<width>,<height>"
+ * @result NFT_SUCCESS or NFT_FAILURE
+ */
+NftResult region_from_string(const char *s, LedFrameCord * x,
+                             LedFrameCord * y, LedFrameCord * width,
+                             LedFrameCord * height)
+{
+        int v[4];
+        char end;
+        if(sscanf(s, "%32d,%32d,%32d,%32d%c", &v[0], &v[1], &v[2], &v[3],
+                  &end) != 4)
+                return NFT_FAILURE;
+
+        if(v[0] < 0 || v[1] < 0 || v[2] <= 0 || v[3] <= 0)
+                return NFT_FAILURE;
+
+        *x = v[0];
+        *y = v[1];
+        *width = v[2];
+        *height = v[3];
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * create region to play a part of full-size input frames
+ *
+ * @param f pixelformat of input frames
+ * @param input_width width of full-size input frames
+ * @param input_height height of full-size input frames
+ * @param x left edge of region
+ * @param y top edge of region
+ * @param width region width (= frame width)
+ * @param height region height (= frame height)
+ * @result newly allocated region or NULL
+ */
+Region *region_new(LedPixelFormat * f, LedFrameCord input_width,
+                   LedFrameCord input_height, LedFrameCord x, LedFrameCord y,
+                   LedFrameCord width, LedFrameCord height)
+{
+        if(x + width > input_width || y + height > input_height)
+        {
+                NFT_LOG(L_ERROR,
+                        "Region %dx%d at %d,%d exceeds %dx%d input frames",
+                        width, height, x, y, input_width, input_height);
+                return NULL;
+        }
+
+        Region *r;
+        if(!(r = calloc(1, sizeof(Region))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        r->bpp = led_pixel_format_get_bytes_per_pixel(f);
+        r->input_width = input_width;
+        r->input_height = input_height;
+        r->x = x;
+        r->y = y;
+        r->width = width;
+        r->height = height;
+        r->fd = -1;
+
+        NFT_LOG(L_INFO, "Playing region %dx%d at %d,%d of %dx%d input",
+                width, height, x, y, input_width, input_height);
+
+        return r;
+}
+
+
+/**
+ * get buffer to load one full-size input frame into
+ *
+ * @result buffer (owned by region) or NULL
+ */
+void *region_get_buffer(Region * r)
+{
+        if(!r->buffer && !(r->buffer = malloc(_input_size(r))))
+        {
+                NFT_LOG_PERROR("malloc()");
+                return NULL;
+        }
+
+        return r->buffer;
+}
+
+
+/**
+ * copy region out of a full-size input frame
+ *
+ * @param src full-size input frame
+ * @param dst frame buffer of region dimensions
+ */
+void region_crop(Region * r, const void *src, void *dst)
+{
+        size_t stride = (size_t) r->input_width * r->bpp;
+        size_t row = (size_t) r->width * r->bpp;
+        const char *s = (const char *) src + r->y * stride + r->x * r->bpp;
+        char *d = dst;
+
+        LedFrameCord i;
+        for(i = 0; i < r->height; i++)
+        {
+                memcpy(d, s, row);
+                s += stride;
+                d += row;
+        }
+}
+
+
+/**
+ * read region of next raw full-size frame
+ *
+ * Regular files are mapped and only the rows of the region are touched,
+ * anything else (including compressed files) is read completely (by
+ * reader) & cropped.
+ *
+ * @param dst frame buffer of region dimensions
+ * @result >= 0 on success, < 0 at end of file or on error
+ */
+int region_read_frame(Region * r, RawReader * reader, Events * events,
+                      bool * running, int fd, void *dst)
+{
+        /* new file? */
+        if(fd != r->fd)
+        {
+                region_close(r);
+                _map(r, fd);
+        }
+
+        /* read complete frame */
+        if(!r->map)
+        {
+                char *src;
+                if(!(src = raw_reader_frame(reader, events, running, fd,
+                                            _input_size(r))))
+                        return -1;
+
+                region_crop(r, src, dst);
+                return 0;
+        }
+
+        /* end of file? */
+        size_t size = _input_size(r);
+        if(r->pos + size > r->map_size)
+                return -1;
+
+        region_crop(r, r->map + r->pos, dst);
+        r->pos += size;
+
+        _prefetch(r, r->pos);
+
+        return 0;
+}
+
+
+/**
+ * forget input file (call before closing it)
+ */
+void region_close(Region * r)
+{
+        if(!r)
+                return;
+
+        if(r->map)
+                munmap((void *) r->map, r->map_size);
+
+        r->map = NULL;
+        r->map_size = 0;
+        r->pos = 0;
+        r->fd = -1;
+}
+
+
+/**
+ * free region
+ */
+void region_destroy(Region * r)
+{
+        if(!r)
+                return;
+
+        region_close(r);
+        free(r->buffer);
+        free(r);
+}
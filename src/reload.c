@@ -0,0 +1,423 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * The prefs file is watched with inotify (its directory actually, since
+ * editors tend to replace files instead of writing them). A new setup is
+ * parsed, mapped & gets its gain set on a thread while the current one
+ * keeps playing. Playback swaps it in between two frames & the old setup
+ * is destroyed on the thread again.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <niftyled.h>
+#include "reload.h"
+
+
+/** time to wait for more changes before reloading (milliseconds) */
+#define RELOAD_SETTLE   200
+
+
+
+/** reload thread */
+struct _Reload
+{
+        /** prefs file */
+        char filename[1024];
+        /** name of prefs file without directory */
+        char basename[1024];
+        /** preferences context used by thread */
+        LedPrefs *prefs;
+        /** frame the chains are filled from (mapping is calculated for it) */
+        LedFrame *frame;
+        /** dimensions the setup must have */
+        LedFrameCord width, height;
+        /** inotify descriptor */
+        int inotify;
+        /** pipe waking up thread ([0] = read end, [1] = write end) */
+        int wake[2];
+        /** thread */
+        pthread_t thread;
+        /** true if thread was started */
+        bool started;
+        /** new setup waiting to be swapped in */
+        LedSetup *pending;
+        /** setup swapped out, waiting to be destroyed */
+        LedSetup *old;
+        /** protects everything above */
+        pthread_mutex_t mutex;
+        /** non-zero if pending is set (read without lock) */
+        int ready;
+};
+
+
+
+/** parse prefs & prepare setup for output */
+static LedSetup *_build(Reload * r)
+{
+        LedPrefsNode *n;
+        if(!(n = led_prefs_node_from_file(r->prefs, r->filename)))
+        {
+                NFT_LOG(L_ERROR, "Failed to open configfile \"%s\"",
+                        r->filename);
+                return NULL;
+        }
+
+        LedSetup *s = led_prefs_setup_from_node(r->prefs, n);
+        led_prefs_node_free(n);
+        if(!s)
+        {
+                NFT_LOG(L_ERROR, "No valid setup found in preferences file.");
+                return NULL;
+        }
+
+        /* frame (and everything sized like it) stays the same */
+        LedFrameCord w, h;
+        if(!led_setup_get_dim(s, &w, &h) || w != r->width || h != r->height)
+        {
+                NFT_LOG(L_ERROR,
+                        "Dimensions of setup changed to %dx%d (restart to use them)",
+                        w, h);
+                goto _b_error;
+        }
+
+        /* mapping & gain like at startup */
+        LedHardware *hw, *ch;
+        if(!(hw = led_setup_get_hardware(s)) ||
+           !led_hardware_list_refresh_mapping(hw))
+                goto _b_error;
+        for(ch = hw; ch; ch = led_hardware_list_get_next(ch))
+        {
+                if(!led_chain_map_from_frame
+                   (led_hardware_get_chain(ch), r->frame))
+                        goto _b_error;
+        }
+        if(!led_hardware_list_refresh_gain(hw))
+                goto _b_error;
+
+        return s;
+
+_b_error:
+        led_setup_destroy(s);
+        return NULL;
+}
+
+
+/** true if an inotify event concerns our prefs file */
+static bool _read_events(Reload * r)
+{
+        char buf[4096]
+                __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        bool ours = false;
+
+        ssize_t len = read(r->inotify, buf, sizeof(buf));
+        ssize_t i;
+        for(i = 0; i < len;)
+        {
+                struct inotify_event *e = (struct inotify_event *) &buf[i];
+                if(e->len && strcmp(e->name, r->basename) == 0)
+                        ours = true;
+                i += sizeof(struct inotify_event) + e->len;
+        }
+
+        return ours;
+}
+
+
+/** destroy setup swapped out by playback */
+static void _destroy_old(Reload * r)
+{
+        pthread_mutex_lock(&r->mutex);
+        LedSetup *old = r->old;
+        r->old = NULL;
+        pthread_mutex_unlock(&r->mutex);
+
+        if(old)
+                led_setup_destroy(old);
+}
+
+
+/** thread waiting for changes */
+static void *_reload_thread(void *arg)
+{
+        Reload *r = arg;
+
+        struct pollfd fds[2];
+        fds[0].fd = r->wake[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = r->inotify;
+        fds[1].events = POLLIN;
+
+        for(;;)
+        {
+                if(poll(fds, 2, -1) < 0)
+                {
+                        if(errno == EINTR)
+                                continue;
+                        NFT_LOG_PERROR("poll()");
+                        break;
+                }
+
+                bool changed = false;
+                if(fds[0].revents & POLLIN)
+                {
+                        char c;
+                        if(read(r->wake[0], &c, 1) != 1 || c == 'q')
+                                break;
+                        changed = (c == 'r');
+                }
+                if(fds[1].revents & POLLIN)
+                        changed = _read_events(r) || changed;
+
+                _destroy_old(r);
+
+                if(!changed)
+                        continue;
+
+                /* wait until file isn't written anymore */
+                while(poll(&fds[1], 1, RELOAD_SETTLE) > 0)
+                        _read_events(r);
+
+                NFT_LOG(L_INFO, "Reloading \"%s\"", r->filename);
+
+                LedSetup *s;
+                if(!(s = _build(r)))
+                {
+                        NFT_LOG(L_WARNING, "Keeping previous setup");
+                        continue;
+                }
+
+                /* hand to playback (replacing a setup it didn't take yet) */
+                pthread_mutex_lock(&r->mutex);
+                LedSetup *unused = r->pending;
+                r->pending = s;
+                __atomic_store_n(&r->ready, 1, __ATOMIC_RELEASE);
+                pthread_mutex_unlock(&r->mutex);
+
+                if(unused)
+                        led_setup_destroy(unused);
+        }
+
+        return NULL;
+}
+
+
+/**
+ * start watching prefs file
+ *
+ * @param prefsfile prefs file the current setup was loaded from
+ * @param frame frame the chains are filled from
+ * @param width width new setups must have
+ * @param height height new setups must have
+ * @result reload thread or NULL upon error
+ */
+Reload *reload_new(const char *prefsfile, LedFrame * frame,
+                   LedFrameCord width, LedFrameCord height)
+{
+        if(!prefsfile || !frame)
+                return NULL;
+
+        Reload *r;
+        if(!(r = calloc(1, sizeof(Reload))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        r->inotify = -1;
+        r->wake[0] = r->wake[1] = -1;
+        r->frame = frame;
+        r->width = width;
+        r->height = height;
+        pthread_mutex_init(&r->mutex, NULL);
+
+        strncpy(r->filename, prefsfile, sizeof(r->filename) - 1);
+        char tmp[1024];
+        strncpy(tmp, prefsfile, sizeof(tmp) - 1);
+        tmp[sizeof(tmp) - 1] = '\0';
+        strncpy(r->basename, basename(tmp), sizeof(r->basename) - 1);
+        strncpy(tmp, prefsfile, sizeof(tmp) - 1);
+
+        if(!(r->prefs = led_prefs_init()))
+                goto _rn_error;
+
+        if(pipe(r->wake) < 0)
+        {
+                NFT_LOG_PERROR("pipe()");
+                goto _rn_error;
+        }
+
+        if((r->inotify = inotify_init()) < 0)
+        {
+                NFT_LOG_PERROR("inotify_init()");
+                goto _rn_error;
+        }
+
+        if(inotify_add_watch(r->inotify, dirname(tmp),
+                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to watch \"%s\": %s", r->filename,
+                        strerror(errno));
+                goto _rn_error;
+        }
+
+        if(pthread_create(&r->thread, NULL, _reload_thread, r) != 0)
+        {
+                NFT_LOG_PERROR("pthread_create()");
+                goto _rn_error;
+        }
+        r->started = true;
+
+        NFT_LOG(L_INFO, "Watching \"%s\" for changes", r->filename);
+
+        return r;
+
+_rn_error:
+        reload_destroy(r);
+        return NULL;
+}
+
+
+/**
+ * reload prefs file now (async-signal-safe, so it can be called from
+ * a signal handler)
+ */
+void reload_trigger(Reload * r)
+{
+        if(!r)
+                return;
+
+        char c = 'r';
+        if(write(r->wake[1], &c, 1) != 1)
+                return;
+}
+
+
+/**
+ * swap in reloaded setup (called by playback between frames)
+ *
+ * @param r reload thread
+ * @param s current setup, replaced by the reloaded one
+ * @result NFT_SUCCESS if *s was replaced
+ */
+NftResult reload_swap(Reload * r, LedSetup ** s)
+{
+        if(!r || !s)
+                return NFT_FAILURE;
+
+        /* nothing reloaded (no locking in this case) */
+        if(!__atomic_load_n(&r->ready, __ATOMIC_ACQUIRE))
+                return NFT_FAILURE;
+
+        pthread_mutex_lock(&r->mutex);
+
+        /* previous setup not destroyed yet? try again next frame */
+        if(r->old)
+        {
+                pthread_mutex_unlock(&r->mutex);
+                return NFT_FAILURE;
+        }
+
+        r->old = *s;
+        *s = r->pending;
+        r->pending = NULL;
+        __atomic_store_n(&r->ready, 0, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&r->mutex);
+
+        /* let thread destroy old setup */
+        char c = 'd';
+        if(write(r->wake[1], &c, 1) != 1)
+                NFT_LOG_PERROR("write()");
+
+        NFT_LOG(L_INFO, "Setup reloaded");
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * stop thread and free everything
+ */
+void reload_destroy(Reload * r)
+{
+        if(!r)
+                return;
+
+        if(r->started)
+        {
+                char c = 'q';
+                if(write(r->wake[1], &c, 1) != 1)
+                        NFT_LOG_PERROR("write()");
+                pthread_join(r->thread, NULL);
+        }
+
+        if(r->pending)
+                led_setup_destroy(r->pending);
+        if(r->old)
+                led_setup_destroy(r->old);
+
+        if(r->inotify >= 0)
+                close(r->inotify);
+        if(r->wake[0] >= 0)
+        {
+                close(r->wake[0]);
+                close(r->wake[1]);
+        }
+
+        if(r->prefs)
+                led_prefs_deinit(r->prefs);
+
+        pthread_mutex_destroy(&r->mutex);
+        free(r);
+}
@@ -0,0 +1,514 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <niftyled.h>
+#include "simd.h"
+#include "format.h"
+#include "scale.h"
+
+
+/** coefficient table for one axis */
+typedef struct
+{
+        /** length of source axis this table was built for */
+        LedFrameCord src;
+        /** amount of taps per destination coordinate */
+        int taps;
+        /** source index of each tap (dst * taps) */
+        int *index;
+        /** weight of each tap (dst * taps) */
+        float *weight;
+        /** true for every source index that has a weight (src) */
+        bool *used;
+} ScaleTable;
+
+
+/** scaler descriptor */
+struct _Scaler
+{
+        /** filter */
+        ScaleMode mode;
+        /** destination width */
+        LedFrameCord width;
+        /** destination height */
+        LedFrameCord height;
+        /** amount of components per pixel */
+        size_t components;
+        /** size of one component in bytes */
+        size_t size;
+        /** buffer for one source frame */
+        void *src;
+        /** size of src in bytes */
+        size_t src_size;
+        /** horizontal coefficients */
+        ScaleTable x;
+        /** vertical coefficients */
+        ScaleTable y;
+        /** horizontally scaled source rows (src height * width * components) */
+        float *tmp;
+        /** size of tmp in floats */
+        size_t tmp_size;
+        /** one vertically accumulated destination row */
+        float *row;
+};
+
+
+
+/** free coefficients */
+static void _table_free(ScaleTable * t)
+{
+        free(t->index);
+        free(t->weight);
+        free(t->used);
+        t->index = NULL;
+        t->weight = NULL;
+        t->used = NULL;
+        t->src = 0;
+}
+
+
+/** (re)build coefficient table for scaling src to dst coordinates */
+static NftResult _table_build(ScaleTable * t, ScaleMode mode,
+                              LedFrameCord src, LedFrameCord dst)
+{
+        /* nothing to do? */
+        if(t->src == src)
+                return NFT_SUCCESS;
+
+        _table_free(t);
+
+        double scale = (double) src / dst;
+
+        t->taps = (mode == SCALE_BOX) ? (int) ceil(scale) + 1 : 2;
+        if(!(t->index = calloc(dst * t->taps, sizeof(int))) ||
+           !(t->weight = calloc(dst * t->taps, sizeof(float))) ||
+           !(t->used = calloc(src, sizeof(bool))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                _table_free(t);
+                return NFT_FAILURE;
+        }
+
+        LedFrameCord i;
+        for(i = 0; i < dst; i++)
+        {
+                int *index = &t->index[i * t->taps];
+                float *weight = &t->weight[i * t->taps];
+                int first, n;
+
+                if(mode == SCALE_BOX)
+                {
+                        /* area of source covered by this pixel */
+                        double a = i * scale, b = (i + 1) * scale;
+                        first = (int) floor(a);
+                        for(n = 0; n < t->taps; n++)
+                        {
+                                double lo = fmax(a, first + n);
+                                double hi = fmin(b, first + n + 1);
+                                weight[n] = (hi > lo) ? (hi - lo) / scale : 0;
+                        }
+                }
+                else
+                {
+                        /* pixel centers */
+                        double c = (i + 0.5) * scale - 0.5;
+                        first = (int) floor(c);
+                        weight[1] = (float) (c - first);
+                        weight[0] = 1.0f - weight[1];
+                }
+
+                /* clamp to source edges (weights of clamped taps add up) */
+                for(n = 0; n < t->taps; n++)
+                {
+                        int j = first + n;
+                        index[n] = (j < 0) ? 0 : ((j >= src) ? src - 1 : j);
+                        if(weight[n] != 0)
+                                t->used[index[n]] = true;
+                }
+        }
+
+        t->src = src;
+        return NFT_SUCCESS;
+}
+
+
+/** 
+ * scale one source row horizontally and store it as float 
+ * (one function per component type to keep the inner loop branch-free)
+ */
+#define SCALE_ROW(name, type)                                                   \
+static void name(Scaler * s, const void *src, float *out)                       \
+{                                                                               \
+        const type *in = src;                                                   \
+        size_t n = s->components;                                               \
+        LedFrameCord x;                                                         \
+        int t;                                                                  \
+        size_t c;                                                               \
+                                                                                \
+        for(x = 0; x < s->width; x++, out += n)                                 \
+        {                                                                       \
+                const int *index = &s->x.index[x * s->x.taps];                  \
+                const float *weight = &s->x.weight[x * s->x.taps];              \
+                                                                                \
+                for(c = 0; c < n; c++)                                          \
+                        out[c] = 0;                                             \
+                                                                                \
+                for(t = 0; t < s->x.taps; t++)                                  \
+                {                                                               \
+                        const type *p = &in[index[t] * n];                      \
+                        float w = weight[t];                                    \
+                        for(c = 0; c < n; c++)                                  \
+                                out[c] += w * p[c];                             \
+                }                                                               \
+        }                                                                       \
+}
+
+SCALE_ROW(_scale_row_u8, uint8_t)
+SCALE_ROW(_scale_row_u16, uint16_t)
+SCALE_ROW(_scale_row_float, float)
+
+
+/** row += w * in (vectorized) */
+static void _accumulate(float *row, const float *in, float w, size_t n)
+{
+        size_t i = 0;
+
+#if SIMD_AVX2
+        __m256 vw = _mm256_set1_ps(w);
+        for(; i + 8 <= n; i += 8)
+        {
+                __m256 r = _mm256_loadu_ps(row + i);
+                r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_loadu_ps(in + i),
+                                                   vw));
+                _mm256_storeu_ps(row + i, r);
+        }
+#elif SIMD_SSE2
+        __m128 vw = _mm_set1_ps(w);
+        for(; i + 4 <= n; i += 4)
+        {
+                __m128 r = _mm_loadu_ps(row + i);
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(in + i), vw));
+                _mm_storeu_ps(row + i, r);
+        }
+#elif SIMD_NEON
+        for(; i + 4 <= n; i += 4)
+        {
+                vst1q_f32(row + i,
+                          vmlaq_n_f32(vld1q_f32(row + i), vld1q_f32(in + i),
+                                      w));
+        }
+#endif
+
+        for(; i < n; i++)
+                row[i] += w * in[i];
+}
+
+
+/** store accumulated row in destination format */
+static void _store_row(Scaler * s, const float *row, void *dst, size_t n)
+{
+        size_t i;
+        switch (s->size)
+        {
+                case 1:
+                {
+                        uint8_t *d = dst;
+                        for(i = 0; i < n; i++)
+                        {
+                                long v = lrintf(row[i]);
+                                d[i] = (v < 0) ? 0 : ((v > 0xff) ? 0xff : v);
+                        }
+                        break;
+                }
+
+                case 2:
+                {
+                        uint16_t *d = dst;
+                        for(i = 0; i < n; i++)
+                        {
+                                long v = lrintf(row[i]);
+                                d[i] = (v < 0) ? 0 : ((v > 0xffff) ? 0xffff :
+                                                      v);
+                        }
+                        break;
+                }
+
+                default:
+                {
+                        memcpy(dst, row, n * sizeof(float));
+                        break;
+                }
+        }
+}
+
+
+
+/**
+ * parse name of scaling filter
+ *
+ * @param s "box" or "bilinear"
+ * @param mode space for result
+ * @result NFT_SUCCESS or NFT_FAILURE
+ */
+NftResult scale_mode_from_string(const char *s, ScaleMode * mode)
+{
+        if(strcmp(s, "box") == 0)
+                *mode = SCALE_BOX;
+        else if(strcmp(s, "bilinear") == 0)
+                *mode = SCALE_BILINEAR;
+        else
+                return NFT_FAILURE;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * get name of scaling filter
+ */
+const char *scale_mode_to_string(ScaleMode mode)
+{
+        switch (mode)
+        {
+                case SCALE_BOX:
+                        return "box";
+                case SCALE_BILINEAR:
+                        return "bilinear";
+                default:
+                        return "none";
+        }
+}
+
+
+/**
+ * create new scaler
+ *
+ * @param mode scaling filter
+ * @param f pixelformat of source and destination
+ * @param width destination width
+ * @param height destination height
+ * @result new scaler or NULL
+ */
+Scaler *scaler_new(ScaleMode mode, LedPixelFormat * f, LedFrameCord width,
+                   LedFrameCord height)
+{
+        size_t size = format_component_size(f);
+        bool is_float = (size == 4 && !format_is_unsigned(f) &&
+                         strcmp(led_pixel_format_get_component_type(f, 0),
+                                "float") == 0);
+
+        if(!((format_is_unsigned(f) && (size == 1 || size == 2)) || is_float))
+        {
+                NFT_LOG(L_ERROR,
+                        "Scaling only supports u8, u16 and float pixelformats (not \"%s\")",
+                        led_pixel_format_to_string(f));
+                return NULL;
+        }
+
+        Scaler *s;
+        if(!(s = calloc(1, sizeof(Scaler))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        s->mode = mode;
+        s->width = width;
+        s->height = height;
+        s->components = led_pixel_format_get_n_components(f);
+        s->size = size;
+
+        if(!(s->row = malloc(width * s->components * sizeof(float))))
+        {
+                NFT_LOG_PERROR("malloc()");
+                free(s);
+                return NULL;
+        }
+
+        NFT_LOG(L_INFO, "Scaling input to %dx%d (%s, %s)", width, height,
+                scale_mode_to_string(mode), SIMD_NAME);
+
+        return s;
+}
+
+
+/**
+ * get buffer big enough for a source frame of the given size
+ *
+ * @param s scaler acquired by scaler_new()
+ * @param src_width width of source frame
+ * @param src_height height of source frame
+ * @result buffer (owned by scaler, valid until next call) or NULL
+ */
+void *scaler_get_buffer(Scaler * s, LedFrameCord src_width,
+                        LedFrameCord src_height)
+{
+        size_t size = src_width * src_height * s->components * s->size;
+
+        if(s->src_size < size)
+        {
+                free(s->src);
+                s->src_size = size;
+                if(!(s->src = malloc(size)))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        s->src_size = 0;
+                        return NULL;
+                }
+        }
+
+        return s->src;
+}
+
+
+/**
+ * scale a raw frame to the dimensions of the scaler
+ *
+ * @param s scaler acquired by scaler_new()
+ * @param src raw source frame (native byte order)
+ * @param src_width width of source frame
+ * @param src_height height of source frame
+ * @param dst raw destination frame
+ * @result NFT_SUCCESS or NFT_FAILURE
+ */
+NftResult scaler_run(Scaler * s, const void *src, LedFrameCord src_width,
+                     LedFrameCord src_height, void *dst)
+{
+        if(src_width <= 0 || src_height <= 0)
+                return NFT_FAILURE;
+
+        size_t stride = src_width * s->components * s->size;
+        size_t n = s->width * s->components;
+
+        /* same size? */
+        if(src_width == s->width && src_height == s->height)
+        {
+                memcpy(dst, src, stride * src_height);
+                return NFT_SUCCESS;
+        }
+
+        /* coefficients are only recalculated when source size changes */
+        if(!_table_build(&s->x, s->mode, src_width, s->width) ||
+           !_table_build(&s->y, s->mode, src_height, s->height))
+                return NFT_FAILURE;
+
+        /* buffer for horizontally scaled rows */
+        if(s->tmp_size < src_height * n)
+        {
+                free(s->tmp);
+                s->tmp_size = src_height * n;
+                if(!(s->tmp = malloc(s->tmp_size * sizeof(float))))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        s->tmp_size = 0;
+                        return NFT_FAILURE;
+                }
+        }
+
+        /* horizontal pass (skip rows that don't contribute) */
+        LedFrameCord y;
+        for(y = 0; y < src_height; y++)
+        {
+                if(!s->y.used[y])
+                        continue;
+
+                const void *in = (const uint8_t *) src + y * stride;
+                switch (s->size)
+                {
+                        case 1:
+                                _scale_row_u8(s, in, &s->tmp[y * n]);
+                                break;
+                        case 2:
+                                _scale_row_u16(s, in, &s->tmp[y * n]);
+                                break;
+                        default:
+                                _scale_row_float(s, in, &s->tmp[y * n]);
+                                break;
+                }
+        }
+
+        /* vertical pass */
+        for(y = 0; y < s->height; y++)
+        {
+                const int *index = &s->y.index[y * s->y.taps];
+                const float *weight = &s->y.weight[y * s->y.taps];
+                int t;
+
+                memset(s->row, 0, n * sizeof(float));
+                for(t = 0; t < s->y.taps; t++)
+                {
+                        if(weight[t] == 0)
+                                continue;
+
+                        _accumulate(s->row, &s->tmp[index[t] * n], weight[t],
+                                    n);
+                }
+
+                _store_row(s, s->row,
+                           (uint8_t *) dst + y * n * s->size, n);
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * free scaler and all its resources
+ *
+ * @param s scaler acquired by scaler_new()
+ */
+void scaler_destroy(Scaler * s)
+{
+        if(!s)
+                return;
+
+        _table_free(&s->x);
+        _table_free(&s->y);
+        free(s->src);
+        free(s->tmp);
+        free(s->row);
+        free(s);
+}
@@ -0,0 +1,71 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SCALE_H
+#define _SCALE_H
+
+
+/** scaling filters */
+typedef enum
+{
+        /** don't scale (crop input to frame dimensions) */
+        SCALE_NONE = 0,
+        /** area average (best for downscaling) */
+        SCALE_BOX,
+        /** bilinear interpolation (best for upscaling) */
+        SCALE_BILINEAR,
+} ScaleMode;
+
+/** scaler that resamples frames of any size to the frame dimensions */
+typedef struct _Scaler          Scaler;
+
+
+NftResult                       scale_mode_from_string(const char *s, ScaleMode * mode);
+const char                     *scale_mode_to_string(ScaleMode mode);
+Scaler                         *scaler_new(ScaleMode mode, LedPixelFormat * f, LedFrameCord width, LedFrameCord height);
+void                           *scaler_get_buffer(Scaler * s, LedFrameCord src_width, LedFrameCord src_height);
+NftResult                       scaler_run(Scaler * s, const void *src, LedFrameCord src_width, LedFrameCord src_height, void *dst);
+void                            scaler_destroy(Scaler * s);
+
+
+#endif /** _SCALE_H */
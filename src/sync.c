@@ -0,0 +1,647 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Instances of a group latch frames on a common grid: frame n is latched
+ * at epoch + n / rate. The grid is laid on CLOCK_REALTIME, so hosts need
+ * their clocks disciplined (NTP or PTP). Instances on one host share the
+ * clock anyway.
+ *
+ * Every instance multicasts a beacon (UDP) after latching a frame that
+ * carries the epoch, the index of the content frame & the time it was
+ * latched. Content frames are counted from the slot the first one was
+ * latched in, one per frame shown (however long it's held).
+ * Multicast is looped back, so instances on the same host sync the same
+ * way as instances on other hosts do.
+ *
+ * Joining: an instance proposes an epoch SYNC_JOIN seconds ahead & 
+ * announces it until SYNC_COMMIT seconds before that epoch. Meanwhile it
+ * takes over any later epoch proposed by others (so all instances started
+ * within SYNC_JOIN agree on the latest proposal) or the epoch of an
+ * instance that already committed (so instances started later join the
+ * running grid at its current frame).
+ *
+ * Slots are counted from the time the previous frame was due, so a frame
+ * latched late doesn't make the next one skip a slot & the following
+ * frames catch up. Only when falling behind more than SYNC_RESYNC seconds,
+ * slots are skipped.
+ *
+ * Skew is measured by comparing the time every other instance latched a
+ * content frame with the time we latched the same one & reported
+ * periodically (an instance that fell a slot behind shows up with a skew
+ * of a whole frame).
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <niftyled.h>
+#include "events.h"
+#include "sync.h"
+
+
+/** identifies beacons */
+#define SYNC_MAGIC              "LCSY"
+/** version of beacon layout */
+#define SYNC_VERSION            1
+/** size of a beacon in bytes */
+#define SYNC_BEACON_SIZE        48
+/** beacon flag: epoch is committed */
+#define SYNC_COMMITTED          (1 << 0)
+/** seconds from start to proposed epoch */
+#define SYNC_JOIN               2.0
+/** seconds before epoch it can't change anymore */
+#define SYNC_COMMIT             0.5
+/** seconds between beacons while joining */
+#define SYNC_ANNOUNCE           0.05
+/** seconds behind the grid before frames are skipped */
+#define SYNC_RESYNC             1
+/** seconds between skew reports */
+#define SYNC_REPORT             5
+/** seconds without beacon until an instance is considered gone */
+#define SYNC_TIMEOUT            5
+/** amount of latched frames remembered to compare */
+#define SYNC_HISTORY            64
+/** maximum amount of other instances */
+#define SYNC_MAX_PEERS          32
+
+/** nanoseconds per second */
+#define NSEC                    1000000000LL
+
+
+/** time a frame was latched */
+struct Latch
+{
+        /** frame index (-1 = unused) */
+        int64_t frame;
+        /** CLOCK_REALTIME in nanoseconds */
+        int64_t time;
+};
+
+/** another instance of the group */
+struct Peer
+{
+        /** random id (0 = unused slot) */
+        uint32_t id;
+        /** time the last beacon arrived (CLOCK_REALTIME in nanoseconds) */
+        int64_t seen;
+        /** true once a differing epoch or rate was reported */
+        bool warned;
+        /** frames latched recently (indexed by frame % SYNC_HISTORY) */
+        struct Latch history[SYNC_HISTORY];
+        /** sum of skews since last report in milliseconds */
+        double skew_sum;
+        /** largest absolute skew since last report in milliseconds */
+        double skew_max;
+        /** amount of skews since last report */
+        unsigned int skew_count;
+};
+
+/** sync descriptor */
+struct _Sync
+{
+        /** multicast socket */
+        int sock;
+        /** multicast group & port */
+        struct sockaddr_in group;
+        /** random id of this instance */
+        uint32_t id;
+        /** frames per second of grid */
+        int rate;
+        /** time of frame 0 (CLOCK_REALTIME in nanoseconds) */
+        int64_t epoch;
+        /** true when epoch can't change anymore */
+        bool committed;
+        /** slot frame is latched in next */
+        int64_t frame;
+        /** slot frame was latched in last (-1 = none) */
+        int64_t last;
+        /** time it was latched (CLOCK_REALTIME in nanoseconds) */
+        int64_t latched;
+        /** index of content frame latched next */
+        int64_t content;
+        /** index of content frame latched last (-1 = none) */
+        int64_t shown;
+        /** content frames latched recently (by index % SYNC_HISTORY) */
+        struct Latch history[SYNC_HISTORY];
+        /** other instances */
+        struct Peer peers[SYNC_MAX_PEERS];
+        /** frames skipped since last report */
+        int64_t skipped;
+};
+
+
+
+static uint32_t _get32(const uint8_t * b)
+{
+        return (uint32_t) b[0] | ((uint32_t) b[1] << 8) |
+                ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24);
+}
+
+
+static uint64_t _get64(const uint8_t * b)
+{
+        return (uint64_t) _get32(b) | ((uint64_t) _get32(b + 4) << 32);
+}
+
+
+static void _put32(uint8_t * b, uint32_t v)
+{
+        b[0] = v;
+        b[1] = v >> 8;
+        b[2] = v >> 16;
+        b[3] = v >> 24;
+}
+
+
+static void _put64(uint8_t * b, uint64_t v)
+{
+        _put32(b, (uint32_t) v);
+        _put32(b + 4, (uint32_t) (v >> 32));
+}
+
+
+/** current time of clock in nanoseconds */
+static int64_t _now(clockid_t clock)
+{
+        struct timespec t;
+        clock_gettime(clock, &t);
+        return (int64_t) t.tv_sec * NSEC + t.tv_nsec;
+}
+
+
+/** monotonic time (in nanoseconds) of a CLOCK_REALTIME point in time */
+static struct timespec _monotonic(int64_t realtime)
+{
+        int64_t t = _now(CLOCK_MONOTONIC) + realtime - _now(CLOCK_REALTIME);
+        struct timespec ts = {.tv_sec = t / NSEC,.tv_nsec = t % NSEC };
+        return ts;
+}
+
+
+/** time of a frame on the grid (CLOCK_REALTIME in nanoseconds) */
+static int64_t _slot(Sync * s, int64_t frame)
+{
+        return s->epoch + frame / s->rate * NSEC +
+                frame % s->rate * NSEC / s->rate;
+}
+
+
+/** remember time a frame was latched */
+static void _remember(struct Latch *history, int64_t frame, int64_t time)
+{
+        struct Latch *l = &history[frame % SYNC_HISTORY];
+        l->frame = frame;
+        l->time = time;
+}
+
+
+/** time a frame was latched (-1 if it's not remembered) */
+static int64_t _recall(struct Latch *history, int64_t frame)
+{
+        struct Latch *l = &history[frame % SYNC_HISTORY];
+        return l->frame == frame ? l->time : -1;
+}
+
+
+/** account skew of one frame (positive = peer latched later) */
+static void _skew(struct Peer *p, int64_t peer, int64_t own)
+{
+        double ms = (double) (peer - own) / 1000000;
+
+        p->skew_sum += ms;
+        if(fabs(ms) > p->skew_max)
+                p->skew_max = fabs(ms);
+        p->skew_count++;
+}
+
+
+/** multicast beacon (frame -1 while no frame was latched) */
+static void _send(Sync * s, int64_t frame, int64_t latched)
+{
+        uint8_t b[SYNC_BEACON_SIZE];
+        memset(b, 0, sizeof(b));
+        memcpy(b, SYNC_MAGIC, 4);
+        _put32(b + 4, SYNC_VERSION);
+        _put32(b + 8, s->id);
+        _put32(b + 12, s->committed ? SYNC_COMMITTED : 0);
+        _put32(b + 16, s->rate);
+        _put64(b + 24, s->epoch);
+        _put64(b + 32, frame);
+        _put64(b + 40, latched);
+
+        if(sendto(s->sock, b, sizeof(b), MSG_DONTWAIT,
+                  (struct sockaddr *) &s->group, sizeof(s->group)) < 0 &&
+           errno != EAGAIN)
+                NFT_LOG_PERROR("sendto()");
+}
+
+
+/** get slot of instance (allocate one if it's new, NULL if full) */
+static struct Peer *_peer(Sync * s, uint32_t id)
+{
+        struct Peer *free = NULL;
+        int i;
+        for(i = 0; i < SYNC_MAX_PEERS; i++)
+        {
+                if(s->peers[i].id == id)
+                        return &s->peers[i];
+                if(!free && !s->peers[i].id)
+                        free = &s->peers[i];
+        }
+
+        if(!free)
+                return NULL;
+
+        memset(free, 0, sizeof(*free));
+        free->id = id;
+        for(i = 0; i < SYNC_HISTORY; i++)
+                free->history[i].frame = -1;
+
+        NFT_LOG(L_INFO, "Sync: instance %08x joined", id);
+        return free;
+}
+
+
+/** handle beacon of another instance */
+static void _beacon(Sync * s, const uint8_t * b)
+{
+        uint32_t id = _get32(b + 8);
+        bool committed = _get32(b + 12) & SYNC_COMMITTED;
+        int rate = (int) _get32(b + 16);
+        int64_t epoch = (int64_t) _get64(b + 24);
+        int64_t frame = (int64_t) _get64(b + 32);
+        int64_t latched = (int64_t) _get64(b + 40);
+
+        /* our own beacon looped back? */
+        if(id == s->id)
+                return;
+
+        struct Peer *p;
+        if(!(p = _peer(s, id)))
+                return;
+        p->seen = _now(CLOCK_REALTIME);
+
+        /* agree on epoch */
+        if(!s->committed)
+        {
+                if(committed)
+                {
+                        s->epoch = epoch;
+                        s->committed = true;
+                }
+                else if(epoch > s->epoch)
+                        s->epoch = epoch;
+        }
+        else if(committed && (epoch != s->epoch || rate != s->rate) &&
+                !p->warned)
+        {
+                NFT_LOG(L_WARNING,
+                        "Sync: instance %08x plays another grid (%d fps, started %.3f s apart)",
+                        id, rate, (double) (epoch - s->epoch) / NSEC);
+                p->warned = true;
+        }
+
+        if(frame < 0)
+                return;
+
+        /* compare with the time we latched this frame (if we did) */
+        _remember(p->history, frame, latched);
+        int64_t own;
+        if((own = _recall(s->history, frame)) >= 0)
+                _skew(p, latched, own);
+}
+
+
+/** read all pending beacons */
+static void _receive(void *arg)
+{
+        Sync *s = arg;
+        uint8_t b[SYNC_BEACON_SIZE];
+        ssize_t r;
+
+        while((r = recv(s->sock, b, sizeof(b), MSG_DONTWAIT)) >= 0)
+        {
+                if(r == SYNC_BEACON_SIZE &&
+                   memcmp(b, SYNC_MAGIC, 4) == 0 &&
+                   _get32(b + 4) == SYNC_VERSION)
+                        _beacon(s, b);
+        }
+
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+                NFT_LOG_PERROR("recv()");
+}
+
+
+/** report skew to every other instance */
+static void _report(void *arg)
+{
+        Sync *s = arg;
+        int64_t now = _now(CLOCK_REALTIME);
+
+        int i;
+        for(i = 0; i < SYNC_MAX_PEERS; i++)
+        {
+                struct Peer *p = &s->peers[i];
+                if(!p->id)
+                        continue;
+
+                if(now - p->seen > SYNC_TIMEOUT * NSEC)
+                {
+                        NFT_LOG(L_INFO, "Sync: instance %08x left", p->id);
+                        p->id = 0;
+                        continue;
+                }
+
+                if(!p->skew_count)
+                        continue;
+
+                double avg = p->skew_sum / p->skew_count;
+                NFT_LOG(L_INFO,
+                        "Sync: skew to instance %08x: %+.3f ms (%+.2f frames) avg, %.3f ms max (%u frames)",
+                        p->id, avg, avg * s->rate / 1000, p->skew_max,
+                        p->skew_count);
+                p->skew_sum = 0;
+                p->skew_max = 0;
+                p->skew_count = 0;
+        }
+
+        if(s->skipped)
+        {
+                NFT_LOG(L_WARNING,
+                        "Sync: skipped %lld frames to catch up with group",
+                        (long long) s->skipped);
+                s->skipped = 0;
+        }
+}
+
+
+/** open multicast socket of group ("<address>:<port>") */
+static NftResult _open(Sync * s, const char *group)
+{
+        char addr[INET_ADDRSTRLEN];
+        unsigned int port;
+        if(sscanf(group, "%15[0-9.]:%5u", addr, &port) != 2 || !port ||
+           port > 65535 || inet_pton(AF_INET, addr,
+                                     &s->group.sin_addr) != 1 ||
+           !IN_MULTICAST(ntohl(s->group.sin_addr.s_addr)))
+        {
+                NFT_LOG(L_ERROR,
+                        "Invalid sync group \"%s\" (Use a multicast address like 239.255.76.67:7667)",
+                        group);
+                return NFT_FAILURE;
+        }
+        s->group.sin_family = AF_INET;
+        s->group.sin_port = htons(port);
+
+        if((s->sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+        {
+                NFT_LOG_PERROR("socket()");
+                return NFT_FAILURE;
+        }
+
+        /* several instances on one host listen to the same group */
+        int on = 1;
+        unsigned char ttl = 1, loop = 1;
+        struct ip_mreq mreq = {.imr_multiaddr = s->group.sin_addr,
+                .imr_interface.s_addr = htonl(INADDR_ANY)
+        };
+        if(setsockopt(s->sock, SOL_SOCKET, SO_REUSEADDR, &on,
+                      sizeof(on)) < 0 ||
+           bind(s->sock, (struct sockaddr *) &s->group,
+                sizeof(s->group)) < 0 ||
+           setsockopt(s->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                      sizeof(mreq)) < 0 ||
+           setsockopt(s->sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl,
+                      sizeof(ttl)) < 0 ||
+           setsockopt(s->sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+                      sizeof(loop)) < 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to join sync group \"%s\": %s",
+                        group, strerror(errno));
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+
+/**
+ * join group of instances & agree on the time of frame 0
+ *
+ * @param e event loop beacons are received in
+ * @param running set to false to stop waiting for others
+ * @param group multicast group ("<address>:<port>")
+ * @param rate frames per second of grid
+ * @result newly allocated sync or NULL
+ */
+Sync *sync_new(Events * e, bool * running, const char *group, int rate)
+{
+        if(rate <= 0)
+                return NULL;
+
+        Sync *s;
+        if(!(s = calloc(1, sizeof(Sync))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+        s->sock = -1;
+        s->rate = rate;
+        s->last = -1;
+        s->shown = -1;
+        int i;
+        for(i = 0; i < SYNC_HISTORY; i++)
+                s->history[i].frame = -1;
+
+        /* random id to tell instances (and our looped back beacons) apart */
+        uint64_t x = (uint64_t) _now(CLOCK_REALTIME) ^
+                ((uint64_t) getpid() << 32) ^ (uint64_t) _now(CLOCK_MONOTONIC);
+        do
+        {
+                x += 0x9e3779b97f4a7c15ULL;
+                uint64_t z = x;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                s->id = (uint32_t) (z ^ (z >> 31));
+        }
+        while(!s->id);
+
+        if(!_open(s, group) ||
+           !events_watch(e, s->sock, _receive, s) ||
+           !events_every(e, SYNC_REPORT, _report, s))
+                goto _sn_error;
+
+        /* propose epoch & take over later ones until it's committed */
+        s->epoch = _now(CLOCK_REALTIME) + (int64_t) (SYNC_JOIN * NSEC);
+        NFT_LOG(L_INFO, "Sync: waiting for instances to join %s (id %08x)",
+                group, s->id);
+        while(*running && !s->committed)
+        {
+                int64_t now = _now(CLOCK_REALTIME);
+                int64_t commit = s->epoch - (int64_t) (SYNC_COMMIT * NSEC);
+                if(now >= commit)
+                {
+                        s->committed = true;
+                        break;
+                }
+
+                _send(s, -1, 0);
+
+                int64_t next = now + (int64_t) (SYNC_ANNOUNCE * NSEC);
+                struct timespec t = _monotonic(next < commit ? next : commit);
+                if(!events_wait_until(e, &t))
+                        goto _sn_error;
+        }
+        if(!*running)
+                goto _sn_error;
+
+        int64_t ahead = s->epoch - _now(CLOCK_REALTIME);
+        if(ahead >= 0)
+                NFT_LOG(L_INFO, "Sync: playing starts in %.3f s",
+                        (double) ahead / NSEC);
+        else
+                NFT_LOG(L_INFO, "Sync: joined running group at frame %lld",
+                        (long long) (-ahead * rate / NSEC));
+
+        return s;
+
+_sn_error:
+        sync_destroy(s);
+        return NULL;
+}
+
+
+/**
+ * get the time to latch the next frame (the slot of the grid closest to
+ * the time it would be latched without syncing, counted from the slot of
+ * the previous frame)
+ *
+ * @param earliest time frame would be latched (CLOCK_MONOTONIC)
+ * @param deadline space for time to latch it (CLOCK_MONOTONIC, may be
+ *        earliest)
+ */
+void sync_deadline(Sync * s, const struct timespec *earliest,
+                   struct timespec *deadline)
+{
+        int64_t now = _now(CLOCK_REALTIME);
+        int64_t t = now + (int64_t) earliest->tv_sec * NSEC +
+                earliest->tv_nsec - _now(CLOCK_MONOTONIC);
+
+        /* closest slot (after the last one). Frames are due relative to
+         * the time the previous one was latched, so count slots from its
+         * slot (latching late mustn't make this one skip a slot) */
+        int64_t frame;
+        if(s->last < 0)
+                frame = llround((double) (t - s->epoch) * s->rate / NSEC);
+        else
+        {
+                int64_t n = llround((double) (t - s->latched) * s->rate /
+                                    NSEC);
+                frame = s->last + (n > 1 ? n : 1);
+        }
+        if(frame < 0)
+                frame = 0;
+
+        /* first frame or fell too far behind? skip to next slot ahead */
+        int64_t late = now - _slot(s, frame);
+        if((s->last < 0 && late > 0) || late > SYNC_RESYNC * NSEC)
+        {
+                int64_t ahead = (now - s->epoch) * s->rate / NSEC + 1;
+                if(s->last >= 0)
+                        s->skipped += ahead - frame;
+                frame = ahead;
+        }
+
+        s->frame = frame;
+        s->content = s->shown < 0 ? frame : s->shown + 1;
+        *deadline = _monotonic(_slot(s, frame));
+}
+
+
+/**
+ * frame was latched at its deadline, tell the group
+ */
+void sync_shown(Sync * s)
+{
+        int64_t now = _now(CLOCK_REALTIME);
+
+        s->last = s->frame;
+        s->latched = now;
+        s->shown = s->content;
+        _remember(s->history, s->content, now);
+
+        /* compare with others that were faster */
+        int i;
+        for(i = 0; i < SYNC_MAX_PEERS; i++)
+        {
+                struct Peer *p = &s->peers[i];
+                int64_t peer;
+                if(p->id && (peer = _recall(p->history, s->content)) >= 0)
+                        _skew(p, peer, now);
+        }
+
+        _send(s, s->content, now);
+}
+
+
+/**
+ * leave group
+ */
+void sync_destroy(Sync * s)
+{
+        if(!s)
+                return;
+
+        if(s->sock >= 0)
+                close(s->sock);
+        free(s);
+}
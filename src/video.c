@@ -0,0 +1,527 @@
+/*
+ * ledcat - CLI tool to send greyscale values to LED devices using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavutil/avutil.h>
+#include <niftyled.h>
+#include "format.h"
+#include "events.h"
+#include "video.h"
+
+
+/** amount of frames decoded ahead */
+#define VIDEO_RING 4
+
+
+/** video descriptor */
+struct _Video
+{
+        /** demuxer */
+        AVFormatContext *format;
+        /** decoder */
+        AVCodecContext *codec;
+        /** index of video stream */
+        int stream;
+        /** converter/scaler to frame format & dimensions */
+        struct SwsContext *sws;
+        /** pixelformat of output frames */
+        enum AVPixelFormat pixfmt;
+        /** output dimensions */
+        LedFrameCord width, height;
+        /** size of one output frame in bytes */
+        size_t size;
+        /** ring of decoded frames */
+        char *ring[VIDEO_RING];
+        /** presentation time of every frame in ring (seconds) */
+        double pts[VIDEO_RING];
+        /** first frame in ring */
+        int head;
+        /** frames in ring */
+        int count;
+        /** pts of first frame */
+        double start;
+        /** pts of last frame decoded */
+        double last;
+        /** seconds between frames (for frames without timestamp) */
+        double step;
+        /** true after first frame */
+        bool started;
+        /** true when decoder reached end of stream */
+        bool eof;
+        /** true to stop decoder thread */
+        bool stop;
+        /** true if thread is running */
+        bool thread_running;
+        /** decoder thread */
+        pthread_t thread;
+        /** protects ring */
+        pthread_mutex_t mutex;
+        /** signalled when a frame was added to or taken from the ring */
+        pthread_cond_t changed;
+        /** eventfd written when a frame was added or the decoder ended
+            (the reader waits for it in the event loop, so signals are
+            handled meanwhile) */
+        int ready;
+};
+
+
+
+/** log libav error */
+static void _av_error(const char *what, int err)
+{
+        char msg[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(err, msg, sizeof(msg));
+        NFT_LOG(L_ERROR, "%s: %s", what, msg);
+}
+
+
+/** wake up reader waiting for a frame */
+static void _ready(Video * v)
+{
+        uint64_t one = 1;
+        if(write(v->ready, &one, sizeof(one)) != sizeof(one))
+                NFT_LOG_PERROR("write()");
+}
+
+
+/** reset wake-up descriptor (before checking the ring) */
+static void _unready(Video * v)
+{
+        uint64_t n;
+        if(read(v->ready, &n, sizeof(n)) < 0 && errno != EAGAIN)
+                NFT_LOG_PERROR("read()");
+}
+
+
+/** abort blocking libav I/O when decoder is stopped */
+static int _interrupt(void *arg)
+{
+        Video *v = arg;
+        pthread_mutex_lock(&v->mutex);
+        bool stop = v->stop;
+        pthread_mutex_unlock(&v->mutex);
+        return stop;
+}
+
+
+/** find libav pixelformat matching LedPixelFormat */
+static enum AVPixelFormat _pixfmt(LedPixelFormat * f)
+{
+        static const struct
+        {
+                const char *colorspace;
+                size_t size;
+                enum AVPixelFormat fmt;
+        } map[] =
+        {
+                {"RGB", 1, AV_PIX_FMT_RGB24},
+                {"BGR", 1, AV_PIX_FMT_BGR24},
+                {"RGBA", 1, AV_PIX_FMT_RGBA},
+                {"BGRA", 1, AV_PIX_FMT_BGRA},
+                {"ARGB", 1, AV_PIX_FMT_ARGB},
+                {"Y", 1, AV_PIX_FMT_GRAY8},
+                {"Y", 2, AV_PIX_FMT_GRAY16},
+                {"RGB", 2, AV_PIX_FMT_RGB48},
+                {"BGR", 2, AV_PIX_FMT_BGR48},
+                {"RGBA", 2, AV_PIX_FMT_RGBA64},
+                {"BGRA", 2, AV_PIX_FMT_BGRA64},
+        };
+
+        if(!format_is_unsigned(f))
+                return AV_PIX_FMT_NONE;
+
+        /* colorspace without primes (R'G'B' -> RGB) */
+        char colorspace[8];
+        size_t n, i;
+        for(n = 0; n < sizeof(colorspace) - 1; n++)
+        {
+                if(!(colorspace[n] = format_component_name(f, n)))
+                        break;
+        }
+        colorspace[n] = '\0';
+
+        for(i = 0; i < sizeof(map) / sizeof(map[0]); i++)
+        {
+                if(strcmp(map[i].colorspace, colorspace) == 0 &&
+                   map[i].size == format_component_size(f))
+                        return map[i].fmt;
+        }
+
+        return AV_PIX_FMT_NONE;
+}
+
+
+/** convert decoded frame into ring (blocks while ring is full) */
+static NftResult _emit(Video * v, AVFrame * frame)
+{
+        pthread_mutex_lock(&v->mutex);
+        while(v->count == VIDEO_RING && !v->stop)
+                pthread_cond_wait(&v->changed, &v->mutex);
+        if(v->stop)
+        {
+                pthread_mutex_unlock(&v->mutex);
+                return NFT_FAILURE;
+        }
+        int slot = (v->head + v->count) % VIDEO_RING;
+        pthread_mutex_unlock(&v->mutex);
+
+        /* slot isn't visible to the reader until count is increased */
+        if(!(v->sws = sws_getCachedContext(v->sws,
+                                           frame->width, frame->height,
+                                           frame->format,
+                                           v->width, v->height, v->pixfmt,
+                                           SWS_AREA, NULL, NULL, NULL)))
+        {
+                NFT_LOG(L_ERROR, "Failed to initialize video scaler");
+                return NFT_FAILURE;
+        }
+
+        uint8_t *dst[4] = { (uint8_t *) v->ring[slot], NULL, NULL, NULL };
+        int stride[4] = { (int) (v->size / v->height), 0, 0, 0 };
+        sws_scale(v->sws, (const uint8_t * const *) frame->data,
+                  frame->linesize, 0, frame->height, dst, stride);
+
+        /* presentation time */
+        AVRational tb = v->format->streams[v->stream]->time_base;
+        double pts;
+        if(frame->best_effort_timestamp != AV_NOPTS_VALUE)
+                pts = frame->best_effort_timestamp * av_q2d(tb);
+        else
+                pts = v->last + v->step;
+
+        if(!v->started)
+        {
+                v->start = pts;
+                v->started = true;
+        }
+        v->last = pts;
+
+        pthread_mutex_lock(&v->mutex);
+        v->pts[slot] = pts - v->start;
+        v->count++;
+        pthread_cond_broadcast(&v->changed);
+        pthread_mutex_unlock(&v->mutex);
+        _ready(v);
+
+        return NFT_SUCCESS;
+}
+
+
+/** decoder thread */
+static void *_decode_thread(void *arg)
+{
+        Video *v = arg;
+        AVPacket *packet = av_packet_alloc();
+        AVFrame *frame = av_frame_alloc();
+
+        if(!packet || !frame)
+                goto _dt_end;
+
+        bool flushing = false;
+        while(!flushing)
+        {
+                int err;
+                if((err = av_read_frame(v->format, packet)) < 0)
+                {
+                        /* AVERROR_EXIT: interrupted by video_close() */
+                        if(err != AVERROR_EOF && err != AVERROR_EXIT)
+                                _av_error("av_read_frame()", err);
+
+                        /* drain decoder */
+                        avcodec_send_packet(v->codec, NULL);
+                        flushing = true;
+                }
+                else
+                {
+                        int stream = packet->stream_index;
+                        if(stream == v->stream)
+                                avcodec_send_packet(v->codec, packet);
+                        av_packet_unref(packet);
+                        if(stream != v->stream)
+                                continue;
+                }
+
+                while(avcodec_receive_frame(v->codec, frame) == 0)
+                {
+                        NftResult r = _emit(v, frame);
+                        av_frame_unref(frame);
+                        if(!r)
+                                goto _dt_end;
+                }
+        }
+
+_dt_end:
+        av_frame_free(&frame);
+        av_packet_free(&packet);
+
+        pthread_mutex_lock(&v->mutex);
+        v->eof = true;
+        pthread_cond_broadcast(&v->changed);
+        pthread_mutex_unlock(&v->mutex);
+        _ready(v);
+
+        return NULL;
+}
+
+
+
+/**
+ * open video and start decoding it
+ *
+ * @param filename file to open ("-" for stdin)
+ * @param f pixelformat of output frames
+ * @param width width of output frames
+ * @param height height of output frames
+ * @param fps framerate of frames without timestamp if the stream has none
+ * @result new video or NULL
+ */
+Video *video_open(const char *filename, LedPixelFormat * f,
+                  LedFrameCord width, LedFrameCord height, int fps)
+{
+        enum AVPixelFormat pixfmt;
+        if((pixfmt = _pixfmt(f)) == AV_PIX_FMT_NONE)
+        {
+                NFT_LOG(L_ERROR, "Pixelformat \"%s\" not supported for video",
+                        led_pixel_format_to_string(f));
+                return NULL;
+        }
+
+        Video *v;
+        if(!(v = calloc(1, sizeof(Video))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        pthread_mutex_init(&v->mutex, NULL);
+        pthread_cond_init(&v->changed, NULL);
+        if((v->ready = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        {
+                NFT_LOG_PERROR("eventfd()");
+                goto _vo_error;
+        }
+        v->pixfmt = pixfmt;
+        v->width = width;
+        v->height = height;
+        v->size = led_pixel_format_get_buffer_size(f, width * height);
+
+        int i, err;
+        for(i = 0; i < VIDEO_RING; i++)
+        {
+                if(!(v->ring[i] = malloc(v->size)))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        goto _vo_error;
+                }
+        }
+
+        /* open container (I/O stalled on a pipe can be interrupted by
+         * video_close()) */
+        if(!(v->format = avformat_alloc_context()))
+        {
+                NFT_LOG(L_ERROR, "Failed to allocate video demuxer");
+                goto _vo_error;
+        }
+        v->format->interrupt_callback.callback = _interrupt;
+        v->format->interrupt_callback.opaque = v;
+
+        const char *url = (strcmp(filename, "-") == 0) ? "pipe:0" : filename;
+        if((err = avformat_open_input(&v->format, url, NULL, NULL)) < 0)
+        {
+                _av_error(filename, err);
+                goto _vo_error;
+        }
+
+        if((err = avformat_find_stream_info(v->format, NULL)) < 0)
+        {
+                _av_error("avformat_find_stream_info()", err);
+                goto _vo_error;
+        }
+
+        /* open decoder */
+        const AVCodec *codec;
+        if((v->stream = av_find_best_stream(v->format, AVMEDIA_TYPE_VIDEO,
+                                            -1, -1, &codec, 0)) < 0)
+        {
+                NFT_LOG(L_ERROR, "No video stream found in \"%s\"",
+                        filename);
+                goto _vo_error;
+        }
+
+        if(!(v->codec = avcodec_alloc_context3(codec)))
+                goto _vo_error;
+
+        avcodec_parameters_to_context(v->codec,
+                                      v->format->streams[v->stream]->codecpar);
+        v->codec->pkt_timebase = v->format->streams[v->stream]->time_base;
+
+        /* frames without timestamp follow each other at the framerate of
+         * the stream */
+        AVRational rate = v->format->streams[v->stream]->avg_frame_rate;
+        if(rate.num <= 0 || rate.den <= 0)
+                rate = v->format->streams[v->stream]->r_frame_rate;
+        if(rate.num > 0 && rate.den > 0)
+                v->step = (double) rate.den / rate.num;
+        else
+                v->step = 1.0 / (fps > 0 ? fps : 25);
+        /* let libav choose amount of decoder threads */
+        v->codec->thread_count = 0;
+
+        if((err = avcodec_open2(v->codec, codec, NULL)) < 0)
+        {
+                _av_error("avcodec_open2()", err);
+                goto _vo_error;
+        }
+
+        /* start decoding */
+        if(pthread_create(&v->thread, NULL, _decode_thread, v) != 0)
+        {
+                NFT_LOG_PERROR("pthread_create()");
+                goto _vo_error;
+        }
+        v->thread_running = true;
+
+        NFT_LOG(L_VERBOSE, "Decoding video \"%s\"", filename);
+        return v;
+
+_vo_error:
+        video_close(v);
+        return NULL;
+}
+
+
+/**
+ * get next decoded frame (handles events until it's available)
+ *
+ * @param v video acquired by video_open()
+ * @param events event loop to handle while the decoder is behind
+ * @param running running flag
+ * @param buf raw frame to copy decoded frame to
+ * @param pts space for presentation time in seconds since first frame
+ * @result NFT_SUCCESS or NFT_FAILURE at end of stream or when running
+ *         became false
+ */
+NftResult video_read_frame(Video * v, Events * events, bool * running,
+                           void *buf, double *pts)
+{
+        for(;;)
+        {
+                /* reset before checking, so a frame added meanwhile
+                 * leaves the descriptor readable */
+                _unready(v);
+
+                pthread_mutex_lock(&v->mutex);
+                if(v->count > 0 || v->eof)
+                        break;
+                pthread_mutex_unlock(&v->mutex);
+
+                /* wait for decoder (handling signals meanwhile) */
+                if(!events_wait_fd(events, v->ready, 0) || !*running)
+                        return NFT_FAILURE;
+        }
+
+        if(v->count == 0)
+        {
+                pthread_mutex_unlock(&v->mutex);
+                return NFT_FAILURE;
+        }
+        int slot = v->head;
+        pthread_mutex_unlock(&v->mutex);
+
+        /* decoder doesn't touch this slot until we release it */
+        memcpy(buf, v->ring[slot], v->size);
+        *pts = v->pts[slot];
+
+        pthread_mutex_lock(&v->mutex);
+        v->head = (v->head + 1) % VIDEO_RING;
+        v->count--;
+        pthread_cond_broadcast(&v->changed);
+        pthread_mutex_unlock(&v->mutex);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * stop decoding and free all resources of a video
+ */
+void video_close(Video * v)
+{
+        if(!v)
+                return;
+
+        if(v->thread_running)
+        {
+                pthread_mutex_lock(&v->mutex);
+                v->stop = true;
+                pthread_cond_broadcast(&v->changed);
+                pthread_mutex_unlock(&v->mutex);
+                pthread_join(v->thread, NULL);
+        }
+
+        sws_freeContext(v->sws);
+        avcodec_free_context(&v->codec);
+        avformat_close_input(&v->format);
+
+        int i;
+        for(i = 0; i < VIDEO_RING; i++)
+                free(v->ring[i]);
+
+        if(v->ready >= 0)
+                close(v->ready);
+        pthread_cond_destroy(&v->changed);
+        pthread_mutex_destroy(&v->mutex);
+        free(v);
+}